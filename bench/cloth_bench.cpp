@@ -0,0 +1,303 @@
+// Headless throughput benchmark for Cloth::update.
+//
+//   cloth_bench [--sizes 20,64,128,256,512,1024] [--steps N] [--warmup N]
+//               [--threads N] [--gravity|--no-gravity] [--wind]
+//               [--no-collision] [--sleep] [--solver force|xpbd|implicit|hierarchical]
+//               [--batch N] [--format json|csv] [--output FILE]
+//               [--profile FILE]
+//
+// Each size builds an NxN cloth, runs the warm-up steps, then times `steps`
+// calls to update(). Results go to stdout (or FILE) as JSON or CSV.
+//
+// With --batch N, a ClothBatch of N cloths cycling through the sizes (and a
+// spread of stiffness and damping) is stepped on `threads` threads instead,
+// and the result is the batch throughput in cloth-steps per second.
+//
+// With --profile FILE, every timed phase of every step (on every thread) is
+// also written to FILE as CSV (the last ProfileRing::capacity per thread).
+// Setting CLOTH_TRACE=FILE instead writes the same samples at exit as a
+// Chrome trace, for chrome://tracing or ui.perfetto.dev.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "clothbatch.h"
+#include "clothprofiler.h"
+#include "clothsim.h"
+
+struct BenchConfig {
+    std::vector<int> sizes = {20, 64, 128, 256, 512, 1024};
+    int steps = 100;
+    int warmup = 10;
+    int threads = 1;
+    int batch = 0;
+    bool gravity = true;
+    bool wind = false;
+    bool collision = true;
+    bool sleep = false;
+    std::string solver = "force";
+    std::string format = "json";
+    std::string output;
+    std::string profile;
+};
+
+struct BenchResult {
+    int size = 0;
+    size_t particles = 0;
+    size_t springs = 0;
+    int steps = 0;
+    double seconds = 0.0;
+    PhaseTimings phases;
+};
+
+static void printUsage() {
+    std::cerr << "usage: cloth_bench [--sizes 20,64,...] [--steps N] [--warmup N] [--threads N]\n"
+              << "                   [--gravity|--no-gravity] [--wind] [--no-collision] [--sleep]\n"
+              << "                   [--solver force|xpbd|implicit|hierarchical]\n"
+              << "                   [--batch N] [--format json|csv] [--output FILE] [--profile FILE]\n";
+}
+
+static std::vector<int> parseSizes(const std::string& list) {
+    std::vector<int> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int size = std::atoi(item.c_str());
+        if (size >= 3) sizes.push_back(size);
+    }
+    return sizes;
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--sizes" && hasValue) config.sizes = parseSizes(argv[++i]);
+        else if (arg == "--steps" && hasValue) config.steps = std::atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue) config.warmup = std::atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue) config.threads = std::atoi(argv[++i]);
+        else if (arg == "--solver" && hasValue) config.solver = argv[++i];
+        else if (arg == "--batch" && hasValue) config.batch = std::atoi(argv[++i]);
+        else if (arg == "--format" && hasValue) config.format = argv[++i];
+        else if (arg == "--output" && hasValue) config.output = argv[++i];
+        else if (arg == "--profile" && hasValue) config.profile = argv[++i];
+        else if (arg == "--gravity") config.gravity = true;
+        else if (arg == "--no-gravity") config.gravity = false;
+        else if (arg == "--wind") config.wind = true;
+        else if (arg == "--no-collision") config.collision = false;
+        else if (arg == "--sleep") config.sleep = true;
+        else return false;
+    }
+
+    return !config.sizes.empty() && config.steps > 0 && config.warmup >= 0 && config.batch >= 0 &&
+           (config.format == "json" || config.format == "csv") &&
+           (config.solver == "force" || config.solver == "xpbd" || config.solver == "implicit" ||
+            config.solver == "hierarchical");
+}
+
+static SolverMode solverFor(const BenchConfig& config) {
+    if (config.solver == "xpbd") return SolverMode::XPBD;
+    if (config.solver == "implicit") return SolverMode::Implicit;
+    if (config.solver == "hierarchical") return SolverMode::Hierarchical;
+    return SolverMode::ForceSprings;
+}
+
+static BenchResult runSize(const BenchConfig& config, int size) {
+    // Keep the cloth's physical extent fixed so collision density does not
+    // change with resolution.
+    float spacing = 2.0f / size;
+    Cloth cloth(size, size, spacing, 50.0f, 20.0f);
+    cloth.setThreadCount(config.threads);
+    cloth.selfCollisionEnabled = config.collision;
+    cloth.sleepingEnabled = config.sleep;
+    cloth.solverMode = solverFor(config);
+    cloth.gravityEnabled = config.gravity;
+
+    for (int i = 0; i < config.warmup; i++) {
+        if (config.wind) cloth.applywind(Cloth::fixedTimeStep);
+        cloth.update(Cloth::fixedTimeStep);
+    }
+
+    cloth.phaseTimings = PhaseTimings();
+    cloth.phaseTimingEnabled = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.steps; i++) {
+        if (config.wind) cloth.applywind(Cloth::fixedTimeStep);
+        cloth.update(Cloth::fixedTimeStep);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    BenchResult result;
+    result.size = size;
+    result.particles = cloth.getParticles().size();
+    result.springs = cloth.getSprings().size();
+    result.steps = config.steps;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.phases = cloth.phaseTimings;
+    return result;
+}
+
+struct BatchResult {
+    size_t instances = 0;
+    size_t particles = 0;
+    int steps = 0;
+    double seconds = 0.0;
+    uint64_t clothSteps = 0;
+    uint64_t steals = 0;
+};
+
+static BatchResult runBatch(const BenchConfig& config) {
+    ClothBatch batch(config.threads);
+    for (int i = 0; i < config.batch; i++) {
+        int size = config.sizes[i % config.sizes.size()];
+        ClothInstanceConfig instance;
+        instance.width = size;
+        instance.height = size;
+        instance.spacing = 2.0f / size;
+        instance.stiffness = 30.0f + 10.0f * (i % 5);
+        instance.damping = 10.0f + 5.0f * (i % 3);
+        instance.solverMode = solverFor(config);
+        instance.gravityEnabled = config.gravity;
+
+        size_t index = batch.add(instance);
+        batch.cloth(index).selfCollisionEnabled = config.collision;
+        batch.cloth(index).sleepingEnabled = config.sleep;
+    }
+
+    batch.step(config.warmup);
+
+    BatchResult result;
+    result.instances = batch.size();
+    for (size_t i = 0; i < batch.size(); i++) {
+        result.particles += batch.cloth(i).getParticles().size();
+    }
+    result.steps = config.steps;
+
+    uint64_t clothStepsBefore = batch.getClothSteps();
+    auto start = std::chrono::steady_clock::now();
+    batch.step(config.steps);
+    auto end = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.clothSteps = batch.getClothSteps() - clothStepsBefore;
+    result.steals = batch.getStealCount();
+    return result;
+}
+
+static void writeBatch(std::ostream& out, const BenchConfig& config, const BatchResult& r) {
+    char buffer[512];
+    double clothStepsPerSec = r.clothSteps / r.seconds;
+    if (config.format == "csv") {
+        out << "instances,particles,steps,threads,seconds,cloth_steps_per_sec,steals\n";
+        std::snprintf(buffer, sizeof(buffer), "%zu,%zu,%d,%d,%.6f,%.3f,%llu\n", r.instances, r.particles, r.steps,
+                      config.threads, r.seconds, clothStepsPerSec, static_cast<unsigned long long>(r.steals));
+    } else {
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\n  \"batch\": {\"instances\": %zu, \"particles\": %zu, \"steps\": %d, \"threads\": %d, "
+                      "\"seconds\": %.6f, \"cloth_steps_per_sec\": %.3f, \"steals\": %llu}\n}\n",
+                      r.instances, r.particles, r.steps, config.threads, r.seconds, clothStepsPerSec,
+                      static_cast<unsigned long long>(r.steals));
+    }
+    out << buffer;
+}
+
+static double nsPerParticleStep(const BenchResult& r) {
+    return r.seconds * 1e9 / (double(r.particles) * r.steps);
+}
+
+static double msPerStep(double seconds, int steps) {
+    return seconds * 1e3 / steps;
+}
+
+static void writeJson(std::ostream& out, const BenchConfig& config, const std::vector<BenchResult>& results) {
+    char buffer[512];
+    out << "{\n";
+    out << "  \"simd\": \"" << simdLevelName(detectSimdLevel()) << "\",\n";
+    out << "  \"threads\": " << config.threads << ",\n";
+    out << "  \"gravity\": " << (config.gravity ? "true" : "false") << ",\n";
+    out << "  \"wind\": " << (config.wind ? "true" : "false") << ",\n";
+    out << "  \"collision\": " << (config.collision ? "true" : "false") << ",\n";
+    out << "  \"solver\": \"" << config.solver << "\",\n";
+    out << "  \"sleep\": " << (config.sleep ? "true" : "false") << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        std::snprintf(buffer, sizeof(buffer),
+                      "    {\"size\": %d, \"particles\": %zu, \"springs\": %zu, \"steps\": %d, "
+                      "\"seconds\": %.6f, \"ns_per_particle_step\": %.3f, \"steps_per_sec\": %.3f, "
+                      "\"phase_ms_per_step\": {\"gravity\": %.4f, \"wind\": %.4f, \"springs\": %.4f, "
+                      "\"collision\": %.4f, \"integrate\": %.4f}}",
+                      r.size, r.particles, r.springs, r.steps, r.seconds, nsPerParticleStep(r), r.steps / r.seconds,
+                      msPerStep(r.phases.gravity, r.steps), msPerStep(r.phases.wind, r.steps),
+                      msPerStep(r.phases.springs, r.steps), msPerStep(r.phases.collision, r.steps),
+                      msPerStep(r.phases.integrate, r.steps));
+        out << buffer << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static void writeCsv(std::ostream& out, const BenchConfig& config, const std::vector<BenchResult>& results) {
+    char buffer[512];
+    out << "size,particles,springs,steps,threads,simd,seconds,ns_per_particle_step,steps_per_sec,"
+           "gravity_ms,wind_ms,springs_ms,collision_ms,integrate_ms\n";
+    for (const BenchResult& r : results) {
+        std::snprintf(buffer, sizeof(buffer), "%d,%zu,%zu,%d,%d,%s,%.6f,%.3f,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                      r.size, r.particles, r.springs, r.steps, config.threads, simdLevelName(detectSimdLevel()),
+                      r.seconds, nsPerParticleStep(r), r.steps / r.seconds,
+                      msPerStep(r.phases.gravity, r.steps), msPerStep(r.phases.wind, r.steps),
+                      msPerStep(r.phases.springs, r.steps), msPerStep(r.phases.collision, r.steps),
+                      msPerStep(r.phases.integrate, r.steps));
+        out << buffer;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        printUsage();
+        return 1;
+    }
+
+    ClothProfiler::setEnabled(!config.profile.empty());
+
+    std::vector<BenchResult> results;
+    BatchResult batchResult;
+    if (config.batch > 0) {
+        std::cerr << "cloth_bench: batch of " << config.batch << " for " << config.steps << " steps" << std::endl;
+        batchResult = runBatch(config);
+    } else {
+        for (int size : config.sizes) {
+            std::cerr << "cloth_bench: " << size << "x" << size << " for " << config.steps << " steps" << std::endl;
+            results.push_back(runSize(config, size));
+        }
+    }
+
+    std::ofstream file;
+    if (!config.output.empty()) {
+        file.open(config.output);
+        if (!file) {
+            std::cerr << "cloth_bench: cannot open " << config.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = config.output.empty() ? std::cout : file;
+
+    if (config.batch > 0) {
+        writeBatch(out, config, batchResult);
+    } else if (config.format == "csv") {
+        writeCsv(out, config, results);
+    } else {
+        writeJson(out, config, results);
+    }
+
+    if (!config.profile.empty() && !ClothProfiler::writeCsv(config.profile)) return 1;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef CLOTHBATCH_H
+#define CLOTHBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "clothsim.h"
+#include "clothsnapshot.h"
+#include "workstealingpool.h"
+
+// Parameters of one cloth in a batch.
+struct ClothInstanceConfig {
+    int width = 20;
+    int height = 20;
+    float spacing = 0.1f;
+    float stiffness = 50.0f;
+    float damping = 20.0f;
+    SolverMode solverMode = SolverMode::ForceSprings;
+    bool gravityEnabled = false;
+};
+
+// Owns many independent cloths and steps them together, for parameter
+// sweeps in one process. Each cloth is one task on a work-stealing pool and
+// runs single-threaded inside it, so parallelism comes from the batch, not
+// from within a cloth. Tasks are dealt largest cloth first so small cloths
+// fill in around the big ones.
+class ClothBatch {
+    public:
+        // 0 picks the hardware thread count.
+        explicit ClothBatch(int threadCount = 0);
+
+        size_t add(const ClothInstanceConfig& config);
+        size_t size() const { return cloths.size(); }
+
+        Cloth& cloth(size_t index) { return *cloths[index]; }
+        const Cloth& cloth(size_t index) const { return *cloths[index]; }
+
+        // Advances every cloth by `steps` calls to Cloth::update(timeStep).
+        void step(int steps, float timeStep = Cloth::fixedTimeStep);
+
+        // Copies one cloth's positions out, e.g. for analysis or output. The
+        // step is the number of steps taken since the batch was created;
+        // cloths added later started at that count.
+        void capture(size_t index, ClothSnapshot& snapshot) const;
+
+        int getThreadCount() const { return pool.size(); }
+        uint64_t getClothSteps() const { return clothSteps; }
+        uint64_t getStealCount() const { return pool.getStealCount(); }
+
+    private:
+        WorkStealingPool pool;
+        std::vector<std::unique_ptr<Cloth>> cloths;
+        // Cloth indices by descending particle count.
+        std::vector<size_t> order;
+        uint64_t stepsTaken = 0;
+        uint64_t clothSteps = 0;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef CLOTHBVH_H
+#define CLOTHBVH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothgrid.h"
+#include "clothtopology.h"
+
+// First triangle a ray meets: the hit point is origin + t * direction, and
+// (1 - u - v, u, v) are its barycentric weights on vertices[0..2].
+struct ClothRayHit {
+    float t = 0.0f;
+    float u = 0.0f;
+    float v = 0.0f;
+    int vertices[3] = {-1, -1, -1};
+};
+
+// Bounding volume hierarchy over a cloth's triangles. The tree is split once
+// from the positions at build() time; as the cloth moves, refit() only
+// recomputes the boxes bottom-up, so the shape of the tree stays fixed while
+// the bounds stay exact.
+class ClothBVH {
+    public:
+        static const int leafSize = 16;
+
+        // Grids are triangulated like ClothTopology::appendGridTriangles,
+        // meshes use their fan triangulation.
+        void build(const ClothTopology& topology, const ParticleState& particles);
+        void refit(const ParticleState& particles);
+        // Boxes around each triangle's whole motion over a step, from
+        // `start` (one position per particle) to the current positions,
+        // grown by margin; the bounds continuous collision needs.
+        void refitSwept(const std::vector<glm::vec3>& start, const ParticleState& particles, float margin);
+        bool empty() const { return nodes.empty(); }
+        size_t triangleCount() const { return triangles.size() / 3; }
+        // Vertices of triangle t in tree order.
+        const unsigned int* triangle(size_t t) const { return triangles.data() + 3 * t; }
+
+        // Nearest hit with t >= 0, or false if the ray misses every triangle.
+        bool raycast(const glm::vec3& origin, const glm::vec3& direction, const ParticleState& particles,
+                     ClothRayHit& hit) const;
+
+        // Every particle on a triangle that lies strictly within radius of
+        // center, each once, in no particular order.
+        void queryRadius(const glm::vec3& center, float radius, const ParticleState& particles, std::vector<int>& out);
+
+        // Pairs of distinct triangles, lower index first, whose boxes from
+        // the last refitSwept overlap.
+        void selfOverlaps(std::vector<std::pair<int, int>>& out);
+
+    private:
+        // Inner nodes have count 0 and children first and first + 1; leaves
+        // hold triangles [first, first + count). Children always follow
+        // their parent, so a reverse sweep refits the tree.
+        struct Node {
+            glm::vec3 boundsMin;
+            int first;
+            glm::vec3 boundsMax;
+            int count;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<unsigned int> triangles;
+        // Refit reads each leaf's distinct vertices, listed per leaf in
+        // leafVertices[leafVertexStart[k], leafVertexStart[k + 1]) for the
+        // leaf node leafNodes[k].
+        std::vector<int> leafNodes;
+        std::vector<int> leafVertexStart;
+        std::vector<unsigned int> leafVertices;
+        // Per-triangle boxes, kept by refitSwept only.
+        std::vector<glm::vec3> triangleMin;
+        std::vector<glm::vec3> triangleMax;
+        // Marks particles already reported by the current queryRadius.
+        std::vector<uint32_t> visited;
+        uint32_t visitStamp = 0;
+        // selfOverlaps' node pairs still to compare, kept between calls; a
+        // node paired with itself stands for the overlaps within its subtree.
+        std::vector<std::pair<int, int>> pendingPairs;
+};
+
+#endif
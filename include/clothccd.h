@@ -0,0 +1,66 @@
+#ifndef CLOTHCCD_H
+#define CLOTHCCD_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothbvh.h"
+#include "clothgrid.h"
+#include "clothtopology.h"
+
+// Continuous self-collision for a cloth's triangles. Every particle is taken
+// to move in a straight line from where beginStep() saw it to its current
+// position; a vertex crossing a triangle, or an edge crossing an edge, is
+// found at the moment the four points become coplanar (Provot 1997, Bridson
+// et al. 2002), however far it travelled. Pairs that end the step closer
+// than the thickness without crossing are pushed apart too.
+//
+// The triangle BVH is built once per topology and refit each pass around
+// the swept triangles, so detection stays near-linear in the cloth size.
+// Contacts are resolved in a fixed order, which keeps results independent
+// of the thread count.
+class ClothCCD {
+    public:
+        void build(const ClothTopology& topology, const ParticleState& particles);
+        bool empty() const { return bvh.empty(); }
+
+        // Records the positions the step starts from. The solver's previous
+        // positions won't do: the ground clamp rewrites them to damp
+        // velocity, so they need not be where a particle actually was.
+        void beginStep(const ParticleState& particles);
+
+        // Detects and resolves crossings, up to `passes` times while any
+        // remain, and leaves every resolved pair `thickness` apart along the
+        // contact normal. Particles still crossing after the last pass are
+        // put back where the step began. Particles with zero inverse mass do
+        // not move. Returns the number of contacts resolved.
+        int resolve(ParticleState& particles, float thickness, int passes);
+
+        // Candidate primitive pairs of the last pass, for diagnostics.
+        size_t getCandidateCount() const { return vertexFace.size() + edgeEdge.size(); }
+
+    private:
+        void findCandidates(const ParticleState& particles, float thickness);
+        // With freeze set, contacts are not pushed apart; their particles
+        // go back to their start positions instead.
+        int resolveCandidates(ParticleState& particles, float thickness, bool freeze);
+        bool resolveVertexFace(ParticleState& particles, int vertex, int face, float thickness, bool freeze);
+        bool resolveEdgeEdge(ParticleState& particles, int edgeA, int edgeB, float thickness, bool freeze);
+        bool freezeParticles(ParticleState& particles, const int (&v)[4]);
+
+        ClothBVH bvh;
+        std::vector<glm::vec3> start;
+        // Edge e joins edgeVertices[2e] and edgeVertices[2e + 1]; triangle t
+        // (in BVH order) has edges triangleEdges[3t, 3t + 3).
+        std::vector<int> edgeVertices;
+        std::vector<int> triangleEdges;
+
+        std::vector<std::pair<int, int>> trianglePairs;
+        // (vertex << 32 | triangle) and (lower edge << 32 | higher edge),
+        // sorted and without duplicates.
+        std::vector<uint64_t> vertexFace;
+        std::vector<uint64_t> edgeEdge;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef CLOTHCHECKPOINT_H
+#define CLOTHCHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of a Cloth checkpoint (Cloth::save / Cloth::load).
+//
+// A fixed-size header is followed by raw sections at the byte offsets it
+// records: the eleven ParticleState arrays (x, y, z, prevX, prevY, prevZ,
+// forceX, forceY, forceZ, mass, invMass) as float[particleCount], the
+// colored spring list as Spring[springCount], the spring color offsets
+// as uint64_t[colorCount + 1] and, for mesh cloths, the render triangles as
+// uint32_t[triangleIndexCount]. Every section starts on a 64-byte boundary,
+// so a mapped file can be read in place and restored with plain copies.
+//
+// Values are stored in native byte order; the endian tag rejects files
+// written on a machine of the other order.
+struct ClothCheckpointHeader {
+    static const uint32_t currentVersion = 3;
+    static const int particleArrays = 11;
+    static const uint64_t sectionAlignment = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t headerSize;
+    uint64_t totalSize;
+
+    int32_t width;
+    int32_t height;
+    float spacing;
+    float stiffness;
+    float damping;
+    int32_t solverMode;
+    int32_t xpbdIterations;
+    int32_t hierarchyLevels;
+    int32_t coarseIterations;
+    uint32_t flags;
+    float lastStepTime;
+    float accumulator;
+    uint64_t randomSeed;
+    uint64_t windGusts;
+
+    uint64_t particleCount;
+    uint64_t springCount;
+    uint64_t colorCount;
+    uint64_t triangleIndexCount;
+
+    uint64_t particleOffsets[particleArrays];
+    uint64_t springOffset;
+    uint64_t colorOffset;
+    uint64_t triangleOffset;
+};
+
+namespace ClothCheckpointFlags {
+    const uint32_t SelfCollision = 1u << 0;
+    const uint32_t SpatialHash = 1u << 1;
+    const uint32_t Sleeping = 1u << 2;
+    // Particles and springs come from a ClothTopology mesh, not a grid.
+    const uint32_t Mesh = 1u << 3;
+    const uint32_t ContinuousCollision = 1u << 4;
+    const uint32_t Gravity = 1u << 5;
+}
+
+extern const char clothCheckpointMagic[8];
+const uint32_t clothCheckpointEndianTag = 0x01020304u;
+
+#endif
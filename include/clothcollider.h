@@ -0,0 +1,86 @@
+#ifndef CLOTHCOLLIDER_H
+#define CLOTHCOLLIDER_H
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Signed distance to a triangle mesh, sampled at the corners of a regular
+// voxel grid: negative inside, positive outside. Distances between samples
+// are trilinear, so a query costs eight loads however many triangles the
+// mesh had.
+class SignedDistanceField {
+    public:
+        // Samples the mesh every cellSize over its bounds grown by `padding`
+        // cells. Distances near the surface are exact; the rest come from the
+        // closest triangle of a neighbouring sample. The sign is the parity of
+        // surface crossings along x, so the mesh should be closed. Returns
+        // false (leaving the field empty) for an empty mesh, a bad cell size
+        // or a grid over maxSamples.
+        bool bake(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& triangles,
+                  float cellSize, int padding = 3);
+
+        bool empty() const { return values.empty(); }
+
+        // Distance at `point` and its gradient, the outward surface normal
+        // where the field is a true distance. Points outside the grid get
+        // FLT_MAX and no normal; padding keeps the grid wider than any
+        // collision thickness.
+        float sample(const glm::vec3& point, glm::vec3& normal) const;
+
+        glm::vec3 getOrigin() const { return origin; }
+        glm::ivec3 getSamples() const { return samples; }
+        float getCellSize() const { return cellSize; }
+
+        static const size_t maxSamples = 256 * 256 * 256;
+
+    private:
+        float value(int i, int j, int k) const {
+            return values[(static_cast<size_t>(k) * samples.y + j) * samples.x + i];
+        }
+
+        glm::vec3 origin = glm::vec3(0.0f);
+        glm::ivec3 samples = glm::ivec3(0);
+        float cellSize = 0.0f;
+        std::vector<float> values;
+};
+
+// A rigid obstacle for Cloth. Analytic shapes are evaluated directly; mesh
+// colliders look up a baked SignedDistanceField, which may be shared by
+// several colliders. Position and orientation place the shape (or the
+// field's mesh coordinates) in the world and may change between steps.
+struct ClothCollider {
+    enum Shape {
+        Sphere,
+        Box,
+        Capsule,
+        Mesh
+    };
+
+    Shape shape = Sphere;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::mat3 orientation = glm::mat3(1.0f);
+    // Sphere and capsule radius.
+    float radius = 0.0f;
+    // Box half size along each local axis.
+    glm::vec3 halfExtents = glm::vec3(0.0f);
+    // Capsule axis runs from -halfHeight to +halfHeight along local y.
+    float halfHeight = 0.0f;
+    std::shared_ptr<const SignedDistanceField> field;
+
+    // Particles are kept at least this far outside the surface.
+    float thickness = 0.01f;
+    // Fraction of a contact's tangential motion removed per step.
+    float friction = 0.9f;
+
+    static ClothCollider sphere(const glm::vec3& center, float radius);
+    static ClothCollider box(const glm::vec3& center, const glm::vec3& halfExtents);
+    static ClothCollider capsule(const glm::vec3& center, float halfHeight, float radius);
+    static ClothCollider mesh(std::shared_ptr<const SignedDistanceField> field);
+
+    // Signed distance from a world-space point to the surface and the
+    // world-space outward normal there.
+    float distance(const glm::vec3& point, glm::vec3& normal) const;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef CLOTHGEOMETRY_H
+#define CLOTHGEOMETRY_H
+
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// Closest-point queries shared by the colliders and continuous collision,
+// after Ericson, Real-Time Collision Detection, 5.1.5 and 5.1.9.
+
+// Closest point to p on triangle abc, with its barycentric weights on
+// (a, b, c) in `weights`.
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+                                        const glm::vec3& c, glm::vec3& weights) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        weights = glm::vec3(1.0f, 0.0f, 0.0f);
+        return a;
+    }
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        weights = glm::vec3(0.0f, 1.0f, 0.0f);
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        float v = d1 / (d1 - d3);
+        weights = glm::vec3(1.0f - v, v, 0.0f);
+        return a + ab * v;
+    }
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        weights = glm::vec3(0.0f, 0.0f, 1.0f);
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        float w = d2 / (d2 - d6);
+        weights = glm::vec3(1.0f - w, 0.0f, w);
+        return a + ac * w;
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        weights = glm::vec3(0.0f, 1.0f - w, w);
+        return b + (c - b) * w;
+    }
+
+    float denominator = 1.0f / (va + vb + vc);
+    float v = vb * denominator;
+    float w = vc * denominator;
+    weights = glm::vec3(1.0f - v - w, v, w);
+    return a + ab * v + ac * w;
+}
+
+// Closest points p0 + s (p1 - p0) and q0 + t (q1 - q0) of two segments, with
+// s and t in [0, 1].
+inline void closestPointsOnSegments(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& q0,
+                                    const glm::vec3& q1, float& s, float& t) {
+    const float epsilon = 1e-12f;
+    glm::vec3 d1 = p1 - p0;
+    glm::vec3 d2 = q1 - q0;
+    glm::vec3 r = p0 - q0;
+    float a = glm::dot(d1, d1);
+    float e = glm::dot(d2, d2);
+    float f = glm::dot(d2, r);
+
+    if (a <= epsilon && e <= epsilon) {
+        s = t = 0.0f;
+        return;
+    }
+    if (a <= epsilon) {
+        s = 0.0f;
+        t = std::min(std::max(f / e, 0.0f), 1.0f);
+        return;
+    }
+
+    float c = glm::dot(d1, r);
+    if (e <= epsilon) {
+        t = 0.0f;
+        s = std::min(std::max(-c / a, 0.0f), 1.0f);
+        return;
+    }
+
+    float b = glm::dot(d1, d2);
+    float denominator = a * e - b * b;
+    s = denominator != 0.0f ? std::min(std::max((b * f - c * e) / denominator, 0.0f), 1.0f) : 0.0f;
+    t = (b * s + f) / e;
+    if (t < 0.0f) {
+        t = 0.0f;
+        s = std::min(std::max(-c / a, 0.0f), 1.0f);
+    } else if (t > 1.0f) {
+        t = 1.0f;
+        s = std::min(std::max((b - c) / a, 0.0f), 1.0f);
+    }
+}
+
+#endif
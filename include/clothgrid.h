@@ -4,6 +4,7 @@
 #include <vector>
 #include <iostream>
 #include <glm/glm.hpp>
+#include "alignedallocator.h"
 
 struct Particle {
     glm::vec3 force;
@@ -15,6 +16,53 @@ struct Particle {
         : position(glm::vec3(0.0f)), previousPosition(glm::vec3(0.0f)), mass(1.0f), force(glm::vec3(0.0f)) {};
 };
 
+// Structure-of-arrays particle storage used by the solver. Each field lives in
+// its own contiguous, aligned array so kernels only stream what they touch.
+struct ParticleState {
+    AlignedVector<float> x, y, z;
+    AlignedVector<float> prevX, prevY, prevZ;
+    AlignedVector<float> forceX, forceY, forceZ;
+    AlignedVector<float> mass;
+    AlignedVector<float> invMass;
+
+    size_t size() const { return x.size(); }
+    void clear();
+    void reserve(size_t n);
+    void resize(size_t n);
+    void push_back(const Particle& p);
+
+    glm::vec3 position(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    glm::vec3 previousPosition(size_t i) const { return glm::vec3(prevX[i], prevY[i], prevZ[i]); }
+    glm::vec3 force(size_t i) const { return glm::vec3(forceX[i], forceY[i], forceZ[i]); }
+
+    void setPosition(size_t i, const glm::vec3& p) { x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+    void setPreviousPosition(size_t i, const glm::vec3& p) { prevX[i] = p.x; prevY[i] = p.y; prevZ[i] = p.z; }
+    void setForce(size_t i, const glm::vec3& f) { forceX[i] = f.x; forceY[i] = f.y; forceZ[i] = f.z; }
+    void addForce(size_t i, const glm::vec3& f) { forceX[i] += f.x; forceY[i] += f.y; forceZ[i] += f.z; }
+    void setMass(size_t i, float m);
+
+    Particle get(size_t i) const;
+    void set(size_t i, const Particle& p);
+
+    void load(const std::vector<Particle>& particles);
+    void store(std::vector<Particle>& particles) const;
+};
+
+// Read-only view over ParticleState for the renderer and tests. Indexing
+// returns a Particle by value so existing `particles[i].position` code works.
+class ParticleView {
+    private:
+        const ParticleState* state;
+
+    public:
+        explicit ParticleView(const ParticleState& s) : state(&s) {}
+        size_t size() const { return state->size(); }
+        bool empty() const { return state->size() == 0; }
+        Particle operator[](size_t i) const { return state->get(i); }
+        glm::vec3 position(size_t i) const { return state->position(i); }
+        const ParticleState& data() const { return *state; }
+};
+
 struct Spring {
     int p1, p2;
     float restLength;
@@ -0,0 +1,59 @@
+#ifndef CLOTHHIERARCHY_H
+#define CLOTHHIERARCHY_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothgrid.h"
+#include "threadpool.h"
+
+// Coarse levels over the regular width x height particle grid, in the spirit
+// of hierarchical position based dynamics (Mueller 2008). Level l keeps every
+// other row and column of level l - 1, so its nodes are fine particles with
+// both coordinates a multiple of 2^l; restriction is plain injection.
+//
+// Each coarse level carries its own distance constraints between adjacent
+// and diagonal nodes. Relaxing a level moves its nodes directly; the skipped
+// nodes of the next finer level then receive the bilinear interpolation of
+// the surrounding corrections (prolongation). Long-wavelength stretch is
+// therefore removed in a handful of cheap coarse passes instead of hundreds
+// of fine ones.
+class ClothHierarchy {
+    public:
+        struct Level {
+            int width = 0;
+            int height = 0;
+            int stride = 1;
+            // Fine particle index of every node, row-major.
+            std::vector<int> nodes;
+            // Constraints over fine particle indices, grouped by color.
+            std::vector<Spring> constraints;
+            std::vector<size_t> colorOffsets;
+            std::vector<float> lambda;
+        };
+
+        // Builds levels until either dimension would drop below minSize.
+        void build(int width, int height, float spacing, int maxLevels, int minSize = 8);
+        // Whether build() was last called with these arguments.
+        bool matches(int width, int height, float spacing, int maxLevels) const;
+
+        // Relaxes every coarse level from the coarsest down, prolongating the
+        // accumulated correction to each finer level. `compliance` is the
+        // fine springs' compliance; coarse springs span `stride` of them in
+        // series and get stride times that.
+        void relax(ParticleState& particles, float compliance, float timeStep, int iterations, ThreadPool* pool);
+
+        // Level 0 is the fine grid itself and has no constraints here.
+        int levelCount() const { return static_cast<int>(levels.size()); }
+        const Level& level(int index) const { return levels[index]; }
+
+    private:
+        void project(ParticleState& particles, Level& level, size_t first, size_t last, float alphaTilde);
+        void prolongate(ParticleState& particles, const Level& fine, int firstRow, int lastRow);
+
+        std::vector<Level> levels;
+        std::vector<glm::vec3> start;
+        float builtSpacing = 0.0f;
+        int builtMaxLevels = 0;
+};
+
+#endif
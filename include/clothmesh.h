@@ -0,0 +1,78 @@
+#ifndef CLOTHMESH_H
+#define CLOTHMESH_H
+
+#include <memory>
+#include <vector>
+#include "alignedallocator.h"
+#include "clothsnapshot.h"
+#include "clothtopology.h"
+#include "glupload.h"
+#include "simdkernels.h"
+#include "threadpool.h"
+
+// CPU side of the cloth's GPU mesh: the triangle indices, which only change
+// with the cloth's topology, and the interleaved per-vertex stream
+// (position, normal, curvature) derived from every snapshot.
+//
+// Vertex derivation runs in two parallel passes: every triangle normal is
+// computed once, then each vertex sums its (area-weighted) neighbouring
+// faces, adds curvature and writes the interleaved vertices straight to the
+// destination, usually a mapped VBO. Grids use row kernels over a
+// zero-padded face grid; meshes take their triangles from the snapshot's
+// ClothTopology and gather faces through per-vertex CSR lists.
+class ClothMesh {
+    public:
+        static const int floatsPerVertex = 7;
+
+        // Rebuilds the index list only if the dimensions changed.
+        bool setTopology(int width, int height);
+        // Same for the snapshot's topology, grid or mesh.
+        bool setTopology(const ClothSnapshot& snapshot);
+
+        // Derives vertices into getVertices(), for callers without a GPU.
+        void update(const ClothSnapshot& snapshot, ThreadPool* pool = nullptr);
+
+        // Sends the index buffer once per topology change, then orphans the
+        // vertex buffer and writes this frame's vertices into the mapped
+        // storage (or streams them with glBufferSubData if mapping fails).
+        // Expects the VAO with this mesh's buffers to be bound.
+        void upload(GLUploadTable& gl, const ClothSnapshot& snapshot, ThreadPool* pool = nullptr);
+
+        void writeVertices(const ClothSnapshot& snapshot, float* destination, ThreadPool* pool);
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        const std::vector<float>& getVertices() const { return vertices; }
+        const std::vector<unsigned int>& getIndices() const { return indices; }
+
+        SimdLevel simdLevel = detectSimdLevel();
+
+    private:
+        void computeFaceRows(const ClothSnapshot& snapshot, int firstRow, int lastRow);
+        void writeVertexRows(const ClothSnapshot& snapshot, float* destination, int firstRow, int lastRow) const;
+        float curvatureAt(const ClothSnapshot& snapshot, int x, int y) const;
+        void computeMeshFaces(const ClothSnapshot& snapshot, size_t first, size_t last);
+        void writeMeshVertices(const ClothSnapshot& snapshot, float* destination, size_t first, size_t last) const;
+
+        int width = 0;
+        int height = 0;
+        bool indicesDirty = false;
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+
+        // Face normals of triangles (i0, i2, i3) and (i0, i3, i1) per quad,
+        // on a (width + 1) x (height + 1) grid with a zero border so vertex
+        // sums need no edge cases.
+        int faceStride = 0;
+        AlignedVector<float> faceAX, faceAY, faceAZ;
+        AlignedVector<float> faceBX, faceBY, faceBZ;
+
+        // Mesh topologies reuse faceA* for one normal per triangle. Vertex v
+        // touches triangles vertexFaces[vertexFaceStart[v], ...v + 1]) and
+        // has edge neighbours ring[ringStart[v], ringStart[v + 1]).
+        std::shared_ptr<const ClothTopology> meshTopology;
+        std::vector<int> vertexFaceStart, vertexFaces;
+        std::vector<int> ringStart, ring;
+};
+
+#endif
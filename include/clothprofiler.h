@@ -0,0 +1,144 @@
+#ifndef CLOTHPROFILER_H
+#define CLOTHPROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Set to 0 (CMake option CLOTH_PROFILING) to compile every ProfileScope out.
+#ifndef CLOTH_PROFILING
+#define CLOTH_PROFILING 1
+#endif
+
+// The hot paths of a frame. Scopes nest: a Step holds the solver phases,
+// a Render holds Upload and Draw, and Upload includes the Normals pass that
+// writes straight into the mapped vertex buffer. Upload, Draw and Render
+// time the CPU side of the GL calls only. Tick is the GUI timer firing.
+enum class ProfilePhase : uint8_t {
+    Gravity,
+    Wind,
+    Springs,
+    Collision,
+    Integrate,
+    Normals,
+    Upload,
+    Draw,
+    Step,
+    Render,
+    Tick,
+    Count
+};
+
+const char* profilePhaseName(ProfilePhase phase);
+
+// One timed scope. Times are nanoseconds since the profiler's epoch (process
+// start); thread is a small per-thread index, stable for the thread's life.
+struct ProfileSample {
+    uint64_t start = 0;
+    uint64_t duration = 0;
+    uint32_t thread = 0;
+    ProfilePhase phase = ProfilePhase::Count;
+};
+
+// Fixed-size ring of a single thread's samples. Only the owning thread
+// pushes; any thread may copy the ring out at the same time without locks.
+// Slots are relaxed atomic words bracketed by two counters, as in a seqlock:
+// `writing` moves before a slot is overwritten and `head` after, so a
+// reader drops whatever may have been overwritten while it copied.
+class ProfileRing {
+    public:
+        static const size_t capacity = 16384;
+
+        void push(const ProfileSample& sample);
+        // Appends the samples still held, oldest first.
+        void copy(std::vector<ProfileSample>& out) const;
+
+    private:
+        friend class ClothProfiler;
+
+        struct Slot {
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> duration{0};
+            // phase in the low byte, thread above it.
+            std::atomic<uint64_t> tag{0};
+        };
+
+        Slot entries[capacity];
+        std::atomic<uint64_t> writing{0};
+        std::atomic<uint64_t> head{0};
+        // Cleared when the owning thread exits, so a new thread can reuse it.
+        std::atomic<bool> owned{false};
+        uint32_t thread = 0;
+        // Set and read under the registry lock.
+        std::string name;
+};
+
+// Each phase's mean duration and call count over a recent window, for the
+// overlay.
+struct ProfileSummary {
+    double milliseconds[static_cast<size_t>(ProfilePhase::Count)] = {};
+    int calls[static_cast<size_t>(ProfilePhase::Count)] = {};
+};
+
+// Process-wide switchboard for the per-thread rings. While disabled, a
+// ProfileScope costs one relaxed load and a branch.
+class ClothProfiler {
+    public:
+        static void setEnabled(bool enabled) { active.store(enabled, std::memory_order_relaxed); }
+        static bool enabled() { return CLOTH_PROFILING && active.load(std::memory_order_relaxed); }
+
+        static uint64_t now();
+        static void record(ProfilePhase phase, uint64_t start, uint64_t end);
+
+        // Every thread's samples, sorted by start time.
+        static void collect(std::vector<ProfileSample>& out);
+        // Over the samples that started in the last `seconds`.
+        static void summarize(double seconds, ProfileSummary& summary);
+        // One row per sample: thread, phase, start and duration in
+        // microseconds. Returns false if the file can't be written.
+        static bool writeCsv(const std::string& path);
+        // Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev): one
+        // complete event per sample, plus the thread names. Returns false if
+        // the file can't be written.
+        static bool writeChromeTrace(const std::string& path);
+        // Hides every sample recorded so far.
+        static void clear();
+
+        // Names the calling thread in traces; unnamed threads show as
+        // "thread N".
+        static void setThreadName(const std::string& name);
+
+        // Set CLOTH_TRACE=<file> in the environment to profile the whole
+        // run of any program linking the core, tests and cloth_bench
+        // included, and write its trace there at exit.
+        static const char* traceEnvironmentVariable;
+
+    private:
+        static ProfileRing& localRing();
+        static std::atomic<bool> active;
+        static std::atomic<uint64_t> clearedAt;
+};
+
+// Records the lifetime of the scope under `phase` while profiling is on.
+class ProfileScope {
+    public:
+#if CLOTH_PROFILING
+        explicit ProfileScope(ProfilePhase phase) : phase(phase), start(ClothProfiler::enabled() ? ClothProfiler::now() : 0) {}
+        ~ProfileScope() {
+            if (start != 0) ClothProfiler::record(phase, start, ClothProfiler::now());
+        }
+#else
+        explicit ProfileScope(ProfilePhase) {}
+#endif
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+#if CLOTH_PROFILING
+    private:
+        ProfilePhase phase;
+        uint64_t start;
+#endif
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef CLOTHRECORDER_H
+#define CLOTHRECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clothsnapshot.h"
+
+// Recording layout (.clrec): a ClothRecordingHeader, then one
+// ClothFrameHeader plus `bytes` of encoded positions per recorded step.
+// Values are stored in native byte order, like checkpoints.
+struct ClothRecordingHeader {
+    static const uint32_t currentVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    int32_t width;
+    int32_t height;
+    float quantum;
+    uint32_t keyframeInterval;
+};
+
+struct ClothFrameHeader {
+    static const uint32_t keyframe = 1u << 0;
+
+    uint64_t step;
+    uint32_t flags;
+    uint32_t bytes;
+};
+
+// Lossy position codec. Positions are rounded to multiples of `quantum` and
+// each frame stores the difference to the previous frame's rounded values
+// (x for all particles, then y, then z) as zigzag varints, with runs of
+// unchanged values collapsed into a single token. Keyframes are coded
+// against zero so playback can start there. Decoding reproduces the
+// recorded positions to within quantum / 2.
+class ClothFrameCodec {
+    public:
+        void encode(const ClothSnapshot& frame, float quantum, bool keyframe, std::vector<uint8_t>& out);
+        bool decode(const uint8_t* data, size_t size, float quantum, bool keyframe, ClothSnapshot& frame);
+
+    private:
+        std::vector<int32_t> previous;
+};
+
+// Streams snapshots to a recording. record() only copies the positions into
+// a free slot; encoding and file output happen on a background writer
+// thread. When the writer falls behind by maxPendingFrames the frame is
+// dropped rather than stalling the caller.
+class ClothRecorder {
+    public:
+        static const float defaultQuantum;
+
+        ClothRecorder() = default;
+        ~ClothRecorder();
+
+        ClothRecorder(const ClothRecorder&) = delete;
+        ClothRecorder& operator=(const ClothRecorder&) = delete;
+
+        bool open(const std::string& path, int width, int height, float quantum = defaultQuantum);
+        // Writes out every queued frame and closes the file.
+        void close();
+        bool isOpen() const { return writer.joinable(); }
+
+        // Returns false if the frame was dropped or does not match the
+        // recording's dimensions.
+        bool record(const ClothSnapshot& snapshot);
+
+        uint64_t getFramesWritten() const { return framesWritten.load(std::memory_order_acquire); }
+        uint64_t getBytesWritten() const { return bytesWritten.load(std::memory_order_acquire); }
+        uint64_t getDroppedFrames() const { return droppedFrames.load(std::memory_order_acquire); }
+
+        uint32_t keyframeInterval = 120;
+        size_t maxPendingFrames = 8;
+
+    private:
+        void writerLoop();
+
+        std::ofstream file;
+        std::thread writer;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        std::vector<ClothSnapshot> buffers;
+        std::vector<size_t> freeSlots;
+        std::deque<size_t> queued;
+
+        int width = 0;
+        int height = 0;
+        float quantum = 0.0f;
+        uint32_t activeKeyframeInterval = 1;
+        std::atomic<uint64_t> droppedFrames{0};
+        std::atomic<uint64_t> framesWritten{0};
+        std::atomic<uint64_t> bytesWritten{0};
+};
+
+// Reads a recording back frame by frame. Sequential reads decode one delta
+// each; a seek decodes forward from the nearest keyframe.
+class ClothPlayback {
+    public:
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const { return file.is_open(); }
+
+        size_t frameCount() const { return frames.size(); }
+        int getWidth() const { return header.width; }
+        int getHeight() const { return header.height; }
+
+        bool readFrame(size_t index, ClothSnapshot& frame);
+
+    private:
+        struct FrameEntry {
+            uint64_t offset;
+            uint64_t step;
+            uint32_t flags;
+            uint32_t bytes;
+        };
+
+        bool decodeFrame(size_t index, ClothSnapshot& frame);
+
+        std::ifstream file;
+        ClothRecordingHeader header{};
+        std::vector<FrameEntry> frames;
+        std::vector<uint8_t> payload;
+        ClothFrameCodec codec;
+        size_t decoded = 0;
+        bool hasDecoded = false;
+};
+
+#endif
@@ -1,39 +1,318 @@
 #ifndef CLOTHSIM_H
 #define CLOTHSIM_H
 
+#include <cstdint>
+#include <functional>
+#include <utility>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <glm/glm.hpp>
+#include "clothbvh.h"
+#include "clothccd.h"
+#include "clothcollider.h"
 #include "clothgrid.h"
+#include "clothhierarchy.h"
+#include "clothtopology.h"
+#include "implicitsolver.h"
+#include "simdkernels.h"
+#include "threadpool.h"
+
+// Whether newly built cloths fall under gravity; each Cloth then has its own
+// gravityEnabled.
+extern bool gravityEnabled;
+
+// Wall-clock seconds spent in each phase of Cloth::update, accumulated
+// while Cloth::phaseTimingEnabled is set.
+struct PhaseTimings {
+    double gravity = 0.0;
+    double wind = 0.0;
+    double springs = 0.0;
+    double collision = 0.0;
+    double integrate = 0.0;
+    long long steps = 0;
+};
+
+// How Cloth::update resolves the springs each step.
+enum class SolverMode {
+    // Spring and damping forces accumulated over several passes, then one
+    // Verlet step at the fixed time step.
+    ForceSprings,
+    // Extended position-based dynamics: springs become distance constraints
+    // projected on predicted positions, stable at large time steps.
+    XPBD,
+    // Linearized backward Euler with a sparse CG solve; handles stiff
+    // springs at real-time step sizes.
+    Implicit,
+    // XPBD preceded by relaxation on coarsened copies of the grid, so
+    // stretch spreads across large cloths in a few iterations.
+    Hierarchical
+};
 
 class Cloth {
 private:
     static const glm::vec3 gravity;
     static const glm::vec3 wind;
-    std::vector<Particle> particles;
+    ParticleState particles;
     std::vector<Spring> springs;
     void handleSelfCollision();
+    void handleSelfCollisionBruteForce();
+    void buildCollisionGrid(float cellSize);
+    void resolveCollisionPair(int i, int j, float minDistance);
     bool areNeighbors(int i, int j) const;
+
+    // Particles joined by a spring never collide with each other. The pairs
+    // are kept as CSR rows (neighborList[neighborStart[i], neighborStart[i+1])
+    // sorted ascending), rebuilt whenever the springs change.
+    std::shared_ptr<const ClothTopology> topology;
+    std::vector<int> neighborStart;
+    std::vector<int> neighborList;
+    void buildAdjacency();
+    // Triangle BVH behind picking and the mouse constraint. It is built for
+    // the current topology on first use and refit lazily: a step only marks
+    // it stale, and the next query refits it.
+    ClothBVH bvh;
+    std::shared_ptr<const ClothTopology> bvhTopology;
+    bool bvhStale = true;
+    std::vector<int> pickedParticles;
+    void refreshBVH();
+    // The particle held by the ray-driven mouse constraint and its depth
+    // along the (normalized) ray when it was grabbed; -1 when released.
+    int grabbedParticle = -1;
+    float grabDepth = 0.0f;
+    void dragParticle(int anchor, const glm::vec3& target);
+    // Continuous self-collision keeps its own BVH, refit around each step's
+    // swept triangles, and rebuilds it when the topology changes.
+    ClothCCD ccd;
+    std::shared_ptr<const ClothTopology> ccdTopology;
+    int continuousContacts = 0;
+    void handleContinuousCollision();
+    // Rest pose bounds; the window-coordinate mouse constraint maps the
+    // window onto this rectangle.
+    glm::vec3 restMin = glm::vec3(0.0f);
+    glm::vec3 restMax = glm::vec3(0.0f);
+    void updateRestBounds();
     float minCollisionDistance = 0.03f;
 
+    // Spatial hash broadphase, rebuilt every collision pass.
+    std::vector<int> cellStart;
+    std::vector<int> cellFill;
+    std::vector<int> cellEntries;
+    std::vector<int> particleCell;
+    std::vector<int> collisionCandidates;
+    int collisionTableMask = 0;
+
+    // Springs are stored grouped by color; no two springs of one color share
+    // a particle, so a color can be solved in parallel without atomics.
+    std::vector<size_t> springColorOffsets;
+    std::unique_ptr<ThreadPool> threadPool;
+    void colorSprings();
+    void solveSprings();
+    void integrateParticles(float timeStep);
+
+    // XPBD: one Lagrange multiplier per spring, in colored order.
+    std::vector<float> constraintLambda;
+    void stepXpbd(float timeStep, PhaseTimings* timings);
+    void predictPositions(float timeStep, size_t first, size_t last);
+    void projectConstraints(const Spring* list, float timeStep, size_t first, size_t last);
+    void clampToGround(size_t first, size_t last);
+    void resolveColliders(size_t first, size_t last);
+    void solveConstraints(float timeStep);
+    // Runs body(first, last) over the awake particles. A template, like
+    // ThreadPool::parallelFor, so the per-step lambdas are never boxed.
+    template <typename Body>
+    void forEachParticleChunk(const Body& body);
+
+    void buildParticles();
+    void simulateStep(float timeStep);
+    void rescaleVelocities(float ratio);
+    float maxStepMotion() const;
+    void computeStabilityBound();
+
+    // advance(): wall-clock time not yet simulated, the step size of the
+    // previous step (velocities are stored as per-step displacement), and
+    // the adaptive shrink factor applied after an unstable substep.
+    float accumulator = 0.0f;
+    float lastStepTime = 0.0f;
+    float substepScale = 1.0f;
+    float stiffnessBound = 0.0f;
+
+    // applywind() calls so far; the counter of the per-particle wind streams.
+    uint64_t windGusts = 0;
+
+    // Checkpoint of the freshly built cloth; reset() restores it instead of
+    // rebuilding the particles and springs.
+    std::vector<uint8_t> pristine;
+    bool restoreCheckpoint(const void* data, size_t size, bool restoreParameters);
+
+    ClothHierarchy hierarchy;
+    ImplicitSolver implicitSolver;
+    void stepImplicit(float timeStep, PhaseTimings* timings);
+
+    // Sleeping tiles of sleepTileSize^2 particles. A sleeping particle keeps
+    // its mass but has invMass zeroed, so every force, integration and
+    // constraint kernel treats it as pinned until its tile wakes.
+    int tilesX = 0;
+    int tilesY = 0;
+    int sleepingTiles = 0;
+    std::vector<uint8_t> tileAsleep;
+    std::vector<int> tileQuietFrames;
+    std::vector<uint8_t> tileDisturbed;
+    std::vector<uint8_t> particleAsleep;
+    bool activeListsDirty = false;
+    // Springs with an awake end, still grouped by color, and the particle
+    // runs of awake tiles; used instead of the full lists while any tile
+    // sleeps.
+    std::vector<Spring> activeSprings;
+    std::vector<size_t> activeColorOffsets;
+    std::vector<std::pair<size_t, size_t>> activeRanges;
+    void initSleeping();
+    void updateSleeping();
+    void setTileAsleep(int tile, bool asleep);
+    void wakeTilesNear(const glm::vec3& point, float radius);
+    void wakeAllTiles();
+    void rebuildActiveLists();
+    const std::vector<Spring>& solverSprings() const;
+    const std::vector<size_t>& solverColorOffsets() const;
+
+    // A grid whose spring list is exactly the stencil colorSprings assigns
+    // is solved straight off the particle arrays, color by color and row by
+    // row, without reading the list. XPBD multipliers are then indexed by
+    // direction * particle count + first particle.
+    bool gridStencil = false;
+    float stencilRestLength[6] = {};
+    void detectGridStencil();
+    bool stencilRowHasColor(int color, int y) const;
+    int stencilRuns(int color, int y, StencilRun runs[2]) const;
+    template <typename Body>
+    void forEachStencilRun(int color, const Body& body);
+    void solveStencilSprings();
+    void solveStencilConstraints(float timeStep);
+
 public:
+    static const float fixedTimeStep;
+
+    void springforces(ParticleState& particles, const std::vector<Spring>& springs, float stiffness, float damping);
+    void updateparticles(ParticleState& particles, float deltaTime);
+    void applygravity(ParticleState& particles, float deltaTime);
+
+    // Array-of-structs wrappers kept for callers that own loose particles.
     void springforces(std::vector<Particle>& particles, const std::vector<Spring>& springs, float stiffness, float damping);
     void updateparticles(std::vector<Particle>& particles, float deltaTime);
     void applygravity(std::vector<Particle>& particles, float deltaTime);
+    // Grabs the particle nearest to mousePos mapped from an 800x600 window
+    // onto the rest pose in the z = 0 plane. Kept for callers without a
+    // camera; applymouseconstraint with a ray works from any view.
     void applymouseconstraint(glm::vec2 mousePos, bool mousePressed);
+    // Grabs the cloth where the ray (e.g. from the camera through the
+    // cursor) first hits it and, while mousePressed stays set, drags the
+    // nearest corner of the hit triangle along the ray at the depth it was
+    // grabbed. Releasing drops it.
+    void applymouseconstraint(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, bool mousePressed);
     void update(float deltaTime);
+
+    // Simulates frameTime seconds of wall-clock time in fixed substeps of
+    // getSubstepTime(), carrying the remainder to the next call. At most
+    // maxSubsteps run per call; time beyond that budget is dropped so one
+    // slow frame cannot spiral. beforeStep, if set, runs before every
+    // substep; per-step inputs such as wind and the mouse constraint belong
+    // there, since they act on per-step velocities. Returns the substep count.
+    int advance(float frameTime, const std::function<void(float)>& beforeStep = nullptr);
+    float getSubstepTime() const;
+    // Largest stable step for the explicit force solver, from the stiffest
+    // particle's spring count and mass.
+    float stableTimeStep() const;
     void applywind(float deltaTime);
     void reset();
+
+    // Binary checkpoints in the layout described in clothcheckpoint.h.
+    // Loading replaces the particles, springs, grid size and parameters and
+    // returns false (leaving the cloth untouched) on a malformed buffer.
+    std::vector<uint8_t> saveCheckpoint() const;
+    bool loadCheckpoint(const void* data, size_t size);
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
     
-    const std::vector<Particle>& getParticles() const;
+    ParticleView getParticles() const;
     const std::vector<Spring>& getSprings() const;
+    const std::vector<size_t>& getSpringColorOffsets() const;
+    const std::shared_ptr<const ClothTopology>& getTopology() const { return topology; }
+
+    // Picking on the current positions through the triangle BVH.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, ClothRayHit& hit);
+    void particlesWithin(const glm::vec3& center, float radius, std::vector<int>& out);
+
+    // 0 picks the hardware thread count; 1 runs everything on the caller.
+    void setThreadCount(int count);
+    int getThreadCount() const;
+
+    ImplicitSolver& getImplicitSolver() { return implicitSolver; }
+    const ClothHierarchy& getHierarchy() const { return hierarchy; }
+
+    static const int sleepTileSize = 16;
+    int getSleepingTileCount() const { return sleepingTiles; }
+    bool isAsleep(size_t particle) const { return particleAsleep[particle] != 0; }
+    // Whether the next step solves the springs from the grid stencil.
+    bool usesGridStencil() const { return useGridStencil && gridStencil && sleepingTiles == 0; }
     
     Cloth(int width, int height, float spacing, float stiff, float damp);
+    // A cloth on an arbitrary mesh (see ClothTopology::loadObj). Particles
+    // are numbered like the mesh vertices; width is the particle count and
+    // height 1, spacing the mean edge length. Hierarchical mode runs as
+    // plain XPBD, since its coarse levels need a grid.
+    Cloth(std::shared_ptr<const ClothTopology> mesh, float stiff, float damp);
     float stiffness;
     float damping;
     int width;
     int height;
     float spacing;
+    bool useSpatialHash = true;
+    // Solve regular grids from their stencil rather than the Spring list;
+    // the results are bit-identical either way.
+    bool useGridStencil = true;
+    bool gravityEnabled = ::gravityEnabled;
+    bool selfCollisionEnabled = true;
+    bool phaseTimingEnabled = false;
+    // Continuous vertex-triangle and edge-edge self-collision at the end of
+    // each step, which catches crossings however fast the cloth moves and so
+    // needs no extra substeps against tunneling. Contacts are left
+    // continuousCollisionThickness * spacing apart, over at most
+    // continuousCollisionPasses detect-and-resolve passes.
+    bool continuousCollisionEnabled = false;
+    float continuousCollisionThickness = 0.05f;
+    int continuousCollisionPasses = 3;
+    int getContinuousContactCount() const { return continuousContacts; }
+    // Rigid obstacles, resolved at the end of every step after the ground
+    // plane, at one distance query per particle and collider. They belong to
+    // the scene rather than the cloth: checkpoints and reset() leave them be.
+    std::vector<ClothCollider> colliders;
+    // Seeds the per-particle random streams (wind gusts). Together with the
+    // colored solvers and fixed-chunk reductions this makes a run
+    // bit-identical for any thread count.
+    uint64_t randomSeed = 0;
+    SolverMode solverMode = SolverMode::ForceSprings;
+    int xpbdIterations = 4;
+    int hierarchyLevels = 5;
+    int coarseIterations = 2;
+    // A tile sleeps after sleepFrames steps in which none of its particles
+    // moved more than sleepThreshold * spacing.
+    bool sleepingEnabled = false;
+    float sleepThreshold = 0.002f;
+    int sleepFrames = 30;
+    // Substepping for advance(). The substep is maxTimeStep, clamped to
+    // stabilitySafety * stableTimeStep() for the force solver. A substep
+    // that moves any particle more than instabilityMotion * spacing halves
+    // the substep until frames run clean again.
+    float maxTimeStep = fixedTimeStep;
+    int maxSubsteps = 8;
+    float stabilitySafety = 0.6f;
+    bool adaptiveSubsteps = true;
+    float instabilityMotion = 0.5f;
+    int lastSubsteps = 0;
+    double droppedTime = 0.0;
+    PhaseTimings phaseTimings;
+    SimdLevel simdLevel = detectSimdLevel();
 };
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef CLOTHSNAPSHOT_H
+#define CLOTHSNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+#include "alignedallocator.h"
+
+class Cloth;
+struct ClothTopology;
+
+// Positions of one finished simulation step, handed from the solver to the
+// renderer.
+struct ClothSnapshot {
+    int width = 0;
+    int height = 0;
+    uint64_t step = 0;
+    AlignedVector<float> x, y, z;
+    // Shared with the cloth; null means a width x height grid.
+    std::shared_ptr<const ClothTopology> topology;
+
+    size_t size() const { return x.size(); }
+    glm::vec3 position(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+
+    void capture(const Cloth& cloth, uint64_t stepIndex);
+};
+
+#endif
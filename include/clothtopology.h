@@ -0,0 +1,55 @@
+#ifndef CLOTHTOPOLOGY_H
+#define CLOTHTOPOLOGY_H
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothgrid.h"
+
+// Connectivity of a cloth. A grid topology only records its dimensions: the
+// grid builds its springs from the fixed stencil and its triangles from
+// appendGridTriangles. A mesh topology, loaded from OBJ, keeps its rest pose,
+// its polygons and the fan triangulation the renderer draws.
+struct ClothTopology {
+    int gridWidth = 0;
+    int gridHeight = 0;
+
+    std::vector<glm::vec3> restPositions;
+    // Polygon p has vertices faceVertices[faceStart[p], faceStart[p + 1]).
+    std::vector<int> faceStart;
+    std::vector<int> faceVertices;
+    std::vector<unsigned int> triangles;
+
+    bool isGrid() const { return gridWidth > 0; }
+    size_t vertexCount() const;
+
+    static std::shared_ptr<const ClothTopology> grid(int width, int height);
+
+    // Two triangles per quad, (i0, i2, i3) and (i0, i3, i1), row by row.
+    static void appendGridTriangles(int width, int height, std::vector<unsigned int>& out);
+
+    // Reads `v` and `f` records (any polygon size, 1-based or negative
+    // indices, texture/normal references ignored), drops unused vertices
+    // and reorders the rest for locality. Returns false on a malformed or
+    // empty file.
+    bool loadObj(const std::string& path);
+    bool parseObj(std::istream& in);
+
+    // Renumbers vertices in reverse Cuthill-McKee order, so particles that
+    // share edges sit close together in memory and springs, adjacency rows
+    // and sleep tiles stay cache local.
+    void reorderForLocality();
+
+    // Structural springs along polygon edges, shear springs across polygon
+    // diagonals and half-stiffness bending springs between the opposite
+    // vertices of every pair of triangles sharing an edge. Each particle pair
+    // gets one spring; the list is sorted by particle.
+    void buildSprings(float stiffness, std::vector<Spring>& springs) const;
+
+    // Mean structural edge length, the mesh's equivalent of grid spacing.
+    float meanEdgeLength() const;
+};
+
+#endif
@@ -5,14 +5,17 @@
 #include <QTimer>
 #include <QKeyEvent>
 #include <QMouseEvent>
-#include "clothsim.h"
+#include <string>
+#include "clothrecorder.h"
+#include "simthread.h"
 #include "openGL.h"
 
 class ClothWidget : public QOpenGLWidget {
     Q_OBJECT
 
 public:
-    ClothWidget(QWidget *parent = nullptr);
+    // meshPath, if set, names an OBJ file to simulate instead of the grid.
+    ClothWidget(QWidget *parent = nullptr, const std::string& meshPath = std::string());
     ~ClothWidget();
 
 protected:
@@ -28,9 +31,18 @@ protected:
 private slots:
     void updateSimulation();
 
+private:
+    glm::mat4 projectionMatrix() const;
+    glm::mat4 viewMatrix() const;
+    // World-space ray from the camera through a widget pixel.
+    void cameraRay(glm::vec2 pixel, glm::vec3& origin, glm::vec3& direction) const;
+    void postMouse(bool pressed);
+    void toggleRecording();
+    void togglePlayback();
+
 private:
     QTimer timer;
-    Cloth cloth;
+    SimulationThread simulation;
     ClothRenderer renderer;
 
     glm::vec3 cameraPos;
@@ -42,6 +54,16 @@ private:
     bool windEnabled;
     bool windPending;
 
-    float lastFrameTime;
-    float deltaTime;
+    // Playback replaces the live simulation: the solver thread is stopped
+    // and recorded frames are drawn one per repaint.
+    std::string recordingPath;
+    bool recording;
+    ClothPlayback playback;
+    ClothSnapshot playbackFrame;
+    size_t playbackIndex;
+
+    // T toggles the profiler and its overlay; C writes its samples to
+    // profilePath and X writes a Chrome trace to tracePath.
+    std::string profilePath;
+    std::string tracePath;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef GLUPLOAD_H
+#define GLUPLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// GL enum values used by the buffer upload path, so code that plans uploads
+// does not need a GL header.
+namespace GLUploadEnum {
+    const unsigned ArrayBuffer = 0x8892;
+    const unsigned ElementArrayBuffer = 0x8893;
+    const unsigned StaticDraw = 0x88E4;
+    const unsigned StreamDraw = 0x88E0;
+    const unsigned MapWriteBit = 0x0002;
+    const unsigned MapInvalidateBufferBit = 0x0008;
+}
+
+// Buffer upload entry points of the GL function table. The renderer binds
+// them to glBufferData/glBufferSubData; tests bind them to fakes. Every byte
+// of client data handed to the driver is counted per frame and in total.
+class GLUploadTable {
+    public:
+        std::function<void(unsigned target, std::ptrdiff_t size, const void* data, unsigned usage)> glBufferData;
+        std::function<void(unsigned target, std::ptrdiff_t offset, std::ptrdiff_t size, const void* data)> glBufferSubData;
+        std::function<void*(unsigned target, std::ptrdiff_t offset, std::ptrdiff_t length, unsigned access)> glMapBufferRange;
+        std::function<bool(unsigned target)> glUnmapBuffer;
+
+        void bufferData(unsigned target, std::ptrdiff_t size, const void* data, unsigned usage) {
+            if (data) record(size);
+            if (glBufferData) glBufferData(target, size, data, usage);
+        }
+
+        void bufferSubData(unsigned target, std::ptrdiff_t offset, std::ptrdiff_t size, const void* data) {
+            record(size);
+            if (glBufferSubData) glBufferSubData(target, offset, size, data);
+        }
+
+        // A successful map counts its whole range as uploaded.
+        void* mapBufferRange(unsigned target, std::ptrdiff_t offset, std::ptrdiff_t length, unsigned access) {
+            void* mapped = glMapBufferRange ? glMapBufferRange(target, offset, length, access) : nullptr;
+            if (mapped) record(length);
+            return mapped;
+        }
+
+        bool unmapBuffer(unsigned target) {
+            return glUnmapBuffer ? glUnmapBuffer(target) : false;
+        }
+
+        void beginFrame() { frameBytes = 0; }
+        uint64_t getFrameBytes() const { return frameBytes; }
+        uint64_t getTotalBytes() const { return totalBytes; }
+        uint64_t getUploadCount() const { return uploadCount; }
+
+    private:
+        void record(std::ptrdiff_t size) {
+            frameBytes += static_cast<uint64_t>(size);
+            totalBytes += static_cast<uint64_t>(size);
+            uploadCount++;
+        }
+
+        uint64_t frameBytes = 0;
+        uint64_t totalBytes = 0;
+        uint64_t uploadCount = 0;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef IMPLICITSOLVER_H
+#define IMPLICITSOLVER_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothgrid.h"
+#include "threadpool.h"
+
+// Block compressed sparse rows of 3x3 blocks, one block row per particle.
+// The pattern follows the spring list: the diagonal plus one block per
+// spring neighbour.
+struct BlockSparseMatrix {
+    std::vector<int> rowStart;
+    std::vector<int> columns;
+    std::vector<glm::mat3> blocks;
+    std::vector<int> diagonal;
+
+    size_t rows() const { return diagonal.size(); }
+};
+
+// Linearized backward Euler (Baraff & Witkin 1998) for the spring network:
+//
+//   (M - dt df/dv - dt^2 df/dx) dv = dt (f0 + dt df/dx v0)
+//
+// solved with block-Jacobi preconditioned conjugate gradients. The sparsity
+// pattern is built once per topology and only the values are reassembled
+// each step.
+class ImplicitSolver {
+    public:
+        void buildPattern(size_t particleCount, const std::vector<Spring>& springs);
+        bool hasPattern(size_t particleCount, size_t springCount) const;
+        void clearPattern() { matrix = BlockSparseMatrix(); patternSprings = 0; }
+
+        // Advances the Verlet state by one implicit step and clears forces.
+        // Springs must be grouped by color as described by colorOffsets.
+        void step(ParticleState& particles, const std::vector<Spring>& springs,
+                  const std::vector<size_t>& colorOffsets, float stiffness, float damping,
+                  float timeStep, ThreadPool* pool);
+
+        const BlockSparseMatrix& getMatrix() const { return matrix; }
+        int getLastIterations() const { return lastIterations; }
+        float getLastResidual() const { return lastResidual; }
+
+        int maxIterations = 60;
+        float tolerance = 1e-4f;
+
+    private:
+        void assemble(const ParticleState& particles, const std::vector<Spring>& springs,
+                      const std::vector<size_t>& colorOffsets, float stiffness, float damping,
+                      float timeStep, ThreadPool* pool);
+        void assembleSprings(const ParticleState& particles, const std::vector<Spring>& springs,
+                             size_t first, size_t last, float stiffness, float damping, float timeStep);
+        void solve(const ParticleState& particles, ThreadPool* pool);
+        void multiply(const std::vector<glm::vec3>& in, std::vector<glm::vec3>& out, size_t first, size_t last) const;
+        float dot(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b, ThreadPool* pool);
+
+        BlockSparseMatrix matrix;
+        // Block indices (ii, ij, ji, jj) touched by each spring.
+        std::vector<int> springBlocks;
+        size_t patternSprings = 0;
+
+        std::vector<glm::vec3> velocity;
+        std::vector<glm::vec3> rhs;
+        std::vector<glm::vec3> deltaVelocity;
+        std::vector<glm::vec3> residual;
+        std::vector<glm::vec3> preconditioned;
+        std::vector<glm::vec3> direction;
+        std::vector<glm::vec3> product;
+        std::vector<glm::mat3> inverseDiagonal;
+        std::vector<float> partialSums;
+
+        int lastIterations = 0;
+        float lastResidual = 0.0f;
+};
+
+#endif
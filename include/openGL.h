@@ -2,15 +2,20 @@
 #define OPENGL_H
 
 #include <QOpenGLFunctions_3_3_Core>
-#include "clothsim.h"
+#include "clothmesh.h"
+#include "clothsnapshot.h"
+#include "glupload.h"
+#include "threadpool.h"
+#include <memory>
 #include <vector>
 
 class ClothRenderer{
 private:
     GLuint vao, vbo, ebo;
     GLuint shaderProgram;
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
+    ClothMesh mesh;
+    GLUploadTable uploads;
+    std::unique_ptr<ThreadPool> meshWorkers;
     QOpenGLFunctions_3_3_Core* gl; 
     
     const char* vertexShaderSource = R"(
@@ -61,8 +66,7 @@ private:
     
     GLuint compileShader(GLenum type, const char* source);
     void setupShaders();
-    void updateBuffers(const std::vector<Particle>& particles, int width, int height);
-    void calculateNormals(std::vector<float>& vertices, const std::vector<Particle>& particles, int width, int height);
+    void updateBuffers(const ClothSnapshot& snapshot);
     int currentShadingMode;
     GLuint wireframeProgram;
     
@@ -71,11 +75,10 @@ public:
     ~ClothRenderer();
     
     void initialize(QOpenGLFunctions_3_3_Core* funcs);
-    void render(const Cloth& cloth, const std::vector<Particle>& particles, const glm::mat4& projection, const glm::mat4& view);
+    void render(const ClothSnapshot& snapshot, const glm::mat4& projection, const glm::mat4& view);
     void setShadingMode(int mode);
     void toggleWireframe(bool enable);
-    void calculateNormalsAndCurvature(std::vector<float>& vertices, const std::vector<Particle>& particles, int width, int height);
-    float calculateCurvature(const std::vector<Particle>& particles, int index, int width, int height);
+    const GLUploadTable& uploadStats() const { return uploads; }
 };
 
 #endif
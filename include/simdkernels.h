@@ -0,0 +1,68 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <cstddef>
+#include "clothgrid.h"
+
+// Instruction sets the solver kernels can be dispatched to at runtime.
+enum class SimdLevel {
+    Scalar = 0,
+    SSE = 1,
+    AVX2 = 2
+};
+
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Accumulates spring and damping forces for springs[first, last) into the
+// particle force arrays. All variants produce bit-identical results.
+void springForcesScalar(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping);
+void springForcesSse(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping);
+void springForcesAvx2(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping);
+
+// A run of regular-grid springs sharing a direction and rest length: spring
+// j joins particle first + j * stride to the particle `offset` further on.
+// No particle may appear twice in a run.
+struct StencilRun {
+    size_t first;
+    size_t count;
+    size_t stride;
+    size_t offset;
+    float restLength;
+};
+
+// springForces for a run, read straight off the grid instead of a Spring
+// list: unit-stride loads and stores when stride is 1. Bit-identical to
+// springForces over the same springs.
+void stencilForcesScalar(ParticleState& particles, const StencilRun& run, float stiffness, float damping);
+void stencilForcesSse(ParticleState& particles, const StencilRun& run, float stiffness, float damping);
+void stencilForcesAvx2(ParticleState& particles, const StencilRun& run, float stiffness, float damping);
+
+// Verlet step with ground clamp for particles[first, last). Clears forces.
+void integrateScalar(ParticleState& particles, size_t first, size_t last, float timeStep);
+void integrateSse(ParticleState& particles, size_t first, size_t last, float timeStep);
+void integrateAvx2(ParticleState& particles, size_t first, size_t last, float timeStep);
+
+// Destination rows for the face normal kernels: one entry per quad for each
+// of its triangles (i0, i2, i3) and (i0, i3, i1).
+struct FaceNormalRow {
+    float* ax;
+    float* ay;
+    float* az;
+    float* bx;
+    float* by;
+    float* bz;
+};
+
+// Unnormalized (area weighted) triangle normals for quads [first, last) of
+// the vertex row starting at x/y/z, whose next row is `stride` floats on.
+void faceNormalsScalar(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out);
+void faceNormalsSse(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out);
+void faceNormalsAvx2(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out);
+
+void springForces(SimdLevel level, ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping);
+void stencilForces(SimdLevel level, ParticleState& particles, const StencilRun& run, float stiffness, float damping);
+void integrate(SimdLevel level, ParticleState& particles, size_t first, size_t last, float timeStep);
+void faceNormals(SimdLevel level, const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "clothrecorder.h"
+#include "clothsim.h"
+#include "clothsnapshot.h"
+#include "triplebuffer.h"
+
+// Input forwarded from the GUI thread to the simulation worker.
+struct SimCommand {
+    enum Type {
+        Mouse,
+        MouseRay,
+        SetWind,
+        SetGravity,
+        Reset,
+        Record,
+        LoadMesh
+    };
+
+    Type type;
+    glm::vec2 mousePos = glm::vec2(0.0f);
+    glm::vec3 rayOrigin = glm::vec3(0.0f);
+    glm::vec3 rayDirection = glm::vec3(0.0f);
+    bool enabled = false;
+    std::string path{};
+
+    static SimCommand mouse(glm::vec2 pos, bool pressed);
+    // The cursor as a world-space ray from the camera; see
+    // Cloth::applymouseconstraint.
+    static SimCommand mouseRay(const glm::vec3& origin, const glm::vec3& direction, bool pressed);
+    static SimCommand wind(bool enabled);
+    static SimCommand gravity(bool enabled);
+    static SimCommand reset();
+    // Starts recording published steps to `path`; an empty path stops.
+    static SimCommand record(const std::string& path);
+    // Replaces the cloth with one built on the OBJ mesh at `path`.
+    static SimCommand loadMesh(const std::string& path);
+};
+
+// Runs Cloth::update on a dedicated thread at a fixed rate. Finished steps
+// are published through a triple buffer so the renderer never blocks on the
+// solver, and input arrives through a command queue drained before each step.
+class SimulationThread {
+    public:
+        SimulationThread(int width, int height, float spacing, float stiffness, float damping);
+        ~SimulationThread();
+
+        SimulationThread(const SimulationThread&) = delete;
+        SimulationThread& operator=(const SimulationThread&) = delete;
+
+        void start();
+        void stop();
+        bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+        void post(const SimCommand& command);
+
+        // Reader side, GUI thread only.
+        bool acquireSnapshot() { return snapshots.acquire(); }
+        const ClothSnapshot& snapshot() const { return snapshots.readBuffer(); }
+
+        void setStepInterval(std::chrono::microseconds interval) { stepInterval = interval; }
+        uint64_t getStepCount() const { return stepCount.load(std::memory_order_acquire); }
+
+    private:
+        void run();
+        void drainCommands();
+        void loadMesh(const std::string& path);
+        void step(float deltaTime);
+        void publishSnapshot();
+
+        Cloth cloth;
+        TripleBuffer<ClothSnapshot> snapshots;
+        ClothRecorder recorder;
+
+        std::mutex commandMutex;
+        std::vector<SimCommand> pendingCommands;
+        std::vector<SimCommand> activeCommands;
+
+        std::thread worker;
+        std::atomic<bool> running{false};
+        std::atomic<uint64_t> stepCount{0};
+        std::chrono::microseconds stepInterval{16000};
+
+        // Worker-owned input state.
+        glm::vec2 mousePos = glm::vec2(0.0f);
+        glm::vec3 rayOrigin = glm::vec3(0.0f);
+        glm::vec3 rayDirection = glm::vec3(0.0f);
+        bool mouseUsesRay = false;
+        bool mousePressed = false;
+        bool windEnabled = false;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool for data-parallel loops. The calling thread joins in on
+// every parallelFor, so a pool of N threads spawns N - 1 workers.
+class ThreadPool {
+    public:
+        explicit ThreadPool(int threadCount);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int size() const { return static_cast<int>(workers.size()) + 1; }
+
+        // Splits [0, count) into chunks of at most `grain` items and runs
+        // body(first, last) on them. Returns once every chunk has finished.
+        // The body is called through a plain pointer, never copied, so a
+        // loop costs no allocation however much its lambda captures.
+        template <typename Body>
+        void parallelFor(size_t count, size_t grain, const Body& body) {
+            run(count, grain, &callBody<Body>, &body);
+        }
+
+    private:
+        using ChunkFunction = void (*)(const void* body, size_t first, size_t last);
+
+        template <typename Body>
+        static void callBody(const void* body, size_t first, size_t last) {
+            (*static_cast<const Body*>(body))(first, last);
+        }
+
+        void run(size_t count, size_t grain, ChunkFunction function, const void* body);
+        void workerLoop();
+        void runChunks();
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+
+        ChunkFunction jobFunction = nullptr;
+        const void* job = nullptr;
+        size_t jobCount = 0;
+        size_t jobGrain = 1;
+        std::atomic<size_t> nextChunk{0};
+        int busyWorkers = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer triple buffer. The writer fills
+// writeBuffer() and publishes it; the reader acquires the newest published
+// buffer without ever waiting on the writer.
+template <typename T>
+class TripleBuffer {
+    public:
+        T& writeBuffer() { return buffers[back]; }
+
+        void publish() {
+            unsigned previous = middle.exchange(back | freshBit, std::memory_order_acq_rel);
+            back = previous & indexMask;
+        }
+
+        // Returns true if a newer buffer was published since the last call.
+        bool acquire() {
+            if ((middle.load(std::memory_order_acquire) & freshBit) == 0) return false;
+            unsigned previous = middle.exchange(front, std::memory_order_acq_rel);
+            front = previous & indexMask;
+            return true;
+        }
+
+        const T& readBuffer() const { return buffers[front]; }
+
+    private:
+        static const unsigned indexMask = 0x3;
+        static const unsigned freshBit = 0x4;
+
+        T buffers[3];
+        std::atomic<unsigned> middle{1};
+        unsigned back = 0;
+        unsigned front = 2;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool for batches of independent tasks of uneven cost. Every thread owns a
+// queue; run() deals the tasks round-robin across the queues, each thread
+// works through its own from the front and, once empty, steals from the back
+// of the others. Like ThreadPool, the calling thread takes part, so a pool of
+// N threads spawns N - 1 workers.
+class WorkStealingPool {
+    public:
+        explicit WorkStealingPool(int threadCount);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        int size() const { return static_cast<int>(workers.size()) + 1; }
+
+        // Runs task(id) for every id in `tasks` and returns once all have
+        // finished. Deal the most expensive tasks first for the best balance.
+        // As with ThreadPool::parallelFor, the task is called through a plain
+        // pointer and never copied.
+        template <typename Task>
+        void run(const std::vector<size_t>& tasks, const Task& task) {
+            run(tasks, &callTask<Task>, &task);
+        }
+
+        uint64_t getStealCount() const { return steals.load(std::memory_order_relaxed); }
+
+    private:
+        using TaskFunction = void (*)(const void* task, size_t id);
+
+        template <typename Task>
+        static void callTask(const void* task, size_t id) {
+            (*static_cast<const Task*>(task))(id);
+        }
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> items;
+        };
+
+        void run(const std::vector<size_t>& tasks, TaskFunction function, const void* task);
+        void workerLoop(int index);
+        void drain(int index);
+        bool pop(int index, size_t& item);
+        bool steal(int thief, size_t& item);
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+
+        TaskFunction jobFunction = nullptr;
+        const void* job = nullptr;
+        std::atomic<uint64_t> steals{0};
+        int busyWorkers = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "clothbatch.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+int resolveThreadCount(int count) {
+    if (count > 0) return count;
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? static_cast<int>(cores) : 1;
+}
+
+}
+
+ClothBatch::ClothBatch(int threadCount)
+    : pool(resolveThreadCount(threadCount)) {
+}
+
+size_t ClothBatch::add(const ClothInstanceConfig& config) {
+    auto instance = std::make_unique<Cloth>(config.width, config.height, config.spacing,
+                                            config.stiffness, config.damping);
+    instance->solverMode = config.solverMode;
+    instance->gravityEnabled = config.gravityEnabled;
+    instance->setThreadCount(1);
+    cloths.push_back(std::move(instance));
+
+    const size_t index = cloths.size() - 1;
+    auto position = std::upper_bound(order.begin(), order.end(), index, [this](size_t a, size_t b) {
+        return cloths[a]->getParticles().size() > cloths[b]->getParticles().size();
+    });
+    order.insert(position, index);
+    return index;
+}
+
+void ClothBatch::step(int steps, float timeStep) {
+    if (steps <= 0) return;
+
+    pool.run(order, [&](size_t index) {
+        Cloth& instance = *cloths[index];
+        for (int i = 0; i < steps; i++) {
+            instance.update(timeStep);
+        }
+    });
+    stepsTaken += steps;
+    clothSteps += static_cast<uint64_t>(steps) * cloths.size();
+}
+
+void ClothBatch::capture(size_t index, ClothSnapshot& snapshot) const {
+    snapshot.capture(*cloths[index], stepsTaken);
+}
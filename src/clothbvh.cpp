@@ -0,0 +1,357 @@
+#include "clothbvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Median splits keep the tree balanced, so its depth stays far below this
+// even for billions of triangles.
+const int maxDepth = 64;
+
+// Entry distance of the ray into the box, or FLT_MAX if it misses or the
+// box lies beyond limit.
+float rayBoxEntry(const glm::vec3& origin, const glm::vec3& inverseDirection,
+                  const glm::vec3& boundsMin, const glm::vec3& boundsMax, float limit) {
+    glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+    glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+    glm::vec3 lower = glm::min(t0, t1);
+    glm::vec3 upper = glm::max(t0, t1);
+    float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+    float exit = std::min(std::min(upper.x, upper.y), std::min(upper.z, limit));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+float boxDistanceSquared(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 outside = glm::max(glm::max(boundsMin - point, point - boundsMax), glm::vec3(0.0f));
+    return glm::dot(outside, outside);
+}
+
+}
+
+void ClothBVH::build(const ClothTopology& topology, const ParticleState& particles) {
+    nodes.clear();
+    triangles.clear();
+    leafNodes.clear();
+    leafVertexStart.assign(1, 0);
+    leafVertices.clear();
+    visited.assign(particles.size(), 0);
+    visitStamp = 0;
+
+    if (topology.isGrid()) {
+        ClothTopology::appendGridTriangles(topology.gridWidth, topology.gridHeight, triangles);
+    } else {
+        triangles = topology.triangles;
+    }
+
+    const size_t count = triangles.size() / 3;
+    if (count == 0) return;
+
+    std::vector<glm::vec3> centroids(count);
+    for (size_t t = 0; t < count; t++) {
+        centroids[t] = (particles.position(triangles[3 * t]) +
+                        particles.position(triangles[3 * t + 1]) +
+                        particles.position(triangles[3 * t + 2])) / 3.0f;
+    }
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+
+    struct Range {
+        int node;
+        int first;
+        int count;
+    };
+    std::vector<Range> pending;
+    nodes.reserve(2 * (count / leafSize + 1));
+    nodes.push_back(Node());
+    pending.push_back({0, 0, static_cast<int>(count)});
+
+    while (!pending.empty()) {
+        Range range = pending.back();
+        pending.pop_back();
+
+        if (range.count <= leafSize) {
+            nodes[range.node].first = range.first;
+            nodes[range.node].count = range.count;
+            leafNodes.push_back(range.node);
+            continue;
+        }
+
+        // Split at the median centroid along the widest axis.
+        glm::vec3 lo = centroids[order[range.first]];
+        glm::vec3 hi = lo;
+        for (int k = range.first + 1; k < range.first + range.count; k++) {
+            lo = glm::min(lo, centroids[order[k]]);
+            hi = glm::max(hi, centroids[order[k]]);
+        }
+        glm::vec3 extent = hi - lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        int half = range.count / 2;
+        std::nth_element(order.begin() + range.first, order.begin() + range.first + half,
+                         order.begin() + range.first + range.count,
+                         [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        int left = static_cast<int>(nodes.size());
+        nodes[range.node].first = left;
+        nodes[range.node].count = 0;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        pending.push_back({left, range.first, half});
+        pending.push_back({left + 1, range.first + half, range.count - half});
+    }
+
+    std::vector<unsigned int> sorted(triangles.size());
+    for (size_t t = 0; t < count; t++) {
+        for (int k = 0; k < 3; k++) {
+            sorted[3 * t + k] = triangles[3 * order[t] + k];
+        }
+    }
+    triangles.swap(sorted);
+
+    for (int leaf : leafNodes) {
+        const Node& node = nodes[leaf];
+        size_t first = leafVertices.size();
+        leafVertices.insert(leafVertices.end(), triangles.begin() + 3 * node.first,
+                            triangles.begin() + 3 * (node.first + node.count));
+        std::sort(leafVertices.begin() + first, leafVertices.end());
+        leafVertices.erase(std::unique(leafVertices.begin() + first, leafVertices.end()), leafVertices.end());
+        leafVertexStart.push_back(static_cast<int>(leafVertices.size()));
+    }
+
+    refit(particles);
+}
+
+void ClothBVH::refit(const ParticleState& particles) {
+    triangleMin.clear();
+    triangleMax.clear();
+
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+
+    for (size_t k = 0; k < leafNodes.size(); k++) {
+        const unsigned int* vertex = leafVertices.data() + leafVertexStart[k];
+        const unsigned int* end = leafVertices.data() + leafVertexStart[k + 1];
+        float minX = x[*vertex], minY = y[*vertex], minZ = z[*vertex];
+        float maxX = minX, maxY = minY, maxZ = minZ;
+        for (++vertex; vertex != end; ++vertex) {
+            minX = std::min(minX, x[*vertex]);
+            minY = std::min(minY, y[*vertex]);
+            minZ = std::min(minZ, z[*vertex]);
+            maxX = std::max(maxX, x[*vertex]);
+            maxY = std::max(maxY, y[*vertex]);
+            maxZ = std::max(maxZ, z[*vertex]);
+        }
+        Node& node = nodes[leafNodes[k]];
+        node.boundsMin = glm::vec3(minX, minY, minZ);
+        node.boundsMax = glm::vec3(maxX, maxY, maxZ);
+    }
+
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.count > 0) continue;
+        const Node& left = nodes[node.first];
+        const Node& right = nodes[node.first + 1];
+        node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+        node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+    }
+}
+
+void ClothBVH::refitSwept(const std::vector<glm::vec3>& start, const ParticleState& particles, float margin) {
+    const size_t count = triangleCount();
+    triangleMin.resize(count);
+    triangleMax.resize(count);
+    const glm::vec3 grow(margin);
+
+    for (size_t t = 0; t < count; t++) {
+        const unsigned int* corner = triangles.data() + 3 * t;
+        glm::vec3 lo = particles.position(corner[0]);
+        glm::vec3 hi = lo;
+        for (int k = 0; k < 3; k++) {
+            glm::vec3 current = particles.position(corner[k]);
+            lo = glm::min(lo, glm::min(current, start[corner[k]]));
+            hi = glm::max(hi, glm::max(current, start[corner[k]]));
+        }
+        triangleMin[t] = lo - grow;
+        triangleMax[t] = hi + grow;
+    }
+
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.count > 0) {
+            node.boundsMin = triangleMin[node.first];
+            node.boundsMax = triangleMax[node.first];
+            for (int t = node.first + 1; t < node.first + node.count; t++) {
+                node.boundsMin = glm::min(node.boundsMin, triangleMin[t]);
+                node.boundsMax = glm::max(node.boundsMax, triangleMax[t]);
+            }
+        } else {
+            const Node& left = nodes[node.first];
+            const Node& right = nodes[node.first + 1];
+            node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+        }
+    }
+}
+
+bool ClothBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, const ParticleState& particles,
+                       ClothRayHit& hit) const {
+    if (nodes.empty()) return false;
+
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    float best = FLT_MAX;
+
+    int stack[maxDepth];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (rayBoxEntry(origin, inverseDirection, node.boundsMin, node.boundsMax, best) == FLT_MAX) continue;
+
+        if (node.count == 0) {
+            // Visit the nearer child first so the farther one is usually
+            // culled by the hit found there.
+            int nearChild = node.first;
+            int farChild = node.first + 1;
+            float nearEntry = rayBoxEntry(origin, inverseDirection, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax, best);
+            float farEntry = rayBoxEntry(origin, inverseDirection, nodes[farChild].boundsMin, nodes[farChild].boundsMax, best);
+            if (farEntry < nearEntry) {
+                std::swap(nearChild, farChild);
+                std::swap(nearEntry, farEntry);
+            }
+            if (farEntry != FLT_MAX) stack[top++] = farChild;
+            if (nearEntry != FLT_MAX) stack[top++] = nearChild;
+            continue;
+        }
+
+        // Moller-Trumbore, accepting both faces.
+        for (int t = node.first; t < node.first + node.count; t++) {
+            const unsigned int* corner = triangles.data() + 3 * t;
+            glm::vec3 a = particles.position(corner[0]);
+            glm::vec3 edge1 = particles.position(corner[1]) - a;
+            glm::vec3 edge2 = particles.position(corner[2]) - a;
+
+            glm::vec3 p = glm::cross(direction, edge2);
+            float determinant = glm::dot(edge1, p);
+            if (std::fabs(determinant) < 1e-12f) continue;
+            float inverseDeterminant = 1.0f / determinant;
+
+            glm::vec3 s = origin - a;
+            float u = glm::dot(s, p) * inverseDeterminant;
+            if (u < 0.0f || u > 1.0f) continue;
+            glm::vec3 q = glm::cross(s, edge1);
+            float v = glm::dot(direction, q) * inverseDeterminant;
+            if (v < 0.0f || u + v > 1.0f) continue;
+            float distance = glm::dot(edge2, q) * inverseDeterminant;
+            if (distance < 0.0f || distance >= best) continue;
+
+            best = distance;
+            hit.t = distance;
+            hit.u = u;
+            hit.v = v;
+            for (int k = 0; k < 3; k++) hit.vertices[k] = static_cast<int>(corner[k]);
+        }
+    }
+    return best != FLT_MAX;
+}
+
+void ClothBVH::queryRadius(const glm::vec3& center, float radius, const ParticleState& particles, std::vector<int>& out) {
+    out.clear();
+    if (nodes.empty() || !(radius > 0.0f)) return;
+
+    if (++visitStamp == 0) {
+        std::fill(visited.begin(), visited.end(), 0);
+        visitStamp = 1;
+    }
+    const float radius2 = radius * radius;
+
+    int stack[maxDepth];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (boxDistanceSquared(center, node.boundsMin, node.boundsMax) >= radius2) continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+
+        const unsigned int* corner = triangles.data() + 3 * node.first;
+        for (int k = 0; k < 3 * node.count; k++) {
+            unsigned int i = corner[k];
+            if (visited[i] == visitStamp) continue;
+            visited[i] = visitStamp;
+
+            glm::vec3 offset = particles.position(i) - center;
+            if (glm::dot(offset, offset) < radius2) out.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+void ClothBVH::selfOverlaps(std::vector<std::pair<int, int>>& out) {
+    out.clear();
+    if (nodes.empty() || triangleMin.size() != triangleCount()) return;
+
+    auto overlap = [](const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+        return minA.x <= maxB.x && minB.x <= maxA.x &&
+               minA.y <= maxB.y && minB.y <= maxA.y &&
+               minA.z <= maxB.z && minB.z <= maxA.z;
+    };
+
+    std::vector<std::pair<int, int>>& pending = pendingPairs;
+    pending.clear();
+    pending.push_back({0, 0});
+    while (!pending.empty()) {
+        const int a = pending.back().first;
+        const int b = pending.back().second;
+        pending.pop_back();
+        const Node& nodeA = nodes[a];
+        const Node& nodeB = nodes[b];
+
+        if (a == b) {
+            if (nodeA.count == 0) {
+                pending.push_back({nodeA.first, nodeA.first});
+                pending.push_back({nodeA.first + 1, nodeA.first + 1});
+                pending.push_back({nodeA.first, nodeA.first + 1});
+                continue;
+            }
+            for (int i = nodeA.first; i < nodeA.first + nodeA.count; i++) {
+                for (int j = i + 1; j < nodeA.first + nodeA.count; j++) {
+                    if (overlap(triangleMin[i], triangleMax[i], triangleMin[j], triangleMax[j])) out.push_back({i, j});
+                }
+            }
+            continue;
+        }
+
+        if (!overlap(nodeA.boundsMin, nodeA.boundsMax, nodeB.boundsMin, nodeB.boundsMax)) continue;
+
+        if (nodeA.count == 0 || nodeB.count == 0) {
+            // Descend into the inner node, the larger one if both are.
+            bool splitA = nodeB.count > 0 || (nodeA.count == 0 &&
+                glm::dot(nodeA.boundsMax - nodeA.boundsMin, glm::vec3(1.0f)) >=
+                glm::dot(nodeB.boundsMax - nodeB.boundsMin, glm::vec3(1.0f)));
+            if (splitA) {
+                pending.push_back({nodeA.first, b});
+                pending.push_back({nodeA.first + 1, b});
+            } else {
+                pending.push_back({a, nodeB.first});
+                pending.push_back({a, nodeB.first + 1});
+            }
+            continue;
+        }
+
+        for (int i = nodeA.first; i < nodeA.first + nodeA.count; i++) {
+            for (int j = nodeB.first; j < nodeB.first + nodeB.count; j++) {
+                if (overlap(triangleMin[i], triangleMax[i], triangleMin[j], triangleMax[j])) {
+                    out.push_back({std::min(i, j), std::max(i, j)});
+                }
+            }
+        }
+    }
+}
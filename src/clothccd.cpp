@@ -0,0 +1,345 @@
+#include "clothccd.h"
+#include "clothgeometry.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int rootBisections = 48;
+
+uint64_t pairKey(int a, int b) {
+    if (a > b) std::swap(a, b);
+    return (static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b);
+}
+
+// Roots of c[0] + c[1] t + c[2] t^2 + c[3] t^3 in [0, 1], ascending. The
+// interval is split at the turning points, so each piece is monotonic and
+// holds at most one root, found by bisection.
+int cubicRootsInUnitInterval(const double c[4], double roots[3]) {
+    auto f = [&](double t) { return ((c[3] * t + c[2]) * t + c[1]) * t + c[0]; };
+
+    double bounds[4] = {0.0, 0.0, 0.0, 0.0};
+    int boundCount = 1;
+    const double qa = 3.0 * c[3];
+    const double qb = 2.0 * c[2];
+    const double qc = c[1];
+    double turning[2];
+    int turns = 0;
+    if (qa != 0.0) {
+        double discriminant = qb * qb - 4.0 * qa * qc;
+        if (discriminant >= 0.0) {
+            double q = -0.5 * (qb + std::copysign(std::sqrt(discriminant), qb));
+            turning[turns++] = q / qa;
+            if (q != 0.0) turning[turns++] = qc / q;
+        }
+    } else if (qb != 0.0) {
+        turning[turns++] = -qc / qb;
+    }
+    if (turns == 2 && turning[1] < turning[0]) std::swap(turning[0], turning[1]);
+    for (int k = 0; k < turns; k++) {
+        if (turning[k] > 0.0 && turning[k] < 1.0) bounds[boundCount++] = turning[k];
+    }
+    bounds[boundCount++] = 1.0;
+
+    int count = 0;
+    for (int k = 0; k + 1 < boundCount; k++) {
+        double lo = bounds[k];
+        double hi = bounds[k + 1];
+        double fLo = f(lo);
+        double fHi = f(hi);
+        if (fLo == 0.0) {
+            if (count == 0 || roots[count - 1] != lo) roots[count++] = lo;
+            continue;
+        }
+        if ((fLo < 0.0) == (fHi < 0.0) && fHi != 0.0) continue;
+
+        for (int i = 0; i < rootBisections; i++) {
+            double mid = 0.5 * (lo + hi);
+            double fMid = f(mid);
+            if ((fMid < 0.0) == (fLo < 0.0) && fMid != 0.0) {
+                lo = mid;
+                fLo = fMid;
+            } else {
+                hi = mid;
+            }
+        }
+        roots[count++] = hi;
+    }
+    return count;
+}
+
+// Also tries the end of the step: pairs that end up closer than the
+// thickness without crossing are pushed apart as well.
+int withEndOfStep(double roots[4], int count) {
+    if (count == 0 || roots[count - 1] < 1.0) roots[count++] = 1.0;
+    return count;
+}
+
+// Coefficients in t of (e1(t) x e2(t)) . d(t), each vector moving linearly
+// from its value at the start of the step (a) by its change over it (b).
+void coplanarityCubic(const glm::vec3& a1, const glm::vec3& b1, const glm::vec3& a2, const glm::vec3& b2,
+                      const glm::vec3& a3, const glm::vec3& b3, double c[4]) {
+    const glm::dvec3 e1(a1), f1(b1), e2(a2), f2(b2), d(a3), g(b3);
+    const glm::dvec3 c0 = glm::cross(e1, e2);
+    const glm::dvec3 c1 = glm::cross(e1, f2) + glm::cross(f1, e2);
+    const glm::dvec3 c2 = glm::cross(f1, f2);
+    c[0] = glm::dot(c0, d);
+    c[1] = glm::dot(c1, d) + glm::dot(c0, g);
+    c[2] = glm::dot(c2, d) + glm::dot(c1, g);
+    c[3] = glm::dot(c2, g);
+}
+
+// Pushes the weighted points A = sum wA[k] x[a[k]] and B = sum wB[k] x[b[k]]
+// apart along n until A - B is `thickness` on n's side, splitting the
+// correction by inverse mass. n points from B towards A at the start of the
+// step. Returns false if nothing could or had to move; with apply unset it
+// only reports that.
+template <int CountA, int CountB>
+bool separate(ParticleState& particles, const int (&a)[CountA], const float (&wA)[CountA],
+              const int (&b)[CountB], const float (&wB)[CountB], const glm::vec3& n, float thickness,
+              bool apply) {
+    glm::vec3 pointA(0.0f), pointB(0.0f);
+    float denominator = 0.0f;
+    for (int k = 0; k < CountA; k++) {
+        pointA += particles.position(a[k]) * wA[k];
+        denominator += wA[k] * wA[k] * particles.invMass[a[k]];
+    }
+    for (int k = 0; k < CountB; k++) {
+        pointB += particles.position(b[k]) * wB[k];
+        denominator += wB[k] * wB[k] * particles.invMass[b[k]];
+    }
+
+    float gap = glm::dot(pointA - pointB, n);
+    if (gap >= thickness || denominator <= 0.0f) return false;
+    if (!apply) return true;
+
+    const float lambda = (thickness - gap) / denominator;
+    for (int k = 0; k < CountA; k++) {
+        particles.setPosition(a[k], particles.position(a[k]) + n * (lambda * wA[k] * particles.invMass[a[k]]));
+    }
+    for (int k = 0; k < CountB; k++) {
+        particles.setPosition(b[k], particles.position(b[k]) - n * (lambda * wB[k] * particles.invMass[b[k]]));
+    }
+    return true;
+}
+
+// Orients n to point from B to A where they started, or against their
+// approach if they started touching.
+glm::vec3 orientNormal(glm::vec3 n, const glm::vec3& startGap, const glm::vec3& relativeMotion) {
+    float side = glm::dot(n, startGap);
+    if (side < 0.0f || (side == 0.0f && glm::dot(n, relativeMotion) > 0.0f)) n = -n;
+    return n;
+}
+
+}
+
+void ClothCCD::build(const ClothTopology& topology, const ParticleState& particles) {
+    bvh.build(topology, particles);
+
+    const size_t count = bvh.triangleCount();
+    std::vector<uint64_t> edges;
+    edges.reserve(count * 3);
+    for (size_t t = 0; t < count; t++) {
+        const unsigned int* v = bvh.triangle(t);
+        for (int k = 0; k < 3; k++) edges.push_back(pairKey(v[k], v[(k + 1) % 3]));
+    }
+    std::vector<uint64_t> unique(edges);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    edgeVertices.resize(unique.size() * 2);
+    for (size_t e = 0; e < unique.size(); e++) {
+        edgeVertices[2 * e] = static_cast<int>(unique[e] >> 32);
+        edgeVertices[2 * e + 1] = static_cast<int>(unique[e] & 0xffffffffu);
+    }
+    triangleEdges.resize(edges.size());
+    for (size_t k = 0; k < edges.size(); k++) {
+        triangleEdges[k] = static_cast<int>(std::lower_bound(unique.begin(), unique.end(), edges[k]) - unique.begin());
+    }
+}
+
+void ClothCCD::beginStep(const ParticleState& particles) {
+    start.resize(particles.size());
+    for (size_t i = 0; i < start.size(); i++) start[i] = particles.position(i);
+}
+
+int ClothCCD::resolve(ParticleState& particles, float thickness, int passes) {
+    int resolved = 0;
+    if (bvh.empty() || start.size() != particles.size()) return resolved;
+
+    int contacts = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        findCandidates(particles, thickness);
+        contacts = resolveCandidates(particles, thickness, false);
+        resolved += contacts;
+        if (contacts == 0) return resolved;
+    }
+
+    // Fixing one contact can cause another, and the passes ran out. Every
+    // particle still in a crossing goes back to where the step began, which
+    // was crossing-free, until none is left.
+    while (contacts > 0) {
+        findCandidates(particles, thickness);
+        contacts = resolveCandidates(particles, thickness, true);
+    }
+    return resolved;
+}
+
+void ClothCCD::findCandidates(const ParticleState& particles, float thickness) {
+    bvh.refitSwept(start, particles, thickness);
+    bvh.selfOverlaps(trianglePairs);
+
+    vertexFace.clear();
+    edgeEdge.clear();
+    for (const std::pair<int, int>& pair : trianglePairs) {
+        const unsigned int* first = bvh.triangle(pair.first);
+        const unsigned int* second = bvh.triangle(pair.second);
+        for (int k = 0; k < 3; k++) {
+            if (std::find(second, second + 3, first[k]) == second + 3) {
+                vertexFace.push_back((static_cast<uint64_t>(first[k]) << 32) | static_cast<uint32_t>(pair.second));
+            }
+            if (std::find(first, first + 3, second[k]) == first + 3) {
+                vertexFace.push_back((static_cast<uint64_t>(second[k]) << 32) | static_cast<uint32_t>(pair.first));
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            const int edgeA = triangleEdges[3 * pair.first + i];
+            for (int j = 0; j < 3; j++) {
+                const int edgeB = triangleEdges[3 * pair.second + j];
+                const int a0 = edgeVertices[2 * edgeA], a1 = edgeVertices[2 * edgeA + 1];
+                const int b0 = edgeVertices[2 * edgeB], b1 = edgeVertices[2 * edgeB + 1];
+                if (a0 == b0 || a0 == b1 || a1 == b0 || a1 == b1) continue;
+                edgeEdge.push_back(pairKey(edgeA, edgeB));
+            }
+        }
+    }
+    std::sort(vertexFace.begin(), vertexFace.end());
+    vertexFace.erase(std::unique(vertexFace.begin(), vertexFace.end()), vertexFace.end());
+    std::sort(edgeEdge.begin(), edgeEdge.end());
+    edgeEdge.erase(std::unique(edgeEdge.begin(), edgeEdge.end()), edgeEdge.end());
+}
+
+int ClothCCD::resolveCandidates(ParticleState& particles, float thickness, bool freeze) {
+    int contacts = 0;
+    for (uint64_t key : vertexFace) {
+        int vertex = static_cast<int>(key >> 32);
+        int face = static_cast<int>(key & 0xffffffffu);
+        if (resolveVertexFace(particles, vertex, face, thickness, freeze)) contacts++;
+    }
+    for (uint64_t key : edgeEdge) {
+        int edgeA = static_cast<int>(key >> 32);
+        int edgeB = static_cast<int>(key & 0xffffffffu);
+        if (resolveEdgeEdge(particles, edgeA, edgeB, thickness, freeze)) contacts++;
+    }
+    return contacts;
+}
+
+bool ClothCCD::freezeParticles(ParticleState& particles, const int (&v)[4]) {
+    bool moved = false;
+    for (int k = 0; k < 4; k++) {
+        if (particles.invMass[v[k]] == 0.0f || particles.position(v[k]) == start[v[k]]) continue;
+        particles.setPosition(v[k], start[v[k]]);
+        moved = true;
+    }
+    return moved;
+}
+
+bool ClothCCD::resolveVertexFace(ParticleState& particles, int vertex, int face, float thickness, bool freeze) {
+    const unsigned int* corner = bvh.triangle(face);
+    const int v[4] = {vertex, static_cast<int>(corner[0]), static_cast<int>(corner[1]), static_cast<int>(corner[2])};
+    if (particles.invMass[v[0]] + particles.invMass[v[1]] + particles.invMass[v[2]] + particles.invMass[v[3]] == 0.0f) {
+        return false;
+    }
+
+    glm::vec3 begin[4], motion[4];
+    for (int k = 0; k < 4; k++) {
+        begin[k] = start[v[k]];
+        motion[k] = particles.position(v[k]) - begin[k];
+    }
+
+    double c[4];
+    coplanarityCubic(begin[2] - begin[1], motion[2] - motion[1], begin[3] - begin[1], motion[3] - motion[1],
+                     begin[0] - begin[1], motion[0] - motion[1], c);
+    double roots[4];
+    const int rootCount = withEndOfStep(roots, cubicRootsInUnitInterval(c, roots));
+
+    for (int r = 0; r < rootCount; r++) {
+        const float t = static_cast<float>(roots[r]);
+        glm::vec3 at[4];
+        for (int k = 0; k < 4; k++) at[k] = begin[k] + motion[k] * t;
+
+        glm::vec3 weights;
+        glm::vec3 onFace = closestPointOnTriangle(at[0], at[1], at[2], at[3], weights);
+        if (glm::distance(at[0], onFace) > thickness) continue;
+
+        glm::vec3 normal = glm::cross(at[2] - at[1], at[3] - at[1]);
+        float length = glm::length(normal);
+        if (length == 0.0f) continue;
+        normal /= length;
+
+        glm::vec3 faceBegin = begin[1] * weights.x + begin[2] * weights.y + begin[3] * weights.z;
+        glm::vec3 faceMotion = motion[1] * weights.x + motion[2] * weights.y + motion[3] * weights.z;
+        normal = orientNormal(normal, begin[0] - faceBegin, motion[0] - faceMotion);
+
+        const int a[1] = {v[0]};
+        const float wA[1] = {1.0f};
+        const int b[3] = {v[1], v[2], v[3]};
+        const float wB[3] = {weights.x, weights.y, weights.z};
+        if (!separate(particles, a, wA, b, wB, normal, thickness, !freeze)) return false;
+        return !freeze || freezeParticles(particles, v);
+    }
+    return false;
+}
+
+bool ClothCCD::resolveEdgeEdge(ParticleState& particles, int edgeA, int edgeB, float thickness, bool freeze) {
+    const int v[4] = {edgeVertices[2 * edgeA], edgeVertices[2 * edgeA + 1],
+                      edgeVertices[2 * edgeB], edgeVertices[2 * edgeB + 1]};
+    if (particles.invMass[v[0]] + particles.invMass[v[1]] + particles.invMass[v[2]] + particles.invMass[v[3]] == 0.0f) {
+        return false;
+    }
+
+    glm::vec3 begin[4], motion[4];
+    for (int k = 0; k < 4; k++) {
+        begin[k] = start[v[k]];
+        motion[k] = particles.position(v[k]) - begin[k];
+    }
+
+    double c[4];
+    coplanarityCubic(begin[1] - begin[0], motion[1] - motion[0], begin[3] - begin[2], motion[3] - motion[2],
+                     begin[2] - begin[0], motion[2] - motion[0], c);
+    double roots[4];
+    const int rootCount = withEndOfStep(roots, cubicRootsInUnitInterval(c, roots));
+
+    for (int r = 0; r < rootCount; r++) {
+        const float t = static_cast<float>(roots[r]);
+        glm::vec3 at[4];
+        for (int k = 0; k < 4; k++) at[k] = begin[k] + motion[k] * t;
+
+        float s, u;
+        closestPointsOnSegments(at[0], at[1], at[2], at[3], s, u);
+        glm::vec3 onA = at[0] + (at[1] - at[0]) * s;
+        glm::vec3 onB = at[2] + (at[3] - at[2]) * u;
+        if (glm::distance(onA, onB) > thickness) continue;
+
+        glm::vec3 normal = glm::cross(at[1] - at[0], at[3] - at[2]);
+        float length = glm::length(normal);
+        // Parallel edges: the endpoints' vertex-face tests cover them.
+        if (length == 0.0f) continue;
+        normal /= length;
+
+        glm::vec3 beginA = begin[0] + (begin[1] - begin[0]) * s;
+        glm::vec3 beginB = begin[2] + (begin[3] - begin[2]) * u;
+        glm::vec3 motionA = motion[0] + (motion[1] - motion[0]) * s;
+        glm::vec3 motionB = motion[2] + (motion[3] - motion[2]) * u;
+        normal = orientNormal(normal, beginA - beginB, motionA - motionB);
+
+        const int a[2] = {v[0], v[1]};
+        const float wA[2] = {1.0f - s, s};
+        const int b[2] = {v[2], v[3]};
+        const float wB[2] = {1.0f - u, u};
+        if (!separate(particles, a, wA, b, wB, normal, thickness, !freeze)) return false;
+        return !freeze || freezeParticles(particles, v);
+    }
+    return false;
+}
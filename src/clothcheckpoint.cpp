@@ -0,0 +1,283 @@
+#include "clothcheckpoint.h"
+#include "clothsim.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<Spring>::value, "Springs are checkpointed as raw bytes");
+
+const char clothCheckpointMagic[8] = {'C', 'L', 'O', 'T', 'H', 'C', 'P', '\0'};
+
+namespace {
+
+uint64_t alignSection(uint64_t offset) {
+    const uint64_t a = ClothCheckpointHeader::sectionAlignment;
+    return (offset + a - 1) / a * a;
+}
+
+bool sectionFits(uint64_t offset, uint64_t bytes, uint64_t total) {
+    return offset <= total && bytes <= total - offset;
+}
+
+}
+
+std::vector<uint8_t> Cloth::saveCheckpoint() const {
+    const uint64_t count = particles.size();
+    const uint64_t colorCount = springColorOffsets.empty() ? 0 : springColorOffsets.size() - 1;
+
+    ClothCheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, clothCheckpointMagic, sizeof(header.magic));
+    header.version = ClothCheckpointHeader::currentVersion;
+    header.endianTag = clothCheckpointEndianTag;
+    header.headerSize = sizeof(ClothCheckpointHeader);
+    header.width = width;
+    header.height = height;
+    header.spacing = spacing;
+    header.stiffness = stiffness;
+    header.damping = damping;
+    header.solverMode = static_cast<int32_t>(solverMode);
+    header.xpbdIterations = xpbdIterations;
+    header.hierarchyLevels = hierarchyLevels;
+    header.coarseIterations = coarseIterations;
+    header.flags = (selfCollisionEnabled ? ClothCheckpointFlags::SelfCollision : 0) |
+                   (useSpatialHash ? ClothCheckpointFlags::SpatialHash : 0) |
+                   (sleepingEnabled ? ClothCheckpointFlags::Sleeping : 0) |
+                   (continuousCollisionEnabled ? ClothCheckpointFlags::ContinuousCollision : 0) |
+                   (gravityEnabled ? ClothCheckpointFlags::Gravity : 0) |
+                   (topology->isGrid() ? 0 : ClothCheckpointFlags::Mesh);
+    header.lastStepTime = lastStepTime;
+    header.accumulator = accumulator;
+    header.randomSeed = randomSeed;
+    header.windGusts = windGusts;
+    header.particleCount = count;
+    header.springCount = springs.size();
+    header.colorCount = colorCount;
+    header.triangleIndexCount = topology->isGrid() ? 0 : topology->triangles.size();
+
+    uint64_t offset = alignSection(sizeof(ClothCheckpointHeader));
+    for (int a = 0; a < ClothCheckpointHeader::particleArrays; a++) {
+        header.particleOffsets[a] = offset;
+        offset = alignSection(offset + count * sizeof(float));
+    }
+    header.springOffset = offset;
+    offset = alignSection(offset + springs.size() * sizeof(Spring));
+    header.colorOffset = offset;
+    offset = alignSection(offset + (colorCount + 1) * sizeof(uint64_t));
+    header.triangleOffset = offset;
+    offset += header.triangleIndexCount * sizeof(uint32_t);
+    header.totalSize = offset;
+
+    std::vector<uint8_t> buffer(offset, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    const AlignedVector<float>* arrays[ClothCheckpointHeader::particleArrays] = {
+        &particles.x, &particles.y, &particles.z,
+        &particles.prevX, &particles.prevY, &particles.prevZ,
+        &particles.forceX, &particles.forceY, &particles.forceZ,
+        &particles.mass, &particles.invMass};
+    for (int a = 0; a < ClothCheckpointHeader::particleArrays; a++) {
+        if (count) std::memcpy(buffer.data() + header.particleOffsets[a], arrays[a]->data(), count * sizeof(float));
+    }
+
+    // Sleeping particles carry a zeroed invMass; checkpoints store them awake.
+    float* invMass = reinterpret_cast<float*>(buffer.data() + header.particleOffsets[10]);
+    for (size_t i = 0; i < particleAsleep.size(); i++) {
+        if (particleAsleep[i]) invMass[i] = 1.0f / particles.mass[i];
+    }
+
+    if (!springs.empty()) {
+        std::memcpy(buffer.data() + header.springOffset, springs.data(), springs.size() * sizeof(Spring));
+    }
+    for (uint64_t c = 0; c <= colorCount; c++) {
+        uint64_t value = c < springColorOffsets.size() ? springColorOffsets[c] : springs.size();
+        std::memcpy(buffer.data() + header.colorOffset + c * sizeof(uint64_t), &value, sizeof(value));
+    }
+    if (header.triangleIndexCount) {
+        std::memcpy(buffer.data() + header.triangleOffset, topology->triangles.data(),
+                    header.triangleIndexCount * sizeof(uint32_t));
+    }
+
+    return buffer;
+}
+
+bool Cloth::loadCheckpoint(const void* data, size_t size) {
+    std::shared_ptr<const ClothTopology> previous = topology;
+    if (!restoreCheckpoint(data, size, true)) return false;
+
+    // A mesh arriving from a checkpoint has no rest pose to rebuild from, so
+    // reset() returns to the loaded state instead.
+    if (topology != previous && !topology->isGrid()) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        pristine.assign(bytes, bytes + size);
+    }
+    return true;
+}
+
+bool Cloth::restoreCheckpoint(const void* data, size_t size, bool restoreParameters) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (!bytes || size < sizeof(ClothCheckpointHeader)) return false;
+
+    ClothCheckpointHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (std::memcmp(header.magic, clothCheckpointMagic, sizeof(header.magic)) != 0 ||
+        header.version != ClothCheckpointHeader::currentVersion ||
+        header.endianTag != clothCheckpointEndianTag ||
+        header.headerSize != sizeof(ClothCheckpointHeader) ||
+        header.totalSize > size) {
+        return false;
+    }
+
+    const uint64_t count = header.particleCount;
+    if (header.width <= 0 || header.height <= 0 ||
+        count != static_cast<uint64_t>(header.width) * static_cast<uint64_t>(header.height)) {
+        return false;
+    }
+    if (!std::isfinite(header.spacing) || header.spacing <= 0.0f ||
+        header.solverMode < static_cast<int32_t>(SolverMode::ForceSprings) ||
+        header.solverMode > static_cast<int32_t>(SolverMode::Hierarchical) ||
+        header.xpbdIterations < 0 || header.coarseIterations < 0) {
+        return false;
+    }
+    for (int a = 0; a < ClothCheckpointHeader::particleArrays; a++) {
+        if (!sectionFits(header.particleOffsets[a], count * sizeof(float), header.totalSize)) return false;
+    }
+    if (!sectionFits(header.springOffset, header.springCount * sizeof(Spring), header.totalSize) ||
+        !sectionFits(header.colorOffset, (header.colorCount + 1) * sizeof(uint64_t), header.totalSize) ||
+        !sectionFits(header.triangleOffset, header.triangleIndexCount * sizeof(uint32_t), header.totalSize)) {
+        return false;
+    }
+
+    const bool mesh = (header.flags & ClothCheckpointFlags::Mesh) != 0;
+    if (mesh ? (header.height != 1 || header.triangleIndexCount % 3 != 0) : header.triangleIndexCount != 0) {
+        return false;
+    }
+    const uint32_t* triangles = reinterpret_cast<const uint32_t*>(bytes + header.triangleOffset);
+    for (uint64_t t = 0; t < header.triangleIndexCount; t++) {
+        uint32_t index;
+        std::memcpy(&index, triangles + t, sizeof(index));
+        if (index >= count) return false;
+    }
+
+    std::vector<size_t> colorOffsets(header.colorCount + 1);
+    for (uint64_t c = 0; c <= header.colorCount; c++) {
+        uint64_t value;
+        std::memcpy(&value, bytes + header.colorOffset + c * sizeof(uint64_t), sizeof(value));
+        if (value > header.springCount || (c > 0 && value < colorOffsets[c - 1])) return false;
+        colorOffsets[c] = static_cast<size_t>(value);
+    }
+    if (colorOffsets.front() != 0 || colorOffsets.back() != header.springCount) return false;
+
+    std::vector<Spring> loadedSprings(header.springCount, Spring(0, 0, 0.0f, 0.0f));
+    if (header.springCount) {
+        std::memcpy(loadedSprings.data(), bytes + header.springOffset, header.springCount * sizeof(Spring));
+    }
+    for (const Spring& s : loadedSprings) {
+        if (s.p1 < 0 || s.p2 < 0 || static_cast<uint64_t>(s.p1) >= count || static_cast<uint64_t>(s.p2) >= count) {
+            return false;
+        }
+    }
+
+    // The colored solvers run a color's springs in parallel, so no particle
+    // may appear twice within one color.
+    std::vector<uint64_t> colorStamp(count, 0);
+    for (uint64_t c = 0; c < header.colorCount; c++) {
+        for (size_t k = colorOffsets[c]; k < colorOffsets[c + 1]; k++) {
+            const Spring& s = loadedSprings[k];
+            if (colorStamp[s.p1] == c + 1) return false;
+            colorStamp[s.p1] = c + 1;
+            if (colorStamp[s.p2] == c + 1) return false;
+            colorStamp[s.p2] = c + 1;
+        }
+    }
+
+    // Validated; from here on the cloth is replaced.
+    particles.resize(count);
+    AlignedVector<float>* arrays[ClothCheckpointHeader::particleArrays] = {
+        &particles.x, &particles.y, &particles.z,
+        &particles.prevX, &particles.prevY, &particles.prevZ,
+        &particles.forceX, &particles.forceY, &particles.forceZ,
+        &particles.mass, &particles.invMass};
+    for (int a = 0; a < ClothCheckpointHeader::particleArrays; a++) {
+        if (count) std::memcpy(arrays[a]->data(), bytes + header.particleOffsets[a], count * sizeof(float));
+    }
+    springs.swap(loadedSprings);
+    springColorOffsets.swap(colorOffsets);
+
+    // Keep the current topology when the checkpoint was taken from it.
+    if (!mesh) {
+        if (!topology->isGrid() || topology->gridWidth != header.width || topology->gridHeight != header.height) {
+            topology = ClothTopology::grid(header.width, header.height);
+        }
+    } else if (topology->isGrid() || topology->triangles.size() != header.triangleIndexCount ||
+               std::memcmp(topology->triangles.data(), triangles, header.triangleIndexCount * sizeof(uint32_t)) != 0) {
+        auto loaded = std::make_shared<ClothTopology>();
+        loaded->triangles.resize(header.triangleIndexCount);
+        std::memcpy(loaded->triangles.data(), triangles, header.triangleIndexCount * sizeof(uint32_t));
+        topology = loaded;
+    }
+
+    lastStepTime = header.lastStepTime;
+    accumulator = header.accumulator;
+    // Not saved: a checkpoint resumes at the full substep.
+    substepScale = 1.0f;
+    windGusts = header.windGusts;
+    width = header.width;
+    height = header.height;
+    spacing = header.spacing;
+    if (restoreParameters) {
+        stiffness = header.stiffness;
+        damping = header.damping;
+        solverMode = static_cast<SolverMode>(header.solverMode);
+        xpbdIterations = header.xpbdIterations;
+        hierarchyLevels = header.hierarchyLevels;
+        coarseIterations = header.coarseIterations;
+        randomSeed = header.randomSeed;
+        selfCollisionEnabled = (header.flags & ClothCheckpointFlags::SelfCollision) != 0;
+        useSpatialHash = (header.flags & ClothCheckpointFlags::SpatialHash) != 0;
+        sleepingEnabled = (header.flags & ClothCheckpointFlags::Sleeping) != 0;
+        continuousCollisionEnabled = (header.flags & ClothCheckpointFlags::ContinuousCollision) != 0;
+        gravityEnabled = (header.flags & ClothCheckpointFlags::Gravity) != 0;
+    }
+
+    implicitSolver.clearPattern();
+    bvhStale = true;
+    grabbedParticle = -1;
+    detectGridStencil();
+    buildAdjacency();
+    updateRestBounds();
+    initSleeping();
+    computeStabilityBound();
+    return true;
+}
+
+bool Cloth::save(const std::string& path) const {
+    std::vector<uint8_t> buffer = saveCheckpoint();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Cloth: cannot write checkpoint " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return static_cast<bool>(file);
+}
+
+bool Cloth::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Cloth: cannot read checkpoint " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    if (!file || !loadCheckpoint(buffer.data(), buffer.size())) {
+        std::cerr << "Cloth: invalid checkpoint " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,303 @@
+#include "clothcollider.h"
+#include "clothgeometry.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+namespace {
+
+// Sign of the 2D cross product of (x1, y1) and (x2, y2), with ties broken
+// by a fixed symbolic perturbation so a point on a shared edge counts for
+// exactly one of the two triangles.
+int orientation(double x1, double y1, double x2, double y2, double& twiceArea) {
+    twiceArea = y1 * x2 - x1 * y2;
+    if (twiceArea > 0.0) return 1;
+    if (twiceArea < 0.0) return -1;
+    if (y2 > y1) return 1;
+    if (y2 < y1) return -1;
+    if (x1 > x2) return 1;
+    if (x1 < x2) return -1;
+    return 0;
+}
+
+// Whether (x0, y0) lies in the 2D triangle, and its barycentric weights.
+bool pointInTriangle2d(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3,
+                       double& a, double& b, double& c) {
+    x1 -= x0; x2 -= x0; x3 -= x0;
+    y1 -= y0; y2 -= y0; y3 -= y0;
+    int signA = orientation(x2, y2, x3, y3, a);
+    if (signA == 0) return false;
+    if (orientation(x3, y3, x1, y1, b) != signA) return false;
+    if (orientation(x1, y1, x2, y2, c) != signA) return false;
+
+    double sum = a + b + c;
+    a /= sum;
+    b /= sum;
+    c /= sum;
+    return true;
+}
+
+}
+
+bool SignedDistanceField::bake(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& triangles,
+                               float cell, int padding) {
+    values.clear();
+    samples = glm::ivec3(0);
+    if (vertices.empty() || triangles.size() < 3 || !(cell > 0.0f) || padding < 1) return false;
+
+    glm::vec3 lo = vertices[0];
+    glm::vec3 hi = vertices[0];
+    for (const glm::vec3& v : vertices) {
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+
+    glm::ivec3 size;
+    size_t total = 1;
+    for (int axis = 0; axis < 3; axis++) {
+        double cells = std::ceil((hi[axis] - lo[axis]) / cell) + 2.0 * padding + 1.0;
+        if (!(cells <= static_cast<double>(maxSamples))) return false;
+        size[axis] = static_cast<int>(cells);
+        total *= static_cast<size_t>(size[axis]);
+        if (total > maxSamples) {
+            std::cerr << "SignedDistanceField: grid exceeds " << maxSamples << " samples" << std::endl;
+            return false;
+        }
+    }
+
+    origin = lo - glm::vec3(padding * cell);
+    samples = size;
+    cellSize = cell;
+    const int nx = size.x, ny = size.y, nz = size.z;
+    auto index = [&](int i, int j, int k) { return (static_cast<size_t>(k) * ny + j) * nx + i; };
+    auto point = [&](int i, int j, int k) { return origin + glm::vec3(i, j, k) * cell; };
+
+    const float unknown = (nx + ny + nz) * cell;
+    values.assign(total, unknown);
+    // The surface point each distance was measured to; none yet where
+    // values[n] is still `unknown`.
+    std::vector<glm::vec3> closest(total);
+    // Odd where an odd number of surface crossings lie between this sample
+    // and the previous one along x.
+    std::vector<uint8_t> crossings(total, 0);
+
+    const int triangleCount = static_cast<int>(triangles.size() / 3);
+    for (int t = 0; t < triangleCount; t++) {
+        glm::vec3 g[3];
+        for (int k = 0; k < 3; k++) g[k] = (vertices[triangles[3 * t + k]] - origin) / cell;
+        glm::vec3 gMin = glm::min(g[0], glm::min(g[1], g[2]));
+        glm::vec3 gMax = glm::max(g[0], glm::max(g[1], g[2]));
+
+        const glm::vec3& a = vertices[triangles[3 * t]];
+        const glm::vec3& b = vertices[triangles[3 * t + 1]];
+        const glm::vec3& c = vertices[triangles[3 * t + 2]];
+
+        // Exact distances within one cell of the triangle.
+        int i0 = std::max(static_cast<int>(gMin.x) - 1, 0), i1 = std::min(static_cast<int>(gMax.x) + 2, nx - 1);
+        int j0 = std::max(static_cast<int>(gMin.y) - 1, 0), j1 = std::min(static_cast<int>(gMax.y) + 2, ny - 1);
+        int k0 = std::max(static_cast<int>(gMin.z) - 1, 0), k1 = std::min(static_cast<int>(gMax.z) + 2, nz - 1);
+        for (int k = k0; k <= k1; k++) {
+            for (int j = j0; j <= j1; j++) {
+                for (int i = i0; i <= i1; i++) {
+                    glm::vec3 p = point(i, j, k);
+                    glm::vec3 weights;
+                    glm::vec3 onSurface = closestPointOnTriangle(p, a, b, c, weights);
+                    float d = glm::distance(p, onSurface);
+                    size_t n = index(i, j, k);
+                    if (d < values[n]) {
+                        values[n] = d;
+                        closest[n] = onSurface;
+                    }
+                }
+            }
+        }
+
+        // Where the sample row (j, k) pierces the triangle, flip the parity
+        // of the first sample past the crossing.
+        j0 = std::max(static_cast<int>(std::ceil(gMin.y)), 0);
+        j1 = std::min(static_cast<int>(std::floor(gMax.y)), ny - 1);
+        k0 = std::max(static_cast<int>(std::ceil(gMin.z)), 0);
+        k1 = std::min(static_cast<int>(std::floor(gMax.z)), nz - 1);
+        for (int k = k0; k <= k1; k++) {
+            for (int j = j0; j <= j1; j++) {
+                double wa, wb, wc;
+                if (!pointInTriangle2d(j, k, g[0].y, g[0].z, g[1].y, g[1].z, g[2].y, g[2].z, wa, wb, wc)) continue;
+                double x = wa * g[0].x + wb * g[1].x + wc * g[2].x;
+                int i = static_cast<int>(std::ceil(x));
+                if (i < 0) {
+                    crossings[index(0, j, k)] ^= 1;
+                } else if (i < nx) {
+                    crossings[index(i, j, k)] ^= 1;
+                }
+            }
+        }
+    }
+
+    // Propagate outward from the band: each sample measures its distance to
+    // the surface points of its already visited neighbours, sweeping the grid
+    // once in each of the eight diagonal directions. Away from the surface
+    // this is a close upper bound rather than the exact distance, at the
+    // cost of a subtraction instead of a triangle query.
+    for (int direction = 0; direction < 8; direction++) {
+        const int di = direction & 1 ? -1 : 1;
+        const int dj = direction & 2 ? -1 : 1;
+        const int dk = direction & 4 ? -1 : 1;
+        const int iBegin = di > 0 ? 1 : nx - 2, iEnd = di > 0 ? nx : -1;
+        const int jBegin = dj > 0 ? 1 : ny - 2, jEnd = dj > 0 ? ny : -1;
+        const int kBegin = dk > 0 ? 1 : nz - 2, kEnd = dk > 0 ? nz : -1;
+
+        for (int k = kBegin; k != kEnd; k += dk) {
+            for (int j = jBegin; j != jEnd; j += dj) {
+                for (int i = iBegin; i != iEnd; i += di) {
+                    const size_t n = index(i, j, k);
+                    // Within a cell of the surface the band is exact.
+                    if (values[n] <= cell) continue;
+                    const size_t neighbours[7] = {
+                        index(i - di, j, k), index(i, j - dj, k), index(i - di, j - dj, k),
+                        index(i, j, k - dk), index(i - di, j, k - dk), index(i, j - dj, k - dk),
+                        index(i - di, j - dj, k - dk)
+                    };
+                    const glm::vec3 p = point(i, j, k);
+                    for (size_t m : neighbours) {
+                        if (values[m] == unknown) continue;
+                        float d = glm::distance(p, closest[m]);
+                        if (d < values[n]) {
+                            values[n] = d;
+                            closest[n] = closest[m];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            uint8_t inside = 0;
+            for (int i = 0; i < nx; i++) {
+                size_t n = index(i, j, k);
+                inside ^= crossings[n];
+                if (inside) values[n] = -values[n];
+            }
+        }
+    }
+    return true;
+}
+
+float SignedDistanceField::sample(const glm::vec3& point, glm::vec3& normal) const {
+    glm::vec3 g = (point - origin) / cellSize;
+    if (!(g.x >= 0.0f && g.y >= 0.0f && g.z >= 0.0f &&
+          g.x < samples.x - 1 && g.y < samples.y - 1 && g.z < samples.z - 1)) {
+        return FLT_MAX;
+    }
+
+    const int i = static_cast<int>(g.x);
+    const int j = static_cast<int>(g.y);
+    const int k = static_cast<int>(g.z);
+    const float fx = g.x - i;
+    const float fy = g.y - j;
+    const float fz = g.z - k;
+
+    const float v000 = value(i, j, k), v100 = value(i + 1, j, k);
+    const float v010 = value(i, j + 1, k), v110 = value(i + 1, j + 1, k);
+    const float v001 = value(i, j, k + 1), v101 = value(i + 1, j, k + 1);
+    const float v011 = value(i, j + 1, k + 1), v111 = value(i + 1, j + 1, k + 1);
+
+    // Interpolate along x, then y, then z; the gradient falls out of the
+    // same differences.
+    const float x00 = v000 + (v100 - v000) * fx;
+    const float x10 = v010 + (v110 - v010) * fx;
+    const float x01 = v001 + (v101 - v001) * fx;
+    const float x11 = v011 + (v111 - v011) * fx;
+    const float y0 = x00 + (x10 - x00) * fy;
+    const float y1 = x01 + (x11 - x01) * fy;
+
+    const float dx0 = (v100 - v000) + ((v110 - v010) - (v100 - v000)) * fy;
+    const float dx1 = (v101 - v001) + ((v111 - v011) - (v101 - v001)) * fy;
+    glm::vec3 gradient(dx0 + (dx1 - dx0) * fz,
+                       (x10 - x00) + ((x11 - x01) - (x10 - x00)) * fz,
+                       y1 - y0);
+    float length = glm::length(gradient);
+    normal = length > 0.0f ? gradient / length : glm::vec3(0.0f);
+
+    return y0 + (y1 - y0) * fz;
+}
+
+ClothCollider ClothCollider::sphere(const glm::vec3& center, float radius) {
+    ClothCollider collider;
+    collider.shape = Sphere;
+    collider.position = center;
+    collider.radius = radius;
+    return collider;
+}
+
+ClothCollider ClothCollider::box(const glm::vec3& center, const glm::vec3& halfExtents) {
+    ClothCollider collider;
+    collider.shape = Box;
+    collider.position = center;
+    collider.halfExtents = halfExtents;
+    return collider;
+}
+
+ClothCollider ClothCollider::capsule(const glm::vec3& center, float halfHeight, float radius) {
+    ClothCollider collider;
+    collider.shape = Capsule;
+    collider.position = center;
+    collider.halfHeight = halfHeight;
+    collider.radius = radius;
+    return collider;
+}
+
+ClothCollider ClothCollider::mesh(std::shared_ptr<const SignedDistanceField> field) {
+    ClothCollider collider;
+    collider.shape = Mesh;
+    collider.field = std::move(field);
+    return collider;
+}
+
+float ClothCollider::distance(const glm::vec3& point, glm::vec3& normal) const {
+    const glm::vec3 local = glm::transpose(orientation) * (point - position);
+    glm::vec3 localNormal(0.0f, 1.0f, 0.0f);
+    float result = FLT_MAX;
+
+    switch (shape) {
+        case Sphere:
+        case Capsule: {
+            glm::vec3 axisPoint(0.0f);
+            if (shape == Capsule) axisPoint.y = glm::clamp(local.y, -halfHeight, halfHeight);
+            glm::vec3 offset = local - axisPoint;
+            float length = glm::length(offset);
+            if (length > 0.0f) localNormal = offset / length;
+            result = length - radius;
+            break;
+        }
+        case Box: {
+            glm::vec3 q = glm::abs(local) - halfExtents;
+            glm::vec3 outside = glm::max(q, glm::vec3(0.0f));
+            float outsideLength = glm::length(outside);
+            if (outsideLength > 0.0f) {
+                localNormal = outside / outsideLength;
+                result = outsideLength;
+            } else {
+                // Inside: leave through the nearest face.
+                int axis = q.x >= q.y && q.x >= q.z ? 0 : (q.y >= q.z ? 1 : 2);
+                localNormal = glm::vec3(0.0f);
+                localNormal[axis] = 1.0f;
+                result = q[axis];
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                if (local[axis] < 0.0f) localNormal[axis] = -localNormal[axis];
+            }
+            break;
+        }
+        case Mesh:
+            if (!field) return FLT_MAX;
+            result = field->sample(local, localNormal);
+            break;
+    }
+
+    normal = orientation * localNormal;
+    return result;
+}
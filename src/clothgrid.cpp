@@ -3,6 +3,61 @@
 Particle::Particle(const glm::vec3& pos, const glm::vec3& prevPos, float m)
         : position(pos), previousPosition(prevPos), mass(m), force(glm::vec3(0.0f, 0.0f, 0.0f)) {}
 
+void ParticleState::clear() {
+    resize(0);
+}
+
+void ParticleState::reserve(size_t n) {
+    for (AlignedVector<float>* field : {&x, &y, &z, &prevX, &prevY, &prevZ, &forceX, &forceY, &forceZ, &mass, &invMass}) {
+        field->reserve(n);
+    }
+}
+
+void ParticleState::resize(size_t n) {
+    for (AlignedVector<float>* field : {&x, &y, &z, &prevX, &prevY, &prevZ, &forceX, &forceY, &forceZ}) {
+        field->resize(n, 0.0f);
+    }
+    mass.resize(n, 1.0f);
+    invMass.resize(n, 1.0f);
+}
+
+void ParticleState::push_back(const Particle& p) {
+    resize(size() + 1);
+    set(size() - 1, p);
+}
+
+void ParticleState::setMass(size_t i, float m) {
+    mass[i] = m;
+    invMass[i] = m > 0.0f ? 1.0f / m : 0.0f;
+}
+
+Particle ParticleState::get(size_t i) const {
+    Particle p(position(i), previousPosition(i), mass[i]);
+    p.force = force(i);
+    return p;
+}
+
+void ParticleState::set(size_t i, const Particle& p) {
+    setPosition(i, p.position);
+    setPreviousPosition(i, p.previousPosition);
+    setForce(i, p.force);
+    setMass(i, p.mass);
+}
+
+void ParticleState::load(const std::vector<Particle>& particles) {
+    resize(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        set(i, particles[i]);
+    }
+}
+
+void ParticleState::store(std::vector<Particle>& particles) const {
+    particles.resize(size());
+    for (size_t i = 0; i < size(); i++) {
+        particles[i] = get(i);
+    }
+}
+
 ParticleGrid::ParticleGrid(int w, int h, float space)
         : width(w), height(h), spacing(space), stiffness(0.5f) {}
 
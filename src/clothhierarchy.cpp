@@ -0,0 +1,155 @@
+#include "clothhierarchy.h"
+#include <algorithm>
+
+bool ClothHierarchy::matches(int width, int height, float spacing, int maxLevels) const {
+    return !levels.empty() && levels[0].width == width && levels[0].height == height && builtSpacing == spacing &&
+           builtMaxLevels == maxLevels;
+}
+
+void ClothHierarchy::build(int width, int height, float spacing, int maxLevels, int minSize) {
+    levels.clear();
+    builtSpacing = spacing;
+    builtMaxLevels = maxLevels;
+
+    Level fine;
+    fine.width = width;
+    fine.height = height;
+    fine.nodes.resize(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < fine.nodes.size(); i++) fine.nodes[i] = static_cast<int>(i);
+    levels.push_back(std::move(fine));
+
+    while (levelCount() < maxLevels) {
+        const Level& finer = levels.back();
+        int coarseWidth = (finer.width + 1) / 2;
+        int coarseHeight = (finer.height + 1) / 2;
+        if (coarseWidth < minSize || coarseHeight < minSize) break;
+
+        Level coarse;
+        coarse.width = coarseWidth;
+        coarse.height = coarseHeight;
+        coarse.stride = finer.stride * 2;
+        coarse.nodes.resize(static_cast<size_t>(coarseWidth) * coarseHeight);
+        for (int y = 0; y < coarseHeight; y++) {
+            for (int x = 0; x < coarseWidth; x++) {
+                coarse.nodes[y * coarseWidth + x] = finer.nodes[(2 * y) * finer.width + 2 * x];
+            }
+        }
+
+        // Structural and shear constraints, colored by direction and row or
+        // column parity like the fine stencil.
+        const float length = spacing * coarse.stride;
+        std::vector<Spring> byColor[8];
+        for (int y = 0; y < coarseHeight; y++) {
+            for (int x = 0; x < coarseWidth; x++) {
+                int node = coarse.nodes[y * coarseWidth + x];
+                if (x < coarseWidth - 1)
+                    byColor[0 + (x & 1)].push_back(Spring(node, coarse.nodes[y * coarseWidth + x + 1], length, 0.0f));
+                if (y < coarseHeight - 1)
+                    byColor[2 + (y & 1)].push_back(Spring(node, coarse.nodes[(y + 1) * coarseWidth + x], length, 0.0f));
+                if (x < coarseWidth - 1 && y < coarseHeight - 1)
+                    byColor[4 + (y & 1)].push_back(Spring(node, coarse.nodes[(y + 1) * coarseWidth + x + 1], length * 1.41f, 0.0f));
+                if (x > 0 && y < coarseHeight - 1)
+                    byColor[6 + (y & 1)].push_back(Spring(node, coarse.nodes[(y + 1) * coarseWidth + x - 1], length * 1.41f, 0.0f));
+            }
+        }
+
+        coarse.colorOffsets.push_back(0);
+        for (const std::vector<Spring>& color : byColor) {
+            coarse.constraints.insert(coarse.constraints.end(), color.begin(), color.end());
+            coarse.colorOffsets.push_back(coarse.constraints.size());
+        }
+        coarse.lambda.assign(coarse.constraints.size(), 0.0f);
+
+        levels.push_back(std::move(coarse));
+    }
+}
+
+void ClothHierarchy::relax(ParticleState& particles, float compliance, float timeStep, int iterations, ThreadPool* pool) {
+    if (levelCount() < 2) return;
+
+    start.resize(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        start[i] = particles.position(i);
+    }
+
+    const size_t constraintChunk = 2048;
+    for (int l = levelCount() - 1; l >= 1; l--) {
+        Level& coarse = levels[l];
+        const float alphaTilde = compliance * coarse.stride / (timeStep * timeStep);
+        std::fill(coarse.lambda.begin(), coarse.lambda.end(), 0.0f);
+
+        for (int i = 0; i < iterations; i++) {
+            for (size_t c = 0; c + 1 < coarse.colorOffsets.size(); c++) {
+                const size_t first = coarse.colorOffsets[c];
+                const size_t count = coarse.colorOffsets[c + 1] - first;
+                if (pool) {
+                    pool->parallelFor(count, constraintChunk, [&](size_t begin, size_t end) {
+                        project(particles, coarse, first + begin, first + end, alphaTilde);
+                    });
+                } else {
+                    project(particles, coarse, first, first + count, alphaTilde);
+                }
+            }
+        }
+
+        const Level& fine = levels[l - 1];
+        const size_t rowGrain = std::max<size_t>(1, 4096 / fine.width);
+        if (pool) {
+            pool->parallelFor(fine.height, rowGrain, [&](size_t begin, size_t end) {
+                prolongate(particles, fine, static_cast<int>(begin), static_cast<int>(end));
+            });
+        } else {
+            prolongate(particles, fine, 0, fine.height);
+        }
+    }
+}
+
+void ClothHierarchy::project(ParticleState& particles, Level& level, size_t first, size_t last, float alphaTilde) {
+    for (size_t k = first; k < last; k++) {
+        const Spring& s = level.constraints[k];
+        const float w1 = particles.invMass[s.p1];
+        const float w2 = particles.invMass[s.p2];
+        if (w1 + w2 == 0.0f) continue;
+
+        glm::vec3 position1 = particles.position(s.p1);
+        glm::vec3 position2 = particles.position(s.p2);
+        glm::vec3 delta = position1 - position2;
+        float length = glm::length(delta);
+        if (length < 1e-6f) continue;
+
+        glm::vec3 normal = delta / length;
+        float deltaLambda = (s.restLength - length - alphaTilde * level.lambda[k]) / (w1 + w2 + alphaTilde);
+        level.lambda[k] += deltaLambda;
+
+        particles.setPosition(s.p1, position1 + normal * (w1 * deltaLambda));
+        particles.setPosition(s.p2, position2 - normal * (w2 * deltaLambda));
+    }
+}
+
+void ClothHierarchy::prolongate(ParticleState& particles, const Level& fine, int firstRow, int lastRow) {
+    for (int y = firstRow; y < lastRow; y++) {
+        // Even rows and columns are coarse nodes and already hold their
+        // correction; the rest average their coarse neighbours.
+        int y0 = y & ~1;
+        int y1 = (y & 1) && y + 1 < fine.height ? y + 1 : y0;
+
+        for (int x = 0; x < fine.width; x++) {
+            if (!(x & 1) && !(y & 1)) continue;
+
+            int node = fine.nodes[y * fine.width + x];
+            if (particles.invMass[node] == 0.0f) continue;
+
+            int x0 = x & ~1;
+            int x1 = (x & 1) && x + 1 < fine.width ? x + 1 : x0;
+
+            const int corners[4] = {fine.nodes[y0 * fine.width + x0], fine.nodes[y0 * fine.width + x1],
+                                    fine.nodes[y1 * fine.width + x0], fine.nodes[y1 * fine.width + x1]};
+            glm::vec3 correction(0.0f);
+            for (int corner : corners) {
+                correction += particles.position(corner) - start[corner];
+            }
+
+            particles.setPosition(node, start[node] + correction * 0.25f);
+        }
+    }
+}
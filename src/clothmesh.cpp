@@ -0,0 +1,300 @@
+#include "clothmesh.h"
+#include "clothprofiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Rows per parallelFor chunk, sized so each chunk touches ~8k vertices.
+size_t rowGrain(int width) {
+    return std::max<size_t>(1, 8192 / std::max(width, 1));
+}
+
+const size_t meshGrain = 8192;
+
+}
+
+bool ClothMesh::setTopology(int w, int h) {
+    if (!meshTopology && w == width && h == height && !indices.empty()) return false;
+
+    meshTopology.reset();
+    width = w;
+    height = h;
+
+    indices.clear();
+    ClothTopology::appendGridTriangles(width, height, indices);
+
+    vertices.assign(static_cast<size_t>(width) * height * floatsPerVertex, 0.0f);
+
+    faceStride = width + 1;
+    size_t faceCount = static_cast<size_t>(faceStride) * (height + 1);
+    for (AlignedVector<float>* face : {&faceAX, &faceAY, &faceAZ, &faceBX, &faceBY, &faceBZ}) {
+        face->assign(faceCount, 0.0f);
+    }
+
+    indicesDirty = true;
+    return true;
+}
+
+bool ClothMesh::setTopology(const ClothSnapshot& snapshot) {
+    if (!snapshot.topology || snapshot.topology->isGrid()) {
+        return setTopology(snapshot.width, snapshot.height);
+    }
+    if (snapshot.topology == meshTopology && !indices.empty()) return false;
+
+    meshTopology = snapshot.topology;
+    width = snapshot.width;
+    height = snapshot.height;
+    indices = meshTopology->triangles;
+
+    const size_t vertexCount = static_cast<size_t>(width) * height;
+    const size_t triangleCount = indices.size() / 3;
+    vertices.assign(vertexCount * floatsPerVertex, 0.0f);
+    for (AlignedVector<float>* face : {&faceAX, &faceAY, &faceAZ}) {
+        face->assign(triangleCount, 0.0f);
+    }
+    faceBX.clear();
+    faceBY.clear();
+    faceBZ.clear();
+
+    vertexFaceStart.assign(vertexCount + 1, 0);
+    for (unsigned int v : indices) vertexFaceStart[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) vertexFaceStart[v + 1] += vertexFaceStart[v];
+    vertexFaces.resize(indices.size());
+    std::vector<int> fill(vertexFaceStart.begin(), vertexFaceStart.end() - 1);
+    for (size_t k = 0; k < indices.size(); k++) {
+        vertexFaces[fill[indices[k]]++] = static_cast<int>(k / 3);
+    }
+
+    // One-ring from triangle edges; every edge is seen from both ends.
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(indices.size() * 2);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            int a = indices[t * 3 + k];
+            int b = indices[t * 3 + (k + 1) % 3];
+            edges.push_back({a, b});
+            edges.push_back({b, a});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    ringStart.assign(vertexCount + 1, 0);
+    ring.resize(edges.size());
+    for (size_t e = 0; e < edges.size(); e++) {
+        ringStart[edges[e].first + 1]++;
+        ring[e] = edges[e].second;
+    }
+    for (size_t v = 0; v < vertexCount; v++) ringStart[v + 1] += ringStart[v];
+
+    indicesDirty = true;
+    return true;
+}
+
+void ClothMesh::update(const ClothSnapshot& snapshot, ThreadPool* pool) {
+    setTopology(snapshot);
+    writeVertices(snapshot, vertices.data(), pool);
+}
+
+void ClothMesh::upload(GLUploadTable& gl, const ClothSnapshot& snapshot, ThreadPool* pool) {
+    ProfileScope scope(ProfilePhase::Upload);
+    setTopology(snapshot);
+
+    if (indicesDirty) {
+        gl.bufferData(GLUploadEnum::ElementArrayBuffer, indices.size() * sizeof(unsigned int), indices.data(),
+                      GLUploadEnum::StaticDraw);
+        indicesDirty = false;
+    }
+
+    // Orphan the previous storage so the driver never stalls on a buffer the
+    // GPU is still reading, then fill the fresh storage in place.
+    const std::ptrdiff_t vertexBytes = vertices.size() * sizeof(float);
+    gl.bufferData(GLUploadEnum::ArrayBuffer, vertexBytes, nullptr, GLUploadEnum::StreamDraw);
+
+    void* mapped = gl.mapBufferRange(GLUploadEnum::ArrayBuffer, 0, vertexBytes,
+                                     GLUploadEnum::MapWriteBit | GLUploadEnum::MapInvalidateBufferBit);
+    if (mapped) {
+        writeVertices(snapshot, static_cast<float*>(mapped), pool);
+        // A failed unmap means the storage was lost; the next frame rewrites
+        // every vertex anyway.
+        gl.unmapBuffer(GLUploadEnum::ArrayBuffer);
+        return;
+    }
+
+    writeVertices(snapshot, vertices.data(), pool);
+    gl.bufferSubData(GLUploadEnum::ArrayBuffer, 0, vertexBytes, vertices.data());
+}
+
+void ClothMesh::writeVertices(const ClothSnapshot& snapshot, float* destination, ThreadPool* pool) {
+    if (width < 1 || height < 1) return;
+    ProfileScope scope(ProfilePhase::Normals);
+
+    if (meshTopology) {
+        const size_t triangleCount = indices.size() / 3;
+        const size_t vertexCount = static_cast<size_t>(width) * height;
+        if (pool && pool->size() > 1) {
+            pool->parallelFor(triangleCount, meshGrain, [&](size_t first, size_t last) {
+                computeMeshFaces(snapshot, first, last);
+            });
+            pool->parallelFor(vertexCount, meshGrain, [&](size_t first, size_t last) {
+                writeMeshVertices(snapshot, destination, first, last);
+            });
+        } else {
+            computeMeshFaces(snapshot, 0, triangleCount);
+            writeMeshVertices(snapshot, destination, 0, vertexCount);
+        }
+        return;
+    }
+
+    const int quadRows = height - 1;
+    if (pool && pool->size() > 1) {
+        pool->parallelFor(quadRows, rowGrain(width), [&](size_t first, size_t last) {
+            computeFaceRows(snapshot, static_cast<int>(first), static_cast<int>(last));
+        });
+        pool->parallelFor(height, rowGrain(width), [&](size_t first, size_t last) {
+            writeVertexRows(snapshot, destination, static_cast<int>(first), static_cast<int>(last));
+        });
+    } else {
+        computeFaceRows(snapshot, 0, quadRows);
+        writeVertexRows(snapshot, destination, 0, height);
+    }
+}
+
+void ClothMesh::computeFaceRows(const ClothSnapshot& snapshot, int firstRow, int lastRow) {
+    for (int y = firstRow; y < lastRow; y++) {
+        size_t row = static_cast<size_t>(y) * width;
+        size_t face = static_cast<size_t>(y + 1) * faceStride + 1;
+
+        FaceNormalRow out = {faceAX.data() + face, faceAY.data() + face, faceAZ.data() + face,
+                             faceBX.data() + face, faceBY.data() + face, faceBZ.data() + face};
+        faceNormals(simdLevel, snapshot.x.data() + row, snapshot.y.data() + row, snapshot.z.data() + row,
+                    width, 0, width - 1, out);
+    }
+}
+
+void ClothMesh::writeVertexRows(const ClothSnapshot& snapshot, float* destination, int firstRow, int lastRow) const {
+    const float* ax = faceAX.data();
+    const float* ay = faceAY.data();
+    const float* az = faceAZ.data();
+    const float* bx = faceBX.data();
+    const float* by = faceBY.data();
+    const float* bz = faceBZ.data();
+
+    for (int y = firstRow; y < lastRow; y++) {
+        // Vertex (x, y) touches both triangles of quads (x, y) and
+        // (x - 1, y - 1), triangle B of (x - 1, y) and triangle A of (x, y - 1).
+        size_t below = static_cast<size_t>(y + 1) * faceStride;
+        size_t above = static_cast<size_t>(y) * faceStride;
+
+        for (int x = 0; x < width; x++) {
+            size_t index = static_cast<size_t>(y) * width + x;
+            size_t q = below + x + 1;
+            size_t left = below + x;
+            size_t up = above + x + 1;
+            size_t diagonal = above + x;
+
+            float nx = (ax[q] + bx[q]) + bx[left] + ax[up] + (ax[diagonal] + bx[diagonal]);
+            float ny = (ay[q] + by[q]) + by[left] + ay[up] + (ay[diagonal] + by[diagonal]);
+            float nz = (az[q] + bz[q]) + bz[left] + az[up] + (az[diagonal] + bz[diagonal]);
+
+            float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+            if (length > 0.0f) {
+                nx /= length;
+                ny /= length;
+                nz /= length;
+            } else {
+                nx = 0.0f;
+                ny = 1.0f;
+                nz = 0.0f;
+            }
+
+            float* vertex = destination + index * floatsPerVertex;
+            vertex[0] = snapshot.x[index];
+            vertex[1] = snapshot.y[index];
+            vertex[2] = snapshot.z[index];
+            vertex[3] = nx;
+            vertex[4] = ny;
+            vertex[5] = nz;
+            vertex[6] = curvatureAt(snapshot, x, y);
+        }
+    }
+}
+
+float ClothMesh::curvatureAt(const ClothSnapshot& snapshot, int x, int y) const {
+    if (x < 2 || x >= width - 2 || y < 2 || y >= height - 2) {
+        return 0.0f;
+    }
+
+    const size_t center = static_cast<size_t>(y) * width + x;
+    const size_t row = width;
+    const float* axes[3] = {snapshot.x.data(), snapshot.y.data(), snapshot.z.data()};
+
+    float curvatureX = 0.0f;
+    float curvatureY = 0.0f;
+    for (const float* p : axes) {
+        float c = p[center];
+        float dx = (p[center - 2] - 2.0f * p[center - 1] + c) + (c - 2.0f * p[center + 1] + p[center + 2]);
+        float dy = (p[center - 2 * row] - 2.0f * p[center - row] + c) + (c - 2.0f * p[center + row] + p[center + 2 * row]);
+        curvatureX += dx * dx;
+        curvatureY += dy * dy;
+    }
+
+    return (std::sqrt(curvatureX) + std::sqrt(curvatureY)) * 0.5f;
+}
+
+void ClothMesh::computeMeshFaces(const ClothSnapshot& snapshot, size_t first, size_t last) {
+    for (size_t t = first; t < last; t++) {
+        glm::vec3 p0 = snapshot.position(indices[t * 3]);
+        glm::vec3 p1 = snapshot.position(indices[t * 3 + 1]);
+        glm::vec3 p2 = snapshot.position(indices[t * 3 + 2]);
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        faceAX[t] = n.x;
+        faceAY[t] = n.y;
+        faceAZ[t] = n.z;
+    }
+}
+
+void ClothMesh::writeMeshVertices(const ClothSnapshot& snapshot, float* destination, size_t first, size_t last) const {
+    for (size_t v = first; v < last; v++) {
+        float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+        for (int k = vertexFaceStart[v]; k < vertexFaceStart[v + 1]; k++) {
+            int t = vertexFaces[k];
+            nx += faceAX[t];
+            ny += faceAY[t];
+            nz += faceAZ[t];
+        }
+
+        float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+        if (length > 0.0f) {
+            nx /= length;
+            ny /= length;
+            nz /= length;
+        } else {
+            nx = 0.0f;
+            ny = 1.0f;
+            nz = 0.0f;
+        }
+
+        // Umbrella Laplacian over the one-ring, scaled to roughly match the
+        // grid's second-difference curvature.
+        glm::vec3 position = snapshot.position(v);
+        float curvature = 0.0f;
+        int ringSize = ringStart[v + 1] - ringStart[v];
+        if (ringSize > 0) {
+            glm::vec3 mean(0.0f);
+            for (int k = ringStart[v]; k < ringStart[v + 1]; k++) {
+                mean += snapshot.position(ring[k]);
+            }
+            curvature = 4.0f * glm::length(mean / static_cast<float>(ringSize) - position);
+        }
+
+        float* vertex = destination + v * floatsPerVertex;
+        vertex[0] = position.x;
+        vertex[1] = position.y;
+        vertex[2] = position.z;
+        vertex[3] = nx;
+        vertex[4] = ny;
+        vertex[5] = nz;
+        vertex[6] = curvature;
+    }
+}
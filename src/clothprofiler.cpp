@@ -0,0 +1,272 @@
+#include "clothprofiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+const char* const phaseNames[] = {
+    "gravity", "wind", "springs", "collision", "integrate", "normals", "upload", "draw", "step", "render", "tick"
+};
+static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == static_cast<size_t>(ProfilePhase::Count),
+              "a ProfilePhase has no name");
+
+// Rings are never freed: a reader may still be copying one when its thread
+// exits, or the trace may be written after static destruction has begun. An
+// exited thread's ring is handed to the next new thread instead.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ProfileRing>>& registry() {
+    static std::vector<std::unique_ptr<ProfileRing>>* rings = new std::vector<std::unique_ptr<ProfileRing>>();
+    return *rings;
+}
+
+// Profiles the whole process when CLOTH_TRACE names a file, and writes the
+// trace there when static objects are destroyed at exit.
+struct TraceOnExit {
+    std::string path;
+    TraceOnExit() {
+        const char* value = std::getenv(ClothProfiler::traceEnvironmentVariable);
+        if (value && *value) {
+            path = value;
+            ClothProfiler::setEnabled(true);
+        }
+    }
+    ~TraceOnExit() {
+        if (!path.empty()) ClothProfiler::writeChromeTrace(path);
+    }
+};
+
+// Escapes a thread name for a JSON string.
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+}
+
+const char* ClothProfiler::traceEnvironmentVariable = "CLOTH_TRACE";
+
+std::atomic<bool> ClothProfiler::active{false};
+std::atomic<uint64_t> ClothProfiler::clearedAt{0};
+
+namespace {
+TraceOnExit traceOnExit;
+}
+
+const char* profilePhaseName(ProfilePhase phase) {
+    size_t index = static_cast<size_t>(phase);
+    return index < static_cast<size_t>(ProfilePhase::Count) ? phaseNames[index] : "unknown";
+}
+
+void ProfileRing::push(const ProfileSample& sample) {
+    const uint64_t index = head.load(std::memory_order_relaxed);
+    writing.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Slot& slot = entries[index % capacity];
+    slot.start.store(sample.start, std::memory_order_relaxed);
+    slot.duration.store(sample.duration, std::memory_order_relaxed);
+    slot.tag.store((static_cast<uint64_t>(sample.thread) << 8) | static_cast<uint64_t>(sample.phase),
+                   std::memory_order_relaxed);
+
+    head.store(index + 1, std::memory_order_release);
+}
+
+void ProfileRing::copy(std::vector<ProfileSample>& out) const {
+    const uint64_t last = head.load(std::memory_order_acquire);
+    uint64_t first = last > capacity ? last - capacity : 0;
+    const size_t base = out.size();
+
+    for (uint64_t index = first; index < last; index++) {
+        const Slot& slot = entries[index % capacity];
+        ProfileSample sample;
+        sample.start = slot.start.load(std::memory_order_relaxed);
+        sample.duration = slot.duration.load(std::memory_order_relaxed);
+        uint64_t tag = slot.tag.load(std::memory_order_relaxed);
+        sample.thread = static_cast<uint32_t>(tag >> 8);
+        sample.phase = static_cast<ProfilePhase>(tag & 0xff);
+        out.push_back(sample);
+    }
+
+    // Slot i is rewritten by push number i + capacity, which first moves
+    // `writing` past i + capacity.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t written = writing.load(std::memory_order_relaxed);
+    if (written > first + capacity) {
+        const uint64_t stale = std::min(written - capacity - first, last - first);
+        out.erase(out.begin() + base, out.begin() + base + static_cast<size_t>(stale));
+    }
+}
+
+uint64_t ClothProfiler::now() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch);
+    // Zero marks a ProfileScope that started while profiling was off.
+    return std::max<uint64_t>(static_cast<uint64_t>(elapsed.count()), 1);
+}
+
+namespace {
+
+// The calling thread's ring, claimed on its first sample, and its name,
+// which may be set before or after that.
+struct RingOwner {
+    ProfileRing* ring = nullptr;
+    // The ring's `owned` flag, released when the thread exits.
+    std::atomic<bool>* owned = nullptr;
+    std::string name;
+    ~RingOwner() {
+        if (owned) owned->store(false, std::memory_order_release);
+    }
+};
+thread_local RingOwner owner;
+
+}
+
+ProfileRing& ClothProfiler::localRing() {
+    if (owner.ring) return *owner.ring;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<std::unique_ptr<ProfileRing>>& rings = registry();
+    for (const std::unique_ptr<ProfileRing>& ring : rings) {
+        bool expected = false;
+        if (ring->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            owner.ring = ring.get();
+            break;
+        }
+    }
+    if (!owner.ring) {
+        rings.push_back(std::make_unique<ProfileRing>());
+        owner.ring = rings.back().get();
+        owner.ring->thread = static_cast<uint32_t>(rings.size() - 1);
+        owner.ring->owned.store(true, std::memory_order_relaxed);
+    }
+    owner.owned = &owner.ring->owned;
+    owner.ring->name = owner.name;
+    return *owner.ring;
+}
+
+void ClothProfiler::record(ProfilePhase phase, uint64_t start, uint64_t end) {
+    ProfileRing& ring = localRing();
+    ProfileSample sample;
+    sample.start = start;
+    sample.duration = end - start;
+    sample.thread = ring.thread;
+    sample.phase = phase;
+    ring.push(sample);
+}
+
+void ClothProfiler::collect(std::vector<ProfileSample>& out) {
+    out.clear();
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const std::unique_ptr<ProfileRing>& ring : registry()) ring->copy(out);
+    }
+
+    const uint64_t cleared = clearedAt.load(std::memory_order_relaxed);
+    out.erase(std::remove_if(out.begin(), out.end(), [&](const ProfileSample& sample) {
+        return sample.start < cleared;
+    }), out.end());
+    std::sort(out.begin(), out.end(), [](const ProfileSample& a, const ProfileSample& b) {
+        return a.start != b.start ? a.start < b.start : a.thread < b.thread;
+    });
+}
+
+void ClothProfiler::summarize(double seconds, ProfileSummary& summary) {
+    summary = ProfileSummary();
+    std::vector<ProfileSample> samples;
+    collect(samples);
+
+    const uint64_t window = static_cast<uint64_t>(seconds * 1e9);
+    const uint64_t current = now();
+    const uint64_t since = current > window ? current - window : 0;
+    double total[static_cast<size_t>(ProfilePhase::Count)] = {};
+    for (const ProfileSample& sample : samples) {
+        size_t phase = static_cast<size_t>(sample.phase);
+        if (sample.start < since || phase >= static_cast<size_t>(ProfilePhase::Count)) continue;
+        total[phase] += static_cast<double>(sample.duration);
+        summary.calls[phase]++;
+    }
+    for (size_t phase = 0; phase < static_cast<size_t>(ProfilePhase::Count); phase++) {
+        if (summary.calls[phase] > 0) summary.milliseconds[phase] = total[phase] * 1e-6 / summary.calls[phase];
+    }
+}
+
+bool ClothProfiler::writeCsv(const std::string& path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cerr << "ClothProfiler: cannot write " << path << std::endl;
+        return false;
+    }
+
+    std::vector<ProfileSample> samples;
+    collect(samples);
+    file << std::fixed << std::setprecision(3) << "thread,phase,start_us,duration_us\n";
+    for (const ProfileSample& sample : samples) {
+        file << sample.thread << ',' << profilePhaseName(sample.phase) << ','
+             << sample.start * 1e-3 << ',' << sample.duration * 1e-3 << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+bool ClothProfiler::writeChromeTrace(const std::string& path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cerr << "ClothProfiler: cannot write " << path << std::endl;
+        return false;
+    }
+
+    std::vector<ProfileSample> samples;
+    collect(samples);
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const std::unique_ptr<ProfileRing>& ring : registry()) {
+            names.push_back(ring->name.empty() ? "thread " + std::to_string(ring->thread) : ring->name);
+        }
+    }
+
+    // Events are comma separated with none after the last, which may be a
+    // thread name when no samples are left.
+    const char* separator = "";
+    file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t thread = 0; thread < names.size(); thread++) {
+        file << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread
+             << ",\"args\":{\"name\":" << jsonString(names[thread]) << "}}";
+        separator = ",\n";
+    }
+    for (const ProfileSample& sample : samples) {
+        file << separator << "{\"ph\":\"X\",\"cat\":\"cloth\",\"name\":\"" << profilePhaseName(sample.phase)
+             << "\",\"pid\":1,\"tid\":" << sample.thread << ",\"ts\":" << sample.start * 1e-3
+             << ",\"dur\":" << sample.duration * 1e-3 << "}";
+        separator = ",\n";
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+void ClothProfiler::setThreadName(const std::string& name) {
+    owner.name = name;
+    if (!owner.ring) return;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    owner.ring->name = name;
+}
+
+void ClothProfiler::clear() {
+    clearedAt.store(now(), std::memory_order_relaxed);
+}
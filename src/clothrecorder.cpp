@@ -0,0 +1,337 @@
+#include "clothrecorder.h"
+#include "clothcheckpoint.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+const float ClothRecorder::defaultQuantum = 1.0f / 4096.0f;
+
+namespace {
+
+const char recordingMagic[8] = {'C', 'L', 'O', 'T', 'H', 'R', 'E', 'C'};
+
+// Positions beyond this many quanta are clamped; NaN is recorded as zero.
+const float quantizeLimit = 1.0e9f;
+
+int32_t quantize(float value, float inverseQuantum) {
+    float scaled = value * inverseQuantum;
+    if (!(std::fabs(scaled) < quantizeLimit)) {
+        if (scaled > 0.0f) return static_cast<int32_t>(quantizeLimit);
+        if (scaled < 0.0f) return -static_cast<int32_t>(quantizeLimit);
+        return 0;
+    }
+    return static_cast<int32_t>(std::lrint(scaled));
+}
+
+void putVarint(uint64_t value, std::vector<uint8_t>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool getVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < size; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+}
+
+// Tokens: (zigzag(delta) << 1) for a changed value, (run << 1) | 1 for a
+// run of unchanged ones.
+void ClothFrameCodec::encode(const ClothSnapshot& frame, float quantum, bool keyframe, std::vector<uint8_t>& out) {
+    const size_t count = frame.size();
+    if (keyframe || previous.size() != count * 3) {
+        previous.assign(count * 3, 0);
+    }
+
+    out.clear();
+    const float inverseQuantum = 1.0f / quantum;
+    const float* axes[3] = {frame.x.data(), frame.y.data(), frame.z.data()};
+    uint64_t unchanged = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t* prev = previous.data() + axis * count;
+        for (size_t i = 0; i < count; i++) {
+            int32_t q = quantize(axes[axis][i], inverseQuantum);
+            int64_t delta = static_cast<int64_t>(q) - prev[i];
+            prev[i] = q;
+
+            if (delta == 0) {
+                unchanged++;
+                continue;
+            }
+            if (unchanged) {
+                putVarint((unchanged << 1) | 1, out);
+                unchanged = 0;
+            }
+            uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+            putVarint(zigzag << 1, out);
+        }
+    }
+
+    if (unchanged) {
+        putVarint((unchanged << 1) | 1, out);
+    }
+}
+
+bool ClothFrameCodec::decode(const uint8_t* data, size_t size, float quantum, bool keyframe, ClothSnapshot& frame) {
+    const size_t count = static_cast<size_t>(frame.width) * frame.height;
+    const size_t total = count * 3;
+    if (keyframe) {
+        previous.assign(total, 0);
+    } else if (previous.size() != total) {
+        return false;
+    }
+
+    size_t pos = 0;
+    size_t index = 0;
+    while (index < total) {
+        uint64_t token;
+        if (!getVarint(data, size, pos, token)) return false;
+
+        if (token & 1) {
+            uint64_t run = token >> 1;
+            if (run > total - index) return false;
+            index += run;
+        } else {
+            uint64_t zigzag = token >> 1;
+            int64_t delta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            previous[index] = static_cast<int32_t>(previous[index] + delta);
+            index++;
+        }
+    }
+    if (pos != size) return false;
+
+    frame.x.resize(count);
+    frame.y.resize(count);
+    frame.z.resize(count);
+    float* axes[3] = {frame.x.data(), frame.y.data(), frame.z.data()};
+    for (int axis = 0; axis < 3; axis++) {
+        const int32_t* q = previous.data() + axis * count;
+        for (size_t i = 0; i < count; i++) {
+            axes[axis][i] = static_cast<float>(q[i]) * quantum;
+        }
+    }
+    return true;
+}
+
+ClothRecorder::~ClothRecorder() {
+    close();
+}
+
+bool ClothRecorder::open(const std::string& path, int w, int h, float q) {
+    close();
+    if (w <= 0 || h <= 0 || !(q > 0.0f)) return false;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ClothRecorder: cannot write " << path << std::endl;
+        return false;
+    }
+
+    ClothRecordingHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, recordingMagic, sizeof(header.magic));
+    header.version = ClothRecordingHeader::currentVersion;
+    header.endianTag = clothCheckpointEndianTag;
+    header.width = w;
+    header.height = h;
+    header.quantum = q;
+    header.keyframeInterval = std::max<uint32_t>(1, keyframeInterval);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    width = w;
+    height = h;
+    quantum = q;
+    activeKeyframeInterval = header.keyframeInterval;
+    stopping = false;
+    droppedFrames.store(0, std::memory_order_relaxed);
+    framesWritten.store(0, std::memory_order_relaxed);
+    bytesWritten.store(sizeof(header), std::memory_order_relaxed);
+
+    buffers.resize(std::max<size_t>(1, maxPendingFrames));
+    freeSlots.clear();
+    for (size_t i = 0; i < buffers.size(); i++) freeSlots.push_back(i);
+    queued.clear();
+
+    writer = std::thread(&ClothRecorder::writerLoop, this);
+    return true;
+}
+
+void ClothRecorder::close() {
+    if (!writer.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    file.close();
+}
+
+bool ClothRecorder::record(const ClothSnapshot& snapshot) {
+    if (!isOpen() || snapshot.width != width || snapshot.height != height) return false;
+
+    size_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+
+    // The slot belongs to this thread until it is queued; copying reuses
+    // its storage once the first frames have sized it.
+    buffers[slot] = snapshot;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(slot);
+    }
+    wake.notify_one();
+    return true;
+}
+
+void ClothRecorder::writerLoop() {
+    ClothFrameCodec codec;
+    std::vector<uint8_t> encoded;
+    uint64_t frameIndex = 0;
+
+    for (;;) {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) return;
+            slot = queued.front();
+            queued.pop_front();
+        }
+
+        const ClothSnapshot& frame = buffers[slot];
+        bool keyframe = frameIndex % activeKeyframeInterval == 0;
+        codec.encode(frame, quantum, keyframe, encoded);
+
+        ClothFrameHeader header;
+        header.step = frame.step;
+        header.flags = keyframe ? ClothFrameHeader::keyframe : 0;
+        header.bytes = static_cast<uint32_t>(encoded.size());
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+        frameIndex++;
+        framesWritten.fetch_add(1, std::memory_order_acq_rel);
+        bytesWritten.fetch_add(sizeof(header) + encoded.size(), std::memory_order_acq_rel);
+    }
+}
+
+bool ClothPlayback::open(const std::string& path) {
+    close();
+
+    file.open(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "ClothPlayback: cannot read " << path << std::endl;
+        return false;
+    }
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, recordingMagic, sizeof(header.magic)) != 0 ||
+        header.version != ClothRecordingHeader::currentVersion ||
+        header.endianTag != clothCheckpointEndianTag ||
+        header.width <= 0 || header.height <= 0 || !(header.quantum > 0.0f)) {
+        std::cerr << "ClothPlayback: invalid recording " << path << std::endl;
+        close();
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    const uint64_t end = static_cast<uint64_t>(file.tellg());
+    uint64_t offset = sizeof(header);
+
+    // A recording cut short by a crash ends in a partial frame; drop it.
+    while (offset + sizeof(ClothFrameHeader) <= end) {
+        ClothFrameHeader frameHeader;
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(&frameHeader), sizeof(frameHeader));
+        if (!file) break;
+
+        uint64_t payloadOffset = offset + sizeof(frameHeader);
+        if (frameHeader.bytes > end - payloadOffset) break;
+
+        frames.push_back({payloadOffset, frameHeader.step, frameHeader.flags, frameHeader.bytes});
+        offset = payloadOffset + frameHeader.bytes;
+    }
+    file.clear();
+
+    if (!frames.empty() && !(frames.front().flags & ClothFrameHeader::keyframe)) {
+        std::cerr << "ClothPlayback: invalid recording " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ClothPlayback::close() {
+    if (file.is_open()) file.close();
+    file.clear();
+    frames.clear();
+    hasDecoded = false;
+}
+
+bool ClothPlayback::readFrame(size_t index, ClothSnapshot& frame) {
+    if (index >= frames.size()) return false;
+
+    size_t first = index;
+    if (!hasDecoded || index != decoded + 1) {
+        while (first > 0 && !(frames[first].flags & ClothFrameHeader::keyframe)) first--;
+    }
+
+    for (size_t i = first; i <= index; i++) {
+        if (!decodeFrame(i, frame)) {
+            hasDecoded = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClothPlayback::decodeFrame(size_t index, ClothSnapshot& frame) {
+    const FrameEntry& entry = frames[index];
+
+    payload.resize(entry.bytes);
+    file.seekg(entry.offset);
+    file.read(reinterpret_cast<char*>(payload.data()), entry.bytes);
+    if (!file) {
+        file.clear();
+        return false;
+    }
+
+    frame.width = header.width;
+    frame.height = header.height;
+    frame.step = entry.step;
+    if (!codec.decode(payload.data(), payload.size(), header.quantum,
+                      (entry.flags & ClothFrameHeader::keyframe) != 0, frame)) {
+        return false;
+    }
+
+    decoded = index;
+    hasDecoded = true;
+    return true;
+}
@@ -1,12 +1,152 @@
 #include "clothsim.h"
+#include "clothcheckpoint.h"
+#include "clothprofiler.h"
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <cmath>
 
 const glm::vec3 Cloth::gravity = glm::vec3(0.0f, -3.0f, 0.0f);
 const glm::vec3 Cloth::wind = glm::vec3(3.0f, 0.0f, 0.0f);
+const float Cloth::fixedTimeStep = 0.016f;
 bool gravityEnabled = false;
 
+namespace {
+
+// Spring passes per step of the force solver. Every pass adds the full spring
+// force again, so its effective stiffness and damping are this many times
+// the configured values; XPBD compliance is derived to match.
+const int springIterations = 8;
+
+// The grid stencil's spring directions in color order (see
+// Cloth::colorSprings), as the step from a spring's first particle to its
+// second.
+const int stencilDirections = 6;
+const int stencilStepX[stencilDirections] = {1, 0, 1, -1, 2, 0};
+const int stencilStepY[stencilDirections] = {0, 1, 1, 1, 0, 2};
+
+// Compliance alpha = 1 / k at the force solver's effective stiffness.
+// The force solver's damping acts on per-frame displacement, so its
+// physical coefficient is c * fixedTimeStep; gamma = alpha * beta / dt.
+void xpbdTerms(float stiffness, float damping, float timeStep, float& alphaTilde, float& gamma) {
+    const float compliance = 1.0f / (stiffness * springIterations);
+    alphaTilde = compliance / (timeStep * timeStep);
+    gamma = compliance * damping * springIterations * Cloth::fixedTimeStep / timeStep;
+}
+
+// One XPBD distance constraint, shared by the Spring list and the grid
+// stencil so that both project identically.
+void projectDistance(ParticleState& particles, size_t p1, size_t p2, float restLength, float& lambda,
+                     float alphaTilde, float gamma) {
+    const float w1 = particles.invMass[p1];
+    const float w2 = particles.invMass[p2];
+    if (w1 + w2 == 0.0f) return;
+
+    glm::vec3 position1 = particles.position(p1);
+    glm::vec3 position2 = particles.position(p2);
+    glm::vec3 delta = position1 - position2;
+    float length = glm::length(delta);
+    if (length < 1e-6f) return;
+
+    glm::vec3 normal = delta / length;
+    float constraint = length - restLength;
+
+    glm::vec3 relativeMotion = (position1 - particles.previousPosition(p1)) -
+                               (position2 - particles.previousPosition(p2));
+    float dampingTerm = gamma * glm::dot(normal, relativeMotion);
+
+    float deltaLambda = (-constraint - alphaTilde * lambda - dampingTerm) / ((1.0f + gamma) * (w1 + w2) + alphaTilde);
+    lambda += deltaLambda;
+
+    particles.setPosition(p1, position1 + normal * (w1 * deltaLambda));
+    particles.setPosition(p2, position2 - normal * (w2 * deltaLambda));
+}
+
+// Mouse constraint reach and drag radius, in multiples of the spacing.
+const float mouseGrabRadius = 4.0f;
+const float mouseFreezeRadius = 3.5f;
+
+// Counter-based generator: a stateless hash of (seed, stream, counter), so
+// any particle's draw for any step can be computed independently.
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Uniform in [0, 1).
+float counterUniform(uint64_t seed, uint64_t stream, uint64_t counter) {
+    uint64_t bits = mix64(mix64(mix64(seed) ^ stream) + counter * 0x9e3779b97f4a7c15ull);
+    return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+// Adds the lifetime of the scope to *target, unless it is null, and records
+// it under `phase` while the profiler is on.
+class PhaseTimer {
+public:
+    PhaseTimer(double* target, ProfilePhase phase)
+        : target(target), phase(phase), start(target || ClothProfiler::enabled() ? ClothProfiler::now() : 0) {}
+
+    ~PhaseTimer() {
+        if (start == 0) return;
+        uint64_t end = ClothProfiler::now();
+        if (target) *target += static_cast<double>(end - start) * 1e-9;
+        if (ClothProfiler::enabled()) ClothProfiler::record(phase, start, end);
+    }
+
+private:
+    double* target;
+    ProfilePhase phase;
+    uint64_t start;
+};
+
+}
+
 Cloth::Cloth(int width, int height, float spacing, float stiff, float damp)
-    : width(width), height(height), spacing(spacing), stiffness(stiff), damping(damp) {
+    : topology(ClothTopology::grid(width, height)), stiffness(stiff), damping(damp), width(width), height(height),
+      spacing(spacing) {
+    buildParticles();
+    colorSprings();
+    buildAdjacency();
+    initSleeping();
+    computeStabilityBound();
+    pristine = saveCheckpoint();
+}
+
+Cloth::Cloth(std::shared_ptr<const ClothTopology> mesh, float stiff, float damp)
+    : topology(mesh), stiffness(stiff), damping(damp), width(static_cast<int>(mesh->vertexCount())), height(1),
+      spacing(mesh->meanEdgeLength()) {
+    buildParticles();
+    colorSprings();
+    buildAdjacency();
+    initSleeping();
+    computeStabilityBound();
+    pristine = saveCheckpoint();
+}
+
+void Cloth::buildParticles() {
+    particles.clear();
+    springs.clear();
+
+    if (!topology->isGrid()) {
+        width = static_cast<int>(topology->restPositions.size());
+        height = 1;
+        particles.reserve(width);
+        for (const glm::vec3& position : topology->restPositions) {
+            particles.push_back(Particle(position, position, 1.0f));
+        }
+        topology->buildSprings(stiffness, springs);
+        updateRestBounds();
+        return;
+    }
+
+    if (topology->gridWidth != width || topology->gridHeight != height) {
+        topology = ClothTopology::grid(width, height);
+    }
+
+    particles.reserve(width * height);
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             glm::vec3 pos(x * spacing, y * spacing, 0.0f);
@@ -15,6 +155,14 @@ Cloth::Cloth(int width, int height, float spacing, float stiff, float damp)
         }
     }
 
+    // Structural, shear and bend springs, counted ahead so the list is
+    // allocated once.
+    const size_t structural = static_cast<size_t>(width - 1) * height + static_cast<size_t>(width) * (height - 1);
+    const size_t shear = 2 * static_cast<size_t>(width - 1) * (height - 1);
+    const size_t bend = static_cast<size_t>(std::max(width - 2, 0)) * height +
+                        static_cast<size_t>(width) * std::max(height - 2, 0);
+    springs.reserve(structural + shear + bend);
+
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             int index = y * width + x;
@@ -38,156 +186,861 @@ Cloth::Cloth(int width, int height, float spacing, float stiff, float damp)
                 springs.push_back(Spring(index, index + width * 2, spacing * 2.0f, stiffness * 0.5f));
         }
     }
+
+    updateRestBounds();
 }
 
-void Cloth::springforces(std::vector<Particle>& particles, const std::vector<Spring>& springs, float stiffness, float damping) {
-    for (const Spring& s : springs) {
-        Particle& p1 = particles[s.p1];
-        Particle& p2 = particles[s.p2];
-        
-        if (p1.mass == 0.0f && p2.mass == 0.0f) continue;
-        
-        glm::vec3 delta = p2.position - p1.position;
-        float currentLength = glm::length(delta);
-    
-        if (currentLength < 1e-6f) continue; 
-    
-        glm::vec3 direction = delta / currentLength;
-    
-        float displacement = currentLength - s.restLength;
-        glm::vec3 force = stiffness * displacement * direction;
-    
-        if (p1.mass > 0.0f) p1.force += force;
-        if (p2.mass > 0.0f) p2.force -= force;
-    
-        glm::vec3 velocity1 = (p1.position - p1.previousPosition);
-        glm::vec3 velocity2 = (p2.position - p2.previousPosition);
-        glm::vec3 relativeVelocity = velocity2 - velocity1;
-        
-        float velocityAlongSpring = glm::dot(relativeVelocity, direction);
-        glm::vec3 dampingForce = damping * velocityAlongSpring * direction;
-   
-        if (p1.mass > 0.0f) p1.force += dampingForce;
-        if (p2.mass > 0.0f) p2.force -= dampingForce;
+void Cloth::buildAdjacency() {
+    const size_t count = particles.size();
+    neighborStart.assign(count + 1, 0);
+    for (const Spring& spring : springs) {
+        neighborStart[spring.p1 + 1]++;
+        neighborStart[spring.p2 + 1]++;
+    }
+    for (size_t i = 0; i < count; i++) {
+        neighborStart[i + 1] += neighborStart[i];
+    }
+
+    neighborList.resize(neighborStart[count]);
+    std::vector<int> fill(neighborStart.begin(), neighborStart.end() - 1);
+    for (const Spring& spring : springs) {
+        neighborList[fill[spring.p1]++] = spring.p2;
+        neighborList[fill[spring.p2]++] = spring.p1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        std::sort(neighborList.begin() + neighborStart[i], neighborList.begin() + neighborStart[i + 1]);
     }
 }
 
-void Cloth::updateparticles(std::vector<Particle>& particles, float deltaTime) {
-    const float timeStep = 0.016f;
-    
-    for (Particle& p : particles) {
-        if (p.mass == 0.0f) continue;
-        
+void Cloth::updateRestBounds() {
+    if (topology->isGrid()) {
+        restMin = glm::vec3(0.0f);
+        restMax = glm::vec3(width * spacing, height * spacing, 0.0f);
+        return;
+    }
+
+    restMin = glm::vec3(0.0f);
+    restMax = glm::vec3(0.0f);
+    for (size_t i = 0; i < particles.size(); i++) {
+        glm::vec3 position = particles.position(i);
+        restMin = i == 0 ? position : glm::min(restMin, position);
+        restMax = i == 0 ? position : glm::max(restMax, position);
+    }
+}
+
+void Cloth::springforces(ParticleState& particles, const std::vector<Spring>& springs, float stiffness, float damping) {
+    springForces(simdLevel, particles, springs.data(), 0, springs.size(), stiffness, damping);
+}
+
+void Cloth::updateparticles(ParticleState& particles, float deltaTime) {
+    integrate(simdLevel, particles, 0, particles.size(), fixedTimeStep);
+}
+
+void Cloth::colorSprings() {
+    // The grid stencil has six spring directions; alternating each one by
+    // the parity of its row or column gives 12 independent sets.
+    std::vector<int> colors(springs.size());
+    int colorCount = 12;
+    bool regular = true;
+
+    for (size_t k = 0; k < springs.size() && regular; k++) {
+        int x1 = springs[k].p1 % width, y1 = springs[k].p1 / width;
+        int x2 = springs[k].p2 % width, y2 = springs[k].p2 / width;
+        int dx = x2 - x1, dy = y2 - y1;
+
+        if (dx == 1 && dy == 0) colors[k] = 0 + (x1 & 1);
+        else if (dx == 0 && dy == 1) colors[k] = 2 + (y1 & 1);
+        else if (dx == 1 && dy == 1) colors[k] = 4 + (y1 & 1);
+        else if (dx == -1 && dy == 1) colors[k] = 6 + (y1 & 1);
+        else if (dx == 2 && dy == 0) colors[k] = 8 + ((x1 >> 1) & 1);
+        else if (dx == 0 && dy == 2) colors[k] = 10 + ((y1 >> 1) & 1);
+        else regular = false;
+    }
 
-        glm::vec3 acceleration = p.force / p.mass;
-        
-        glm::vec3 temp = p.position;
-        p.position = p.position * 2.0f - p.previousPosition + acceleration * timeStep * timeStep;
-        p.previousPosition = temp;
-        
-        p.force = glm::vec3(0.0f);
-        
-        if (p.position.y < 0.0f) {
-            p.position.y = 0.0f;
-            glm::vec3 velocity = p.position - p.previousPosition;
-            p.previousPosition = p.position - velocity * 0.1f;
+    if (!regular) {
+        // Greedy edge coloring for spring layouts outside the grid stencil.
+        std::vector<uint64_t> used(particles.size(), 0);
+        colorCount = 0;
+        for (size_t k = 0; k < springs.size(); k++) {
+            uint64_t taken = used[springs[k].p1] | used[springs[k].p2];
+            int color = 0;
+            while (color < 63 && (taken >> color) & 1) color++;
+            colors[k] = color;
+            used[springs[k].p1] |= uint64_t(1) << color;
+            used[springs[k].p2] |= uint64_t(1) << color;
+            colorCount = std::max(colorCount, color + 1);
         }
     }
+
+    springColorOffsets.assign(colorCount + 1, 0);
+    for (int color : colors) {
+        springColorOffsets[color + 1]++;
+    }
+    for (int c = 0; c < colorCount; c++) {
+        springColorOffsets[c + 1] += springColorOffsets[c];
+    }
+
+    std::vector<size_t> fill(springColorOffsets.begin(), springColorOffsets.end() - 1);
+    std::vector<Spring> sorted(springs);
+    for (size_t k = 0; k < springs.size(); k++) {
+        sorted[fill[colors[k]]++] = springs[k];
+    }
+    springs.swap(sorted);
+    detectGridStencil();
+}
+
+void Cloth::detectGridStencil() {
+    gridStencil = false;
+    if (!topology->isGrid() || springColorOffsets.size() != 2 * stencilDirections + 1) return;
+
+    for (int direction = 0; direction < stencilDirections; direction++) {
+        const size_t first = springColorOffsets[2 * direction];
+        stencilRestLength[direction] = first < springColorOffsets[2 * direction + 2] ? springs[first].restLength : 0.0f;
+    }
+
+    // Each color has to hold exactly the stencil's springs for it: as many,
+    // each inside one of its runs, and none twice.
+    StencilRun runs[2];
+    for (int color = 0; color < 2 * stencilDirections; color++) {
+        size_t expected = 0;
+        for (int y = 0; y < height; y++) {
+            if (!stencilRowHasColor(color, y)) continue;
+            const int runCount = stencilRuns(color, y, runs);
+            for (int r = 0; r < runCount; r++) expected += runs[r].count;
+        }
+        if (springColorOffsets[color + 1] - springColorOffsets[color] != expected) return;
+
+        int previous = -1;
+        for (size_t k = springColorOffsets[color]; k < springColorOffsets[color + 1]; k++) {
+            const Spring& s = springs[k];
+            if (s.p1 <= previous || !stencilRowHasColor(color, s.p1 / width)) return;
+            previous = s.p1;
+
+            bool inRun = false;
+            const int runCount = stencilRuns(color, s.p1 / width, runs);
+            for (int r = 0; r < runCount && !inRun; r++) {
+                const size_t j = static_cast<size_t>(s.p1) - runs[r].first;
+                inRun = static_cast<size_t>(s.p1) >= runs[r].first && j % runs[r].stride == 0 &&
+                        j / runs[r].stride < runs[r].count &&
+                        static_cast<size_t>(s.p2) == s.p1 + runs[r].offset && s.restLength == runs[r].restLength;
+            }
+            if (!inRun) return;
+        }
+    }
+    gridStencil = true;
+}
+
+bool Cloth::stencilRowHasColor(int color, int y) const {
+    const int direction = color / 2;
+    const int parity = color & 1;
+    if (y < 0 || y + stencilStepY[direction] >= height) return false;
+    if (direction == 1 || direction == 2 || direction == 3) return (y & 1) == parity;
+    if (direction == 5) return ((y >> 1) & 1) == parity;
+    return true;
+}
+
+// Horizontal springs alternate by column, every other one for the
+// structural direction and every other pair for the bend direction, so
+// their runs step over the other color. The rest are unit-stride.
+int Cloth::stencilRuns(int color, int y, StencilRun runs[2]) const {
+    const int direction = color / 2;
+    const int parity = color & 1;
+    const int stepX = stencilStepX[direction];
+    const int lastX = width - 1 - std::max(0, stepX);
+
+    int starts[2] = {std::max(0, -stepX), 0};
+    int startCount = 1;
+    int stride = 1;
+    if (direction == 0) {
+        starts[0] = parity;
+        stride = 2;
+    } else if (direction == 4) {
+        starts[0] = 2 * parity;
+        starts[1] = 2 * parity + 1;
+        startCount = 2;
+        stride = 4;
+    }
+
+    int count = 0;
+    for (int r = 0; r < startCount; r++) {
+        if (starts[r] > lastX) continue;
+        StencilRun& run = runs[count++];
+        run.first = static_cast<size_t>(y) * width + starts[r];
+        run.count = static_cast<size_t>((lastX - starts[r]) / stride + 1);
+        run.stride = static_cast<size_t>(stride);
+        run.offset = static_cast<size_t>(stencilStepY[direction] * width + stepX);
+        run.restLength = stencilRestLength[direction];
+    }
+    return count;
+}
+
+// A color's springs share no particle, so its rows run in parallel.
+template <typename Body>
+void Cloth::forEachStencilRun(int color, const Body& body) {
+    const int rows = height - stencilStepY[color / 2];
+    if (rows <= 0) return;
+
+    auto runRows = [&](size_t first, size_t last) {
+        StencilRun runs[2];
+        for (size_t y = first; y < last; y++) {
+            if (!stencilRowHasColor(color, static_cast<int>(y))) continue;
+            const int count = stencilRuns(color, static_cast<int>(y), runs);
+            for (int r = 0; r < count; r++) body(runs[r]);
+        }
+    };
+
+    if (threadPool) {
+        const size_t springChunk = 2048;
+        threadPool->parallelFor(rows, std::max<size_t>(1, springChunk / width), runRows);
+    } else {
+        runRows(0, rows);
+    }
+}
+
+void Cloth::solveStencilSprings() {
+    for (int color = 0; color < 2 * stencilDirections; color++) {
+        forEachStencilRun(color, [&](const StencilRun& run) {
+            stencilForces(simdLevel, particles, run, stiffness, damping);
+        });
+    }
+}
+
+void Cloth::solveStencilConstraints(float timeStep) {
+    if (stiffness <= 0.0f) return;
+
+    float alphaTilde, gamma;
+    xpbdTerms(stiffness, damping, timeStep, alphaTilde, gamma);
+
+    for (int color = 0; color < 2 * stencilDirections; color++) {
+        float* lambda = constraintLambda.data() + (color / 2) * particles.size();
+        forEachStencilRun(color, [&](const StencilRun& run) {
+            for (size_t j = 0; j < run.count; j++) {
+                const size_t p1 = run.first + j * run.stride;
+                projectDistance(particles, p1, p1 + run.offset, run.restLength, lambda[p1], alphaTilde, gamma);
+            }
+        });
+    }
+}
+
+void Cloth::solveSprings() {
+    if (usesGridStencil()) {
+        solveStencilSprings();
+        return;
+    }
+
+    const std::vector<Spring>& list = solverSprings();
+    const std::vector<size_t>& offsets = solverColorOffsets();
+
+    if (!threadPool) {
+        springForces(simdLevel, particles, list.data(), 0, list.size(), stiffness, damping);
+        return;
+    }
+
+    const size_t springChunk = 2048;
+    for (size_t c = 0; c + 1 < offsets.size(); c++) {
+        const size_t first = offsets[c];
+        const size_t count = offsets[c + 1] - first;
+
+        threadPool->parallelFor(count, springChunk, [&](size_t begin, size_t end) {
+            springForces(simdLevel, particles, list.data(), first + begin, first + end, stiffness, damping);
+        });
+    }
+}
+
+void Cloth::integrateParticles(float timeStep) {
+    forEachParticleChunk([&](size_t begin, size_t end) {
+        integrate(simdLevel, particles, begin, end, timeStep);
+    });
+}
+
+void Cloth::setThreadCount(int count) {
+    if (count <= 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if (count == 1) {
+        threadPool.reset();
+    } else if (!threadPool || threadPool->size() != count) {
+        threadPool.reset(new ThreadPool(count));
+    }
+}
+
+int Cloth::getThreadCount() const {
+    return threadPool ? threadPool->size() : 1;
+}
+
+void Cloth::applygravity(ParticleState& particles, float deltaTime) {
+    const size_t count = particles.size();
+
+    for (size_t i = 0; i < count; i++) {
+        if (particles.invMass[i] > 0.0f) {
+            particles.addForce(i, gravity * particles.mass[i]);
+        }
+    }
+}
+
+void Cloth::springforces(std::vector<Particle>& particles, const std::vector<Spring>& springs, float stiffness, float damping) {
+    ParticleState state;
+    state.load(particles);
+    springforces(state, springs, stiffness, damping);
+    state.store(particles);
+}
+
+void Cloth::updateparticles(std::vector<Particle>& particles, float deltaTime) {
+    ParticleState state;
+    state.load(particles);
+    updateparticles(state, deltaTime);
+    state.store(particles);
 }
 
 void Cloth::applygravity(std::vector<Particle>& particles, float deltaTime) {
-    for (Particle& p : particles) {
-        if (p.mass > 0.0f) {
-            p.force += gravity * p.mass;
+    ParticleState state;
+    state.load(particles);
+    applygravity(state, deltaTime);
+    state.store(particles);
+}
+
+// Clamped well inside int, so a blown-up or NaN particle (which lands on
+// the lower bound) neither overflows the cast nor the neighbour offsets.
+static inline int collisionCellCoord(float v, float invCellSize) {
+    const float limit = static_cast<float>(1 << 30);
+    return static_cast<int>(std::max(-limit, std::min(std::floor(v * invCellSize), limit)));
+}
+
+// Unsigned, so the products wrap instead of overflowing.
+static inline uint32_t collisionCellHash(int x, int y, int z, int mask) {
+    return ((static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u) ^
+            (static_cast<uint32_t>(z) * 83492791u)) & static_cast<uint32_t>(mask);
+}
+
+void Cloth::buildCollisionGrid(float cellSize) {
+    const int count = static_cast<int>(particles.size());
+
+    int tableSize = 1;
+    while (tableSize < count * 2) tableSize <<= 1;
+    collisionTableMask = tableSize - 1;
+
+    const float invCellSize = 1.0f / cellSize;
+
+    cellStart.assign(tableSize + 1, 0);
+    particleCell.resize(count);
+    cellEntries.resize(count);
+    // One particle's candidates never outnumber the particles, so the list
+    // stops growing after the first step instead of whenever cloth bunches.
+    collisionCandidates.reserve(count);
+
+    for (int i = 0; i < count; ++i) {
+        if (particles.invMass[i] == 0.0f && !particleAsleep[i]) {
+            particleCell[i] = -1;
+            continue;
+        }
+
+        int h = collisionCellHash(collisionCellCoord(particles.x[i], invCellSize),
+                                  collisionCellCoord(particles.y[i], invCellSize),
+                                  collisionCellCoord(particles.z[i], invCellSize),
+                                  collisionTableMask);
+        particleCell[i] = h;
+        cellStart[h + 1]++;
+    }
+
+    for (int h = 0; h < tableSize; ++h) {
+        cellStart[h + 1] += cellStart[h];
+    }
+
+    // Counting sort keeps particles inside a bucket in index order, so the
+    // pair visiting order stays close to the brute-force loop.
+    cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < count; ++i) {
+        if (particleCell[i] >= 0) {
+            cellEntries[cellFill[particleCell[i]]++] = i;
+        }
+    }
+}
+
+void Cloth::resolveCollisionPair(int i, int j, float minDistance) {
+    glm::vec3 position1 = particles.position(i);
+    glm::vec3 position2 = particles.position(j);
+    glm::vec3 diff = position1 - position2;
+    float distance = glm::length(diff);
+
+    if (distance < minDistance && distance > 0.001f) {
+        glm::vec3 normal = glm::normalize(diff);
+        float overlap = minDistance - distance;
+
+        float ratio1, ratio2;
+        if (particleAsleep[i] || particleAsleep[j]) {
+            // Sleeping particles are obstacles; the awake side takes the push.
+            ratio1 = particleAsleep[i] ? 0.0f : 1.0f;
+            ratio2 = particleAsleep[j] ? 0.0f : 1.0f;
+        } else {
+            float totalMass = particles.mass[i] + particles.mass[j];
+            ratio1 = particles.mass[j] / totalMass;
+            ratio2 = particles.mass[i] / totalMass;
         }
+
+        position1 += normal * (overlap * ratio1);
+        position2 -= normal * (overlap * ratio2);
+
+        particles.setPosition(i, position1);
+        particles.setPosition(j, position2);
+
+        glm::vec3 vel1 = position1 - particles.previousPosition(i);
+        glm::vec3 vel2 = position2 - particles.previousPosition(j);
+
+        particles.setPreviousPosition(i, position1 - vel1);
+        particles.setPreviousPosition(j, position2 - vel2);
     }
 }
 
 void Cloth::handleSelfCollision() {
+    if (!useSpatialHash) {
+        handleSelfCollisionBruteForce();
+        return;
+    }
+
     float minDistance = spacing * 0.6f;
-    
+    buildCollisionGrid(minDistance);
+
+    const float invCellSize = 1.0f / minDistance;
+    const int count = static_cast<int>(particles.size());
+
+    for (int i = 0; i < count; ++i) {
+        if (particles.invMass[i] == 0.0f && !particleAsleep[i]) continue;
+
+        int cx = collisionCellCoord(particles.x[i], invCellSize);
+        int cy = collisionCellCoord(particles.y[i], invCellSize);
+        int cz = collisionCellCoord(particles.z[i], invCellSize);
+
+        // Neighbouring cells can hash to the same bucket; visit each bucket
+        // once so a pair is never resolved twice in the same pass.
+        int buckets[27];
+        int bucketCount = 0;
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int h = collisionCellHash(cx + dx, cy + dy, cz + dz, collisionTableMask);
+                    bool seen = false;
+                    for (int b = 0; b < bucketCount; ++b) {
+                        if (buckets[b] == h) {
+                            seen = true;
+                            break;
+                        }
+                    }
+                    if (!seen) buckets[bucketCount++] = h;
+                }
+            }
+        }
+
+        // Resolve candidates in ascending index order, the same order the
+        // brute-force loop uses, so both paths push particles identically.
+        collisionCandidates.clear();
+        for (int b = 0; b < bucketCount; ++b) {
+            for (int k = cellStart[buckets[b]]; k < cellStart[buckets[b] + 1]; ++k) {
+                int j = cellEntries[k];
+                if (j > i) collisionCandidates.push_back(j);
+            }
+        }
+        std::sort(collisionCandidates.begin(), collisionCandidates.end());
+
+        for (int j : collisionCandidates) {
+            if (particleAsleep[i] && particleAsleep[j]) continue;
+            if (areNeighbors(i, j)) continue;
+
+            resolveCollisionPair(i, j, minDistance);
+        }
+    }
+}
+
+void Cloth::handleSelfCollisionBruteForce() {
+    float minDistance = spacing * 0.6f;
+
     for (size_t i = 0; i < particles.size(); ++i) {
-        if (particles[i].mass == 0.0f) continue;
-        
+        if (particles.invMass[i] == 0.0f && !particleAsleep[i]) continue;
+
         for (size_t j = i + 1; j < particles.size(); ++j) {
-            if (particles[j].mass == 0.0f) continue;
-            
+            if (particles.invMass[j] == 0.0f && !particleAsleep[j]) continue;
+            if (particleAsleep[i] && particleAsleep[j]) continue;
+
             if (areNeighbors(i, j)) continue;
-            
-            glm::vec3 diff = particles[i].position - particles[j].position;
-            float distance = glm::length(diff);
-            
-            if (distance < minDistance && distance > 0.001f) {
-                glm::vec3 normal = glm::normalize(diff);
-                float overlap = minDistance - distance;
-                
-                float totalMass = particles[i].mass + particles[j].mass;
-                float ratio1 = particles[j].mass / totalMass;
-                float ratio2 = particles[i].mass / totalMass;
-
-                particles[i].position += normal * (overlap * ratio1);
-                particles[j].position -= normal * (overlap * ratio2);
-                
-                glm::vec3 vel1 = particles[i].position - particles[i].previousPosition;
-                glm::vec3 vel2 = particles[j].position - particles[j].previousPosition;
-                
-                particles[i].previousPosition = particles[i].position - vel1;
-                particles[j].previousPosition = particles[j].position - vel2;
-            }
+
+            resolveCollisionPair(i, j, minDistance);
         }
     }
 }
 
 bool Cloth::areNeighbors(int i, int j) const {
-    int row1 = i / width, col1 = i % width;
-    int row2 = j / width, col2 = j % width;
-    
-    int rowDiff = abs(row1 - row2);
-    int colDiff = abs(col1 - col2);
-    
-    return (rowDiff <= 1 && colDiff <= 1) ||
-           (rowDiff <= 2 && colDiff == 0) ||
-           (rowDiff == 0 && colDiff <= 2);
+    const int* first = neighborList.data() + neighborStart[i];
+    const int* last = neighborList.data() + neighborStart[i + 1];
+    return std::binary_search(first, last, j);
 }
 
 void Cloth::update(float deltaTime) {
+    // The force solver always takes the fixed step here; advance() is the
+    // entry point that substeps real frame times.
+    if (solverMode == SolverMode::ForceSprings || deltaTime <= 0.0f) {
+        simulateStep(fixedTimeStep);
+    } else {
+        simulateStep(deltaTime);
+    }
+}
+
+int Cloth::advance(float frameTime, const std::function<void(float)>& beforeStep) {
+    accumulator += std::max(0.0f, frameTime);
+
+    float substep = getSubstepTime();
+    bool unstable = false;
+    int steps = 0;
+    while (accumulator >= substep && steps < maxSubsteps) {
+        if (beforeStep) beforeStep(substep);
+        simulateStep(substep);
+        accumulator -= substep;
+        steps++;
+
+        if (adaptiveSubsteps) {
+            float motion = maxStepMotion();
+            if (!(motion <= instabilityMotion * spacing)) {
+                unstable = true;
+                substepScale = std::max(substepScale * 0.5f, 1.0f / 64.0f);
+                substep = getSubstepTime();
+            }
+        }
+    }
+
+    if (accumulator >= substep) {
+        float kept = std::fmod(accumulator, substep);
+        droppedTime += accumulator - kept;
+        accumulator = kept;
+    }
+
+    if (!unstable && substepScale < 1.0f) {
+        substepScale = std::min(1.0f, substepScale * 1.25f);
+    }
+
+    lastSubsteps = steps;
+    return steps;
+}
+
+float Cloth::getSubstepTime() const {
+    float substep = maxTimeStep;
+    if (solverMode == SolverMode::ForceSprings) {
+        substep = std::min(substep, stabilitySafety * stableTimeStep());
+    }
+    return substep * substepScale;
+}
+
+float Cloth::stableTimeStep() const {
+    // Gershgorin bound on the largest mass-spring eigenfrequency:
+    // omega^2 <= springs at a particle * effective stiffness / mass.
+    if (stiffnessBound <= 0.0f) return maxTimeStep;
+    return 2.0f / std::sqrt(stiffnessBound * stiffness * springIterations);
+}
+
+void Cloth::computeStabilityBound() {
+    std::vector<int> incident(particles.size(), 0);
+    for (const Spring& s : springs) {
+        incident[s.p1]++;
+        incident[s.p2]++;
+    }
+
+    stiffnessBound = 0.0f;
+    for (size_t i = 0; i < particles.size(); i++) {
+        stiffnessBound = std::max(stiffnessBound, incident[i] * particles.invMass[i]);
+    }
+}
+
+float Cloth::maxStepMotion() const {
+    float motion2 = 0.0f;
+    for (size_t i = 0; i < particles.size(); i++) {
+        glm::vec3 motion = particles.position(i) - particles.previousPosition(i);
+        float length2 = glm::dot(motion, motion);
+        // Written so a NaN position also reports as unstable.
+        if (!(length2 <= motion2)) motion2 = length2;
+    }
+    return std::sqrt(motion2);
+}
+
+void Cloth::rescaleVelocities(float ratio) {
+    for (size_t i = 0; i < particles.size(); i++) {
+        if (particles.invMass[i] == 0.0f) continue;
+        glm::vec3 position = particles.position(i);
+        particles.setPreviousPosition(i, position - (position - particles.previousPosition(i)) * ratio);
+    }
+}
+
+void Cloth::simulateStep(float timeStep) {
+    ProfileScope scope(ProfilePhase::Step);
+    PhaseTimings* timings = phaseTimingEnabled ? &phaseTimings : nullptr;
+
+    // Velocity lives in x - prev as displacement per step, so a change of
+    // step size rescales it (time-corrected Verlet).
+    if (lastStepTime > 0.0f && timeStep != lastStepTime) {
+        rescaleVelocities(timeStep / lastStepTime);
+    }
+    lastStepTime = timeStep;
+
+    if (continuousCollisionEnabled) ccd.beginStep(particles);
+
     if (gravityEnabled) {
-        applygravity(particles, deltaTime);
+        PhaseTimer timer(timings ? &timings->gravity : nullptr, ProfilePhase::Gravity);
+        applygravity(particles, timeStep);
+    }
+
+    if (!sleepingEnabled && sleepingTiles > 0) wakeAllTiles();
+    if (activeListsDirty) rebuildActiveLists();
+
+    if (solverMode != SolverMode::ForceSprings) {
+        if (solverMode == SolverMode::XPBD || solverMode == SolverMode::Hierarchical) {
+            stepXpbd(timeStep, timings);
+        } else {
+            stepImplicit(timeStep, timings);
+        }
+    } else {
+        for (int i = 0; i < springIterations; ++i) {
+            {
+                PhaseTimer timer(timings ? &timings->springs : nullptr, ProfilePhase::Springs);
+                solveSprings();
+            }
+
+            if (i % 2 == 0 && selfCollisionEnabled) {
+                PhaseTimer timer(timings ? &timings->collision : nullptr, ProfilePhase::Collision);
+                handleSelfCollision();
+            }
+        }
+
+        {
+            PhaseTimer timer(timings ? &timings->integrate : nullptr, ProfilePhase::Integrate);
+            integrateParticles(timeStep);
+        }
+    }
+
+    if (!colliders.empty()) {
+        PhaseTimer timer(timings ? &timings->collision : nullptr, ProfilePhase::Collision);
+        forEachParticleChunk([&](size_t begin, size_t end) {
+            resolveColliders(begin, end);
+        });
+    }
+
+    // Last, so nothing after it can push the cloth through itself again.
+    if (continuousCollisionEnabled) {
+        PhaseTimer timer(timings ? &timings->collision : nullptr, ProfilePhase::Collision);
+        handleContinuousCollision();
+    }
+
+    if (sleepingEnabled) {
+        PhaseTimer timer(timings ? &timings->integrate : nullptr, ProfilePhase::Integrate);
+        updateSleeping();
+    }
+
+    bvhStale = true;
+    if (timings) timings->steps++;
+}
+
+void Cloth::stepXpbd(float timeStep, PhaseTimings* timings) {
+    {
+        PhaseTimer timer(timings ? &timings->integrate : nullptr, ProfilePhase::Integrate);
+        forEachParticleChunk([&](size_t begin, size_t end) {
+            predictPositions(timeStep, begin, end);
+        });
+    }
+
+    if (solverMode == SolverMode::Hierarchical && stiffness > 0.0f && topology->isGrid()) {
+        PhaseTimer timer(timings ? &timings->springs : nullptr, ProfilePhase::Springs);
+        if (!hierarchy.matches(width, height, spacing, hierarchyLevels)) {
+            hierarchy.build(width, height, spacing, hierarchyLevels);
+        }
+        hierarchy.relax(particles, 1.0f / (stiffness * springIterations), timeStep, coarseIterations, threadPool.get());
     }
 
-    const int solverIterations = 8;
-    for (int i = 0; i < solverIterations; ++i) {
-        springforces(particles, springs, stiffness, damping);
-        
-        if (i % 2 == 0) {
+    constraintLambda.assign(usesGridStencil() ? stencilDirections * particles.size() : solverSprings().size(), 0.0f);
+    for (int i = 0; i < xpbdIterations; ++i) {
+        {
+            PhaseTimer timer(timings ? &timings->springs : nullptr, ProfilePhase::Springs);
+            solveConstraints(timeStep);
+        }
+
+        if (i % 2 == 0 && selfCollisionEnabled) {
+            PhaseTimer timer(timings ? &timings->collision : nullptr, ProfilePhase::Collision);
             handleSelfCollision();
         }
     }
-    
-    updateparticles(particles, deltaTime);
+
+    {
+        PhaseTimer timer(timings ? &timings->integrate : nullptr, ProfilePhase::Integrate);
+        forEachParticleChunk([&](size_t begin, size_t end) {
+            clampToGround(begin, end);
+        });
+    }
+}
+
+void Cloth::stepImplicit(float timeStep, PhaseTimings* timings) {
+    {
+        // Same effective stiffness and damping as the force solver.
+        PhaseTimer timer(timings ? &timings->springs : nullptr, ProfilePhase::Springs);
+        implicitSolver.step(particles, springs, springColorOffsets, stiffness * springIterations,
+                            damping * springIterations * fixedTimeStep, timeStep, threadPool.get());
+    }
+
+    if (selfCollisionEnabled) {
+        PhaseTimer timer(timings ? &timings->collision : nullptr, ProfilePhase::Collision);
+        handleSelfCollision();
+    }
+
+    {
+        PhaseTimer timer(timings ? &timings->integrate : nullptr, ProfilePhase::Integrate);
+        forEachParticleChunk([&](size_t begin, size_t end) {
+            clampToGround(begin, end);
+        });
+    }
+}
+
+template <typename Body>
+void Cloth::forEachParticleChunk(const Body& body) {
+    const size_t particleChunk = 4096;
+    if (sleepingTiles > 0) {
+        // Runs of awake tiles are short, so hand out several per chunk.
+        const size_t rangeChunk = 32;
+        auto runRanges = [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++) body(activeRanges[r].first, activeRanges[r].second);
+        };
+        if (threadPool) {
+            threadPool->parallelFor(activeRanges.size(), rangeChunk, runRanges);
+        } else {
+            runRanges(0, activeRanges.size());
+        }
+    } else if (threadPool) {
+        threadPool->parallelFor(particles.size(), particleChunk, body);
+    } else {
+        body(0, particles.size());
+    }
+}
+
+void Cloth::predictPositions(float timeStep, size_t first, size_t last) {
+    const float dt2 = timeStep * timeStep;
+
+    for (size_t i = first; i < last; i++) {
+        const float invMass = particles.invMass[i];
+        if (invMass == 0.0f) {
+            particles.setForce(i, glm::vec3(0.0f));
+            continue;
+        }
+
+        glm::vec3 position = particles.position(i);
+        glm::vec3 velocity = position - particles.previousPosition(i);
+
+        particles.setPreviousPosition(i, position);
+        particles.setPosition(i, position + velocity + particles.force(i) * invMass * dt2);
+        particles.setForce(i, glm::vec3(0.0f));
+    }
+}
+
+void Cloth::projectConstraints(const Spring* list, float timeStep, size_t first, size_t last) {
+    if (stiffness <= 0.0f) return;
+
+    float alphaTilde, gamma;
+    xpbdTerms(stiffness, damping, timeStep, alphaTilde, gamma);
+
+    for (size_t k = first; k < last; k++) {
+        const Spring& s = list[k];
+        projectDistance(particles, s.p1, s.p2, s.restLength, constraintLambda[k], alphaTilde, gamma);
+    }
+}
+
+void Cloth::solveConstraints(float timeStep) {
+    if (usesGridStencil()) {
+        solveStencilConstraints(timeStep);
+        return;
+    }
+
+    const std::vector<Spring>& list = solverSprings();
+    const std::vector<size_t>& offsets = solverColorOffsets();
+
+    if (!threadPool) {
+        projectConstraints(list.data(), timeStep, 0, list.size());
+        return;
+    }
+
+    const size_t springChunk = 2048;
+    for (size_t c = 0; c + 1 < offsets.size(); c++) {
+        const size_t first = offsets[c];
+        const size_t count = offsets[c + 1] - first;
+
+        threadPool->parallelFor(count, springChunk, [&](size_t begin, size_t end) {
+            projectConstraints(list.data(), timeStep, first + begin, first + end);
+        });
+    }
+}
+
+void Cloth::clampToGround(size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+        if (particles.invMass[i] == 0.0f || particles.y[i] >= 0.0f) continue;
+
+        glm::vec3 position = particles.position(i);
+        position.y = 0.0f;
+        glm::vec3 velocity = position - particles.previousPosition(i);
+
+        particles.setPosition(i, position);
+        particles.setPreviousPosition(i, position - velocity * 0.1f);
+    }
+}
+
+// Pushes penetrating particles out along the collider normal to its
+// thickness. The step's motion into the surface is dropped and friction
+// bleeds off the tangential part, so contacts neither bounce nor slide freely.
+void Cloth::resolveColliders(size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+        if (particles.invMass[i] == 0.0f) continue;
+
+        glm::vec3 position = particles.position(i);
+        glm::vec3 previousPosition = particles.previousPosition(i);
+        bool contact = false;
+
+        for (const ClothCollider& collider : colliders) {
+            glm::vec3 normal;
+            float depth = collider.thickness - collider.distance(position, normal);
+            if (!(depth > 0.0f)) continue;
+
+            glm::vec3 velocity = position - previousPosition;
+            float normalSpeed = glm::dot(velocity, normal);
+            glm::vec3 tangential = velocity - normal * normalSpeed;
+            velocity = tangential * (1.0f - collider.friction) + normal * std::max(normalSpeed, 0.0f);
+
+            position += normal * depth;
+            previousPosition = position - velocity;
+            contact = true;
+        }
+
+        if (contact) {
+            particles.setPosition(i, position);
+            particles.setPreviousPosition(i, previousPosition);
+        }
+    }
 }
 
 void Cloth::applymouseconstraint(glm::vec2 mousePos, bool mousePressed) {
     if (!mousePressed) return;
 
-    float simWidth = width * spacing;
-    float simHeight = height * spacing;
+    float simWidth = restMax.x - restMin.x;
+    float simHeight = restMax.y - restMin.y;
 
-    float normalizedX = (mousePos.x / 800.0f) * simWidth;
-    float normalizedY = ((600.0f - mousePos.y) / 600.0f) * simHeight;
+    float normalizedX = restMin.x + (mousePos.x / 800.0f) * simWidth;
+    float normalizedY = restMin.y + ((600.0f - mousePos.y) / 600.0f) * simHeight;
     glm::vec3 mousePoint(normalizedX, normalizedY, 0.0f);
 
-    float radius = spacing * 4.0f;
-    float freezeRadius = spacing * 3.5f;
+    float radius = spacing * mouseGrabRadius;
+    float freezeRadius = spacing * mouseFreezeRadius;
+
+    // The grab can reach anything within radius of the cursor and drags
+    // whatever lies within freezeRadius of that.
+    if (sleepingTiles > 0) wakeTilesNear(mousePoint, radius + freezeRadius);
     
     int closestParticle = -1;
     float minDistance = radius;
     
-    for (size_t i = 0; i < particles.size(); i++) {
-        Particle& p = particles[i];
-        if (p.mass > 0.0f) {
-            float distance = glm::distance(p.position, mousePoint);
-            if (distance < minDistance) {
+    particlesWithin(mousePoint, radius, pickedParticles);
+    for (int i : pickedParticles) {
+        if (particles.invMass[i] > 0.0f) {
+            float distance = glm::distance(particles.position(i), mousePoint);
+            if (distance < minDistance || (distance == minDistance && i < closestParticle)) {
                 minDistance = distance;
                 closestParticle = i;
             }
@@ -195,84 +1048,299 @@ void Cloth::applymouseconstraint(glm::vec2 mousePos, bool mousePressed) {
     }
     
     if (closestParticle != -1) {
-        Particle& anchor = particles[closestParticle];
-        glm::vec3 anchorOriginalPos = anchor.position;
-        
-        glm::vec3 targetMovement = mousePoint - anchorOriginalPos;
-        glm::vec3 smoothedMovement = targetMovement * 0.8f;
-        
-        anchor.previousPosition = anchor.position;
-        anchor.position = anchorOriginalPos + smoothedMovement;
-        
-        glm::vec3 movement = smoothedMovement;
-        
-        for (size_t i = 0; i < particles.size(); i++) {
-            if (i == closestParticle) continue;
-            
-            Particle& p = particles[i];
-            if (p.mass > 0.0f) {
-                float distance = glm::distance(p.position, anchorOriginalPos);
-                if (distance < freezeRadius) {
-                    p.previousPosition = p.position;
-                    p.position += movement;
-                }
+        dragParticle(closestParticle, mousePoint);
+    }
+}
+
+void Cloth::applymouseconstraint(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, bool mousePressed) {
+    if (!mousePressed) {
+        grabbedParticle = -1;
+        return;
+    }
+
+    float length = glm::length(rayDirection);
+    if (!(length > 0.0f)) return;
+    glm::vec3 direction = rayDirection / length;
+    float freezeRadius = spacing * mouseFreezeRadius;
+
+    if (grabbedParticle < 0) {
+        ClothRayHit hit;
+        if (!raycast(rayOrigin, direction, hit)) return;
+        if (sleepingTiles > 0) wakeTilesNear(rayOrigin + direction * hit.t, spacing * mouseGrabRadius + freezeRadius);
+
+        const float weights[3] = {1.0f - hit.u - hit.v, hit.u, hit.v};
+        float bestWeight = -1.0f;
+        for (int k = 0; k < 3; k++) {
+            if (particles.invMass[hit.vertices[k]] > 0.0f && weights[k] > bestWeight) {
+                bestWeight = weights[k];
+                grabbedParticle = hit.vertices[k];
             }
         }
+        if (grabbedParticle < 0) return;
+        grabDepth = glm::dot(particles.position(grabbedParticle) - rayOrigin, direction);
+    } else if (sleepingTiles > 0) {
+        wakeTilesNear(particles.position(grabbedParticle), freezeRadius);
+    }
+
+    dragParticle(grabbedParticle, rayOrigin + direction * grabDepth);
+}
+
+// Moves the anchor 80% of the way to target and everything free within the
+// freeze radius of it by the same amount, zeroing their velocities.
+void Cloth::dragParticle(int anchor, const glm::vec3& target) {
+    glm::vec3 anchorOriginalPos = particles.position(anchor);
+    glm::vec3 movement = (target - anchorOriginalPos) * 0.8f;
+
+    // Sized for the whole cloth up front; a crumpled cloth can bring more
+    // particles into the radius every step.
+    pickedParticles.reserve(particles.size());
+    particlesWithin(anchorOriginalPos, spacing * mouseFreezeRadius, pickedParticles);
+
+    particles.setPreviousPosition(anchor, anchorOriginalPos);
+    particles.setPosition(anchor, anchorOriginalPos + movement);
+
+    for (int i : pickedParticles) {
+        if (i == anchor || particles.invMass[i] == 0.0f) continue;
+
+        glm::vec3 position = particles.position(i);
+        particles.setPreviousPosition(i, position);
+        particles.setPosition(i, position + movement);
     }
+    bvhStale = true;
 }
 
-const std::vector<Particle>& Cloth::getParticles() const {
-    return particles;
+// Runs serially: contacts are resolved one after another in sorted order,
+// so the result does not depend on the thread count.
+void Cloth::handleContinuousCollision() {
+    if (ccdTopology != topology) {
+        ccd.build(*topology, particles);
+        ccdTopology = topology;
+    }
+    continuousContacts = ccd.resolve(particles, continuousCollisionThickness * spacing, continuousCollisionPasses);
+}
+
+void Cloth::refreshBVH() {
+    if (bvhTopology != topology) {
+        bvh.build(*topology, particles);
+        bvhTopology = topology;
+    } else if (bvhStale) {
+        bvh.refit(particles);
+    }
+    bvhStale = false;
+}
+
+bool Cloth::raycast(const glm::vec3& origin, const glm::vec3& direction, ClothRayHit& hit) {
+    refreshBVH();
+    return bvh.raycast(origin, direction, particles, hit);
+}
+
+void Cloth::particlesWithin(const glm::vec3& center, float radius, std::vector<int>& out) {
+    refreshBVH();
+    bvh.queryRadius(center, radius, particles, out);
+}
+
+ParticleView Cloth::getParticles() const {
+    return ParticleView(particles);
 }
 
 const std::vector<Spring>& Cloth::getSprings() const {
     return springs;
 }
 
+const std::vector<size_t>& Cloth::getSpringColorOffsets() const {
+    return springColorOffsets;
+}
+
 void Cloth::applywind(float deltaTime) {
-    for (Particle& p : particles) {
-        if (p.mass > 0.0f) {
-            float randomness = 0.5f + static_cast<float>(rand()) / RAND_MAX;
-            glm::vec3 localWind = wind * randomness;
-            p.force += localWind * p.mass;
+    PhaseTimer timer(phaseTimingEnabled ? &phaseTimings.wind : nullptr, ProfilePhase::Wind);
+
+    // Wind pushes every particle, so nothing stays asleep under it.
+    if (sleepingTiles > 0) wakeAllTiles();
+
+    // Each particle draws from its own stream at the current gust, so the
+    // result depends on neither thread count nor evaluation order.
+    const uint64_t gust = windGusts++;
+    forEachParticleChunk([&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            if (particles.invMass[i] > 0.0f) {
+                float randomness = 0.5f + counterUniform(randomSeed, i, gust);
+                glm::vec3 localWind = wind * randomness;
+                particles.addForce(i, localWind * particles.mass[i]);
+            }
         }
-    }
+    });
 }
 
 void Cloth::reset() {
-    particles.clear();
-    springs.clear();
+    const ClothCheckpointHeader* header = reinterpret_cast<const ClothCheckpointHeader*>(pristine.data());
+    // Meshes restored from a checkpoint carry no rest pose to rebuild from.
+    bool canRebuild = topology->isGrid() || !topology->restPositions.empty();
+    if (!canRebuild || (header->width == width && header->height == height && header->spacing == spacing &&
+                        header->stiffness == stiffness)) {
+        restoreCheckpoint(pristine.data(), pristine.size(), false);
+        return;
+    }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            glm::vec3 pos(x * spacing, y * spacing, 0.0f);
-            glm::vec3 prevPos = pos;
-            particles.push_back(Particle(pos, prevPos, 1.0f));
+    // The cloth was resized or restiffened since construction; build it anew.
+    buildParticles();
+    colorSprings();
+    buildAdjacency();
+    initSleeping();
+    computeStabilityBound();
+    accumulator = 0.0f;
+    lastStepTime = 0.0f;
+    substepScale = 1.0f;
+    pristine = saveCheckpoint();
+}
+
+void Cloth::initSleeping() {
+    tilesX = (width + sleepTileSize - 1) / sleepTileSize;
+    tilesY = (height + sleepTileSize - 1) / sleepTileSize;
+    sleepingTiles = 0;
+    tileAsleep.assign(tilesX * tilesY, 0);
+    tileQuietFrames.assign(tilesX * tilesY, 0);
+    tileDisturbed.assign(tilesX * tilesY, 0);
+    particleAsleep.assign(particles.size(), 0);
+    activeListsDirty = false;
+
+    // At their largest the active lists hold every spring and one range per
+    // tile row, so tiles falling asleep and waking never reallocate them.
+    activeSprings.reserve(springs.size());
+    activeColorOffsets.reserve(springColorOffsets.size());
+    activeRanges.reserve(static_cast<size_t>(tilesX) * height);
+}
+
+void Cloth::setTileAsleep(int tile, bool asleep) {
+    if ((tileAsleep[tile] != 0) == asleep) return;
+
+    const int tx = tile % tilesX;
+    const int ty = tile / tilesX;
+    const int xEnd = std::min(width, (tx + 1) * sleepTileSize);
+    const int yEnd = std::min(height, (ty + 1) * sleepTileSize);
+
+    for (int y = ty * sleepTileSize; y < yEnd; y++) {
+        for (int x = tx * sleepTileSize; x < xEnd; x++) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            if (asleep) {
+                // Pinned particles stay pinned and are not tracked.
+                if (particles.invMass[i] == 0.0f) continue;
+                particles.invMass[i] = 0.0f;
+                particleAsleep[i] = 1;
+            } else {
+                if (!particleAsleep[i]) continue;
+                particles.invMass[i] = particles.mass[i] > 0.0f ? 1.0f / particles.mass[i] : 0.0f;
+                particleAsleep[i] = 0;
+            }
+            particles.setPreviousPosition(i, particles.position(i));
+            particles.setForce(i, glm::vec3(0.0f));
         }
     }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int index = y * width + x;
+    tileAsleep[tile] = asleep ? 1 : 0;
+    tileQuietFrames[tile] = 0;
+    sleepingTiles += asleep ? 1 : -1;
+    activeListsDirty = true;
+}
 
-            if (x < width - 1) 
-                springs.push_back(Spring(index, index + 1, spacing, stiffness));
+void Cloth::updateSleeping() {
+    const float threshold = sleepThreshold * spacing;
+    const float threshold2 = threshold * threshold;
+    std::fill(tileDisturbed.begin(), tileDisturbed.end(), 0);
 
-            if (y < height - 1) 
-                springs.push_back(Spring(index, index + width, spacing, stiffness));
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            const int tile = ty * tilesX + tx;
+            if (tileAsleep[tile]) continue;
 
-            if (x < width - 1 && y < height - 1) 
-                springs.push_back(Spring(index, index + width + 1, spacing * 1.41f, stiffness));
+            const int xEnd = std::min(width, (tx + 1) * sleepTileSize);
+            const int yEnd = std::min(height, (ty + 1) * sleepTileSize);
+            float motion2 = 0.0f;
+            for (int y = ty * sleepTileSize; y < yEnd; y++) {
+                for (int x = tx * sleepTileSize; x < xEnd; x++) {
+                    size_t i = static_cast<size_t>(y) * width + x;
+                    if (particles.invMass[i] == 0.0f) continue;
+                    glm::vec3 motion = particles.position(i) - particles.previousPosition(i);
+                    motion2 = std::max(motion2, glm::dot(motion, motion));
+                }
+            }
 
-            if (x > 0 && y < height - 1) 
-                springs.push_back(Spring(index, index + width - 1, spacing * 1.41f, stiffness));
+            if (motion2 <= threshold2) {
+                tileQuietFrames[tile]++;
+                continue;
+            }
 
-            if (x < width - 2) 
-                springs.push_back(Spring(index, index + 2, spacing * 2.0f, stiffness * 0.5f));
+            // A moving tile disturbs its neighbours: they wake if asleep and
+            // cannot fall asleep this step.
+            tileQuietFrames[tile] = 0;
+            for (int ny = std::max(0, ty - 1); ny <= std::min(tilesY - 1, ty + 1); ny++) {
+                for (int nx = std::max(0, tx - 1); nx <= std::min(tilesX - 1, tx + 1); nx++) {
+                    tileDisturbed[ny * tilesX + nx] = 1;
+                }
+            }
+        }
+    }
 
-            if (y < height - 2) 
-                springs.push_back(Spring(index, index + width * 2, spacing * 2.0f, stiffness * 0.5f));
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        if (tileAsleep[tile]) {
+            if (tileDisturbed[tile]) setTileAsleep(tile, false);
+        } else if (!tileDisturbed[tile] && tileQuietFrames[tile] >= sleepFrames) {
+            setTileAsleep(tile, true);
+        }
+    }
+}
+
+void Cloth::wakeTilesNear(const glm::vec3& point, float radius) {
+    particlesWithin(point, radius, pickedParticles);
+    for (int i : pickedParticles) {
+        if (!particleAsleep[i]) continue;
+
+        int x = i % width;
+        int y = i / width;
+        setTileAsleep((y / sleepTileSize) * tilesX + x / sleepTileSize, false);
+    }
+}
+
+void Cloth::wakeAllTiles() {
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        setTileAsleep(tile, false);
+    }
+}
+
+void Cloth::rebuildActiveLists() {
+    activeSprings.clear();
+    activeColorOffsets.assign(1, 0);
+    for (size_t c = 0; c + 1 < springColorOffsets.size(); c++) {
+        for (size_t k = springColorOffsets[c]; k < springColorOffsets[c + 1]; k++) {
+            const Spring& s = springs[k];
+            if (!particleAsleep[s.p1] || !particleAsleep[s.p2]) activeSprings.push_back(s);
+        }
+        activeColorOffsets.push_back(activeSprings.size());
+    }
+
+    // Contiguous runs of particles in awake tiles, merged across tile and
+    // row boundaries where possible.
+    activeRanges.clear();
+    for (int y = 0; y < height; y++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (tileAsleep[(y / sleepTileSize) * tilesX + tx]) continue;
+
+            size_t first = static_cast<size_t>(y) * width + tx * sleepTileSize;
+            size_t last = static_cast<size_t>(y) * width + std::min(width, (tx + 1) * sleepTileSize);
+            if (!activeRanges.empty() && activeRanges.back().second == first) {
+                activeRanges.back().second = last;
+            } else {
+                activeRanges.emplace_back(first, last);
+            }
         }
     }
+
+    activeListsDirty = false;
 }
 
+const std::vector<Spring>& Cloth::solverSprings() const {
+    return sleepingTiles > 0 ? activeSprings : springs;
+}
+
+const std::vector<size_t>& Cloth::solverColorOffsets() const {
+    return sleepingTiles > 0 ? activeColorOffsets : springColorOffsets;
+}
@@ -0,0 +1,14 @@
+#include "clothsnapshot.h"
+#include "clothsim.h"
+
+void ClothSnapshot::capture(const Cloth& cloth, uint64_t stepIndex) {
+    const ParticleState& particles = cloth.getParticles().data();
+
+    width = cloth.width;
+    height = cloth.height;
+    step = stepIndex;
+    if (topology != cloth.getTopology()) topology = cloth.getTopology();
+    x.assign(particles.x.begin(), particles.x.end());
+    y.assign(particles.y.begin(), particles.y.end());
+    z.assign(particles.z.begin(), particles.z.end());
+}
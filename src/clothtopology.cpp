@@ -0,0 +1,316 @@
+#include "clothtopology.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+uint64_t pairKey(int a, int b) {
+    if (a > b) std::swap(a, b);
+    return (static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b);
+}
+
+// Vertex adjacency along polygon edges, as sorted CSR rows.
+void buildEdgeGraph(const ClothTopology& topology, std::vector<int>& start, std::vector<int>& neighbors) {
+    const size_t n = topology.restPositions.size();
+    std::vector<uint64_t> edges;
+    edges.reserve(topology.faceVertices.size() * 2);
+    for (size_t f = 0; f + 1 < topology.faceStart.size(); f++) {
+        int first = topology.faceStart[f];
+        int count = topology.faceStart[f + 1] - first;
+        for (int k = 0; k < count; k++) {
+            int a = topology.faceVertices[first + k];
+            int b = topology.faceVertices[first + (k + 1) % count];
+            if (a == b) continue;
+            edges.push_back((static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b));
+            edges.push_back((static_cast<uint64_t>(b) << 32) | static_cast<uint32_t>(a));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    start.assign(n + 1, 0);
+    neighbors.resize(edges.size());
+    for (size_t e = 0; e < edges.size(); e++) {
+        start[(edges[e] >> 32) + 1]++;
+        neighbors[e] = static_cast<int>(edges[e] & 0xffffffffu);
+    }
+    for (size_t i = 0; i < n; i++) {
+        start[i + 1] += start[i];
+    }
+}
+
+// Breadth-first order of the component containing `root`, children visited
+// by ascending degree. Appends to `order` and marks `visited`.
+void cuthillMcKee(int root, const std::vector<int>& start, const std::vector<int>& neighbors,
+                  std::vector<uint8_t>& visited, std::vector<int>& order) {
+    size_t head = order.size();
+    order.push_back(root);
+    visited[root] = 1;
+
+    std::vector<int> children;
+    while (head < order.size()) {
+        int v = order[head++];
+        children.clear();
+        for (int k = start[v]; k < start[v + 1]; k++) {
+            int u = neighbors[k];
+            if (!visited[u]) {
+                visited[u] = 1;
+                children.push_back(u);
+            }
+        }
+        std::sort(children.begin(), children.end(), [&](int a, int b) {
+            int da = start[a + 1] - start[a];
+            int db = start[b + 1] - start[b];
+            return da != db ? da < db : a < b;
+        });
+        order.insert(order.end(), children.begin(), children.end());
+    }
+}
+
+}
+
+size_t ClothTopology::vertexCount() const {
+    if (isGrid()) return static_cast<size_t>(gridWidth) * gridHeight;
+    return restPositions.size();
+}
+
+std::shared_ptr<const ClothTopology> ClothTopology::grid(int width, int height) {
+    auto topology = std::make_shared<ClothTopology>();
+    topology->gridWidth = width;
+    topology->gridHeight = height;
+    return topology;
+}
+
+void ClothTopology::appendGridTriangles(int width, int height, std::vector<unsigned int>& out) {
+    out.reserve(out.size() + static_cast<size_t>(std::max(width - 1, 0)) * std::max(height - 1, 0) * 6);
+    for (int y = 0; y < height - 1; y++) {
+        for (int x = 0; x < width - 1; x++) {
+            int i0 = y * width + x;
+            int i1 = i0 + 1;
+            int i2 = i0 + width;
+            int i3 = i2 + 1;
+
+            out.push_back(i0);
+            out.push_back(i2);
+            out.push_back(i3);
+            out.push_back(i0);
+            out.push_back(i3);
+            out.push_back(i1);
+        }
+    }
+}
+
+bool ClothTopology::loadObj(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "ClothTopology: cannot read " << path << std::endl;
+        return false;
+    }
+    if (!parseObj(file)) {
+        std::cerr << "ClothTopology: invalid mesh " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ClothTopology::parseObj(std::istream& in) {
+    gridWidth = 0;
+    gridHeight = 0;
+    restPositions.clear();
+    faceStart.assign(1, 0);
+    faceVertices.clear();
+    triangles.clear();
+
+    std::string line;
+    std::string token;
+    while (std::getline(in, line)) {
+        std::istringstream record(line);
+        std::string type;
+        record >> type;
+
+        if (type == "v") {
+            glm::vec3 position;
+            if (!(record >> position.x >> position.y >> position.z)) return false;
+            restPositions.push_back(position);
+        } else if (type == "f") {
+            size_t first = faceVertices.size();
+            while (record >> token) {
+                // "v", "v/vt", "v//vn" or "v/vt/vn"; only v matters here.
+                char* end = nullptr;
+                long index = std::strtol(token.c_str(), &end, 10);
+                if (end == token.c_str() || index == 0) return false;
+
+                long vertex = index > 0 ? index - 1 : static_cast<long>(restPositions.size()) + index;
+                if (vertex < 0 || vertex >= static_cast<long>(restPositions.size())) return false;
+                faceVertices.push_back(static_cast<int>(vertex));
+            }
+            if (faceVertices.size() - first < 3) return false;
+            faceStart.push_back(static_cast<int>(faceVertices.size()));
+        }
+    }
+
+    if (faceStart.size() < 2) return false;
+
+    // Vertices no face uses would become free-floating particles.
+    std::vector<int> remap(restPositions.size(), -1);
+    for (int v : faceVertices) remap[v] = 0;
+    size_t used = 0;
+    for (size_t v = 0; v < restPositions.size(); v++) {
+        if (remap[v] < 0) continue;
+        remap[v] = static_cast<int>(used);
+        restPositions[used++] = restPositions[v];
+    }
+    restPositions.resize(used);
+    for (int& v : faceVertices) v = remap[v];
+
+    for (size_t f = 0; f + 1 < faceStart.size(); f++) {
+        for (int k = faceStart[f] + 1; k + 1 < faceStart[f + 1]; k++) {
+            triangles.push_back(faceVertices[faceStart[f]]);
+            triangles.push_back(faceVertices[k]);
+            triangles.push_back(faceVertices[k + 1]);
+        }
+    }
+
+    reorderForLocality();
+    return true;
+}
+
+void ClothTopology::reorderForLocality() {
+    const size_t n = restPositions.size();
+    if (n == 0) return;
+
+    std::vector<int> start, neighbors;
+    buildEdgeGraph(*this, start, neighbors);
+
+    auto degree = [&](int v) { return start[v + 1] - start[v]; };
+    std::vector<int> byDegree(n);
+    for (size_t v = 0; v < n; v++) byDegree[v] = static_cast<int>(v);
+    std::stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return degree(a) < degree(b); });
+
+    std::vector<uint8_t> visited(n, 0);
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<int> level(n, -1);
+    std::vector<int> probe;
+
+    for (int seed : byDegree) {
+        if (visited[seed]) continue;
+
+        // Start from the far end of the component: a lowest-degree vertex of
+        // the last breadth-first level from the seed gives a narrower band.
+        probe.assign(1, seed);
+        level[seed] = 0;
+        for (size_t head = 0; head < probe.size(); head++) {
+            int v = probe[head];
+            for (int k = start[v]; k < start[v + 1]; k++) {
+                int u = neighbors[k];
+                if (level[u] < 0) {
+                    level[u] = level[v] + 1;
+                    probe.push_back(u);
+                }
+            }
+        }
+        int root = probe.back();
+        for (int v : probe) {
+            if (level[v] == level[probe.back()] && degree(v) < degree(root)) root = v;
+        }
+        for (int v : probe) level[v] = -1;
+
+        cuthillMcKee(root, start, neighbors, visited, order);
+    }
+
+    std::vector<int> newIndex(n);
+    for (size_t k = 0; k < n; k++) {
+        newIndex[order[k]] = static_cast<int>(n - 1 - k);
+    }
+
+    std::vector<glm::vec3> positions(n);
+    for (size_t v = 0; v < n; v++) positions[newIndex[v]] = restPositions[v];
+    restPositions.swap(positions);
+    for (int& v : faceVertices) v = newIndex[v];
+    for (unsigned int& v : triangles) v = newIndex[v];
+}
+
+void ClothTopology::buildSprings(float stiffness, std::vector<Spring>& springs) const {
+    struct Candidate {
+        uint64_t key;
+        int priority;
+        float stiffness;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(faceVertices.size() * 3);
+
+    for (size_t f = 0; f + 1 < faceStart.size(); f++) {
+        const int* v = faceVertices.data() + faceStart[f];
+        int count = faceStart[f + 1] - faceStart[f];
+        for (int k = 0; k < count; k++) {
+            candidates.push_back({pairKey(v[k], v[(k + 1) % count]), 0, stiffness});
+        }
+        // Quads get both diagonals; larger polygons the fan diagonals.
+        if (count == 4) {
+            candidates.push_back({pairKey(v[0], v[2]), 1, stiffness});
+            candidates.push_back({pairKey(v[1], v[3]), 1, stiffness});
+        } else {
+            for (int k = 2; k < count - 1; k++) {
+                candidates.push_back({pairKey(v[0], v[k]), 1, stiffness});
+            }
+        }
+    }
+
+    // Triangles sharing an edge: pair up the two vertices opposite it.
+    std::vector<std::pair<uint64_t, int>> edgeOpposites;
+    edgeOpposites.reserve(triangles.size());
+    for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            int a = triangles[t + k];
+            int b = triangles[t + (k + 1) % 3];
+            int opposite = triangles[t + (k + 2) % 3];
+            edgeOpposites.push_back({pairKey(a, b), opposite});
+        }
+    }
+    std::sort(edgeOpposites.begin(), edgeOpposites.end());
+    for (size_t e = 0; e < edgeOpposites.size();) {
+        size_t run = e + 1;
+        while (run < edgeOpposites.size() && edgeOpposites[run].first == edgeOpposites[e].first) run++;
+        if (run - e == 2) {
+            candidates.push_back({pairKey(edgeOpposites[e].second, edgeOpposites[e + 1].second), 2, stiffness * 0.5f});
+        }
+        e = run;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.key != b.key ? a.key < b.key : a.priority < b.priority;
+    });
+
+    springs.clear();
+    uint64_t previous = ~uint64_t(0);
+    for (const Candidate& c : candidates) {
+        if (c.key == previous) continue;
+        previous = c.key;
+
+        int a = static_cast<int>(c.key >> 32);
+        int b = static_cast<int>(c.key & 0xffffffffu);
+        if (a == b) continue;
+        springs.push_back(Spring(a, b, glm::distance(restPositions[a], restPositions[b]), c.stiffness));
+    }
+}
+
+float ClothTopology::meanEdgeLength() const {
+    double total = 0.0;
+    size_t edges = 0;
+    for (size_t f = 0; f + 1 < faceStart.size(); f++) {
+        int first = faceStart[f];
+        int count = faceStart[f + 1] - first;
+        for (int k = 0; k < count; k++) {
+            int a = faceVertices[first + k];
+            int b = faceVertices[first + (k + 1) % count];
+            total += glm::distance(restPositions[a], restPositions[b]);
+            edges++;
+        }
+    }
+    return edges ? static_cast<float>(total / edges) : 0.0f;
+}
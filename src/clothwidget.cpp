@@ -1,31 +1,42 @@
 #include "clothwidget.h"
+#include "clothprofiler.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <QTime>
 #include <QOpenGLContext>
 #include <QOpenGLVersionFunctionsFactory>
 #include <QPainter>
 
-extern bool gravityEnabled;
-
-ClothWidget::ClothWidget(QWidget *parent)
+ClothWidget::ClothWidget(QWidget *parent, const std::string& meshPath)
     : QOpenGLWidget(parent),
-      cloth(20, 20, 0.1f, 50.0f, 20.0f),
+      simulation(20, 20, 0.1f, 50.0f, 20.0f),
       cameraPos(1.0f, 1.0f, 3.0f),
       cameraTarget(1.0f, 1.0f, 0.0f),
       cameraUp(0.0f, 1.0f, 0.0f),
       mousePressed(false),
       windEnabled(false),
       windPending(false),
-      lastFrameTime(QTime::currentTime().msecsSinceStartOfDay() / 1000.0f)
+      recordingPath("cloth_recording.clrec"),
+      recording(false),
+      playbackIndex(0),
+      profilePath("cloth_profile.csv"),
+      tracePath("cloth_trace.json")
 {
+    ClothProfiler::setThreadName("gui");
     setFocusPolicy(Qt::StrongFocus);
+    if (!meshPath.empty()) {
+        simulation.post(SimCommand::loadMesh(meshPath));
+    }
+    simulation.start();
+
     timer.setInterval(16);
     connect(&timer, &QTimer::timeout, this, &ClothWidget::updateSimulation);
     timer.start();
 }
 
-ClothWidget::~ClothWidget() {}
+ClothWidget::~ClothWidget() {
+    simulation.stop();
+    if (ClothProfiler::enabled()) ClothProfiler::writeChromeTrace(tracePath);
+}
 
 void ClothWidget::initializeGL() {
     QOpenGLFunctions_3_3_Core* coreFuncs =
@@ -49,34 +60,107 @@ void ClothWidget::paintGL() {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(width()) / height(), 0.1f, 100.0f);
-    glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, cameraUp);
+    glm::mat4 projection = projectionMatrix();
+    glm::mat4 view = viewMatrix();
 
     QPainter painter(this);
     painter.setPen(Qt::white);
     painter.drawText(10, 20, "WASD = Move Camera | QE = Zoom | F = Wind | Mouse = Grab | R = Reset");
     painter.drawText(10, 40, "1-4 = Shading Modes: 1=Basic 2=Enhanced 3=Height 4=Fresnel");
+    painter.drawText(10, 60, "K = Record | P = Playback | T = Timings | C = Save timings | X = Save trace");
+    if (recording) painter.drawText(10, 80, "Recording");
+    if (playback.isOpen()) {
+        painter.drawText(10, 80, QString("Playback %1/%2").arg(static_cast<int>(playbackIndex + 1)).arg(static_cast<int>(playback.frameCount())));
+    }
+    if (ClothProfiler::enabled()) {
+        // Last second's mean time per call and calls per second.
+        ProfileSummary summary;
+        ClothProfiler::summarize(1.0, summary);
+        for (size_t phase = 0; phase < static_cast<size_t>(ProfilePhase::Count); phase++) {
+            painter.drawText(10, 100 + 20 * static_cast<int>(phase),
+                             QString("%1  %2 ms x %3/s").arg(QString(profilePhaseName(static_cast<ProfilePhase>(phase))), -10)
+                                 .arg(summary.milliseconds[phase], 0, 'f', 3).arg(summary.calls[phase]));
+        }
+    }
     painter.end();
 
-    renderer.render(cloth, cloth.getParticles(), projection, view);
+    if (playback.isOpen()) {
+        if (playback.readFrame(playbackIndex, playbackFrame)) {
+            // Recordings hold positions only; draw them on the live cloth's
+            // mesh when they match it.
+            if (simulation.snapshot().size() == playbackFrame.size()) {
+                playbackFrame.topology = simulation.snapshot().topology;
+            }
+            renderer.render(playbackFrame, projection, view);
+        }
+        playbackIndex = (playbackIndex + 1) % playback.frameCount();
+        return;
+    }
+
+    // Draw the newest finished step; if the solver has not published a new
+    // one since the last frame, the previous snapshot is drawn again.
+    simulation.acquireSnapshot();
+    renderer.render(simulation.snapshot(), projection, view);
+}
+
+glm::mat4 ClothWidget::projectionMatrix() const {
+    return glm::perspective(glm::radians(45.0f), float(width()) / height(), 0.1f, 100.0f);
+}
+
+glm::mat4 ClothWidget::viewMatrix() const {
+    return glm::lookAt(cameraPos, cameraTarget, cameraUp);
+}
+
+void ClothWidget::cameraRay(glm::vec2 pixel, glm::vec3& origin, glm::vec3& direction) const {
+    glm::mat4 inverse = glm::inverse(projectionMatrix() * viewMatrix());
+    float ndcX = 2.0f * pixel.x / width() - 1.0f;
+    float ndcY = 1.0f - 2.0f * pixel.y / height();
+
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
+void ClothWidget::postMouse(bool pressed) {
+    glm::vec3 origin, direction;
+    cameraRay(mousePos, origin, direction);
+    simulation.post(SimCommand::mouseRay(origin, direction, pressed));
 }
 
 void ClothWidget::updateSimulation() {
-    float currentTime = QTime::currentTime().msecsSinceStartOfDay() / 1000.0f;
-    deltaTime = currentTime - lastFrameTime;
-    lastFrameTime = currentTime;
+    ProfileScope scope(ProfilePhase::Tick);
+    // The solver runs on its own thread; the timer only drives repaints.
+    update();
+}
 
-    if (mousePressed) {
-        cloth.applymouseconstraint(mousePos, true);
-    }
+void ClothWidget::toggleRecording() {
+    if (playback.isOpen()) return;
+
+    recording = !recording;
+    simulation.post(SimCommand::record(recording ? recordingPath : std::string()));
+}
 
-    if (windEnabled && mousePressed) {
-        cloth.applywind(deltaTime);
+void ClothWidget::togglePlayback() {
+    if (playback.isOpen()) {
+        playback.close();
+        simulation.start();
+        return;
     }
 
-    cloth.update(deltaTime);
+    // Stopping the solver also finishes any recording in progress.
+    if (recording) {
+        simulation.post(SimCommand::record(std::string()));
+        recording = false;
+    }
+    simulation.stop();
 
-    update();
+    if (!playback.open(recordingPath) || playback.frameCount() == 0) {
+        playback.close();
+        simulation.start();
+        return;
+    }
+    playbackIndex = 0;
 }
 
 void ClothWidget::keyPressEvent(QKeyEvent *event) {
@@ -102,16 +186,33 @@ void ClothWidget::keyPressEvent(QKeyEvent *event) {
             break;
         case Qt::Key_F:
             windEnabled = !windEnabled;
+            simulation.post(SimCommand::wind(windEnabled));
             break;
         case Qt::Key_R:
-            cloth.reset();
-            gravityEnabled = false;
+            simulation.post(SimCommand::reset());
+            simulation.post(SimCommand::gravity(false));
+            simulation.post(SimCommand::wind(false));
             windEnabled = false;
             windPending = false;
             cameraPos = glm::vec3(1.0f, 1.0f, 3.0f);
             cameraTarget = glm::vec3(1.0f, 1.0f, 0.0f);
             cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
             break;
+        case Qt::Key_K:
+            toggleRecording();
+            break;
+        case Qt::Key_P:
+            togglePlayback();
+            break;
+        case Qt::Key_T:
+            ClothProfiler::setEnabled(!ClothProfiler::enabled());
+            break;
+        case Qt::Key_C:
+            ClothProfiler::writeCsv(profilePath);
+            break;
+        case Qt::Key_X:
+            ClothProfiler::writeChromeTrace(tracePath);
+            break;
         case Qt::Key_1:
             renderer.setShadingMode(0);
             break;
@@ -130,17 +231,23 @@ void ClothWidget::keyPressEvent(QKeyEvent *event) {
 }
 
 void ClothWidget::mousePressEvent(QMouseEvent *event) {
+        if (playback.isOpen()) return;
+        mousePos = glm::vec2(static_cast<float>(event->pos().x()), static_cast<float>(event->pos().y()));
         mousePressed = true;
-        gravityEnabled = true;
+        postMouse(true);
+        simulation.post(SimCommand::gravity(true));
 }
 
 void ClothWidget::mouseReleaseEvent(QMouseEvent *event) {
     if (event->button() == Qt::LeftButton) {
         mousePressed = false;
+        postMouse(false);
     }
 }
 
 void ClothWidget::mouseMoveEvent(QMouseEvent *event) {
     mousePos.x = static_cast<float>(event->pos().x());
     mousePos.y = static_cast<float>(event->pos().y());
+    if (playback.isOpen()) return;
+    postMouse(mousePressed);
 }
@@ -0,0 +1,258 @@
+#include "implicitsolver.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const size_t rowChunk = 4096;
+const size_t springChunk = 2048;
+
+template <typename Body>
+void forRows(ThreadPool* pool, size_t count, size_t grain, const Body& body) {
+    if (pool) {
+        pool->parallelFor(count, grain, body);
+    } else {
+        body(0, count);
+    }
+}
+
+}
+
+bool ImplicitSolver::hasPattern(size_t particleCount, size_t springCount) const {
+    return matrix.rows() == particleCount && patternSprings == springCount && !matrix.rowStart.empty();
+}
+
+void ImplicitSolver::buildPattern(size_t particleCount, const std::vector<Spring>& springs) {
+    std::vector<std::vector<int>> neighbours(particleCount);
+    for (size_t i = 0; i < particleCount; i++) {
+        neighbours[i].push_back(static_cast<int>(i));
+    }
+    for (const Spring& s : springs) {
+        neighbours[s.p1].push_back(s.p2);
+        neighbours[s.p2].push_back(s.p1);
+    }
+
+    matrix.rowStart.assign(particleCount + 1, 0);
+    matrix.columns.clear();
+    matrix.diagonal.assign(particleCount, 0);
+    for (size_t i = 0; i < particleCount; i++) {
+        std::vector<int>& row = neighbours[i];
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+
+        matrix.rowStart[i] = static_cast<int>(matrix.columns.size());
+        for (int column : row) {
+            if (column == static_cast<int>(i)) matrix.diagonal[i] = static_cast<int>(matrix.columns.size());
+            matrix.columns.push_back(column);
+        }
+    }
+    matrix.rowStart[particleCount] = static_cast<int>(matrix.columns.size());
+    matrix.blocks.assign(matrix.columns.size(), glm::mat3(0.0f));
+
+    auto blockIndex = [this](int row, int column) {
+        auto first = matrix.columns.begin() + matrix.rowStart[row];
+        auto last = matrix.columns.begin() + matrix.rowStart[row + 1];
+        return static_cast<int>(std::lower_bound(first, last, column) - matrix.columns.begin());
+    };
+
+    springBlocks.resize(springs.size() * 4);
+    for (size_t k = 0; k < springs.size(); k++) {
+        const Spring& s = springs[k];
+        springBlocks[k * 4 + 0] = matrix.diagonal[s.p1];
+        springBlocks[k * 4 + 1] = blockIndex(s.p1, s.p2);
+        springBlocks[k * 4 + 2] = blockIndex(s.p2, s.p1);
+        springBlocks[k * 4 + 3] = matrix.diagonal[s.p2];
+    }
+    patternSprings = springs.size();
+
+    for (std::vector<glm::vec3>* v : {&velocity, &rhs, &deltaVelocity, &residual, &preconditioned, &direction, &product}) {
+        v->assign(particleCount, glm::vec3(0.0f));
+    }
+    inverseDiagonal.assign(particleCount, glm::mat3(0.0f));
+    partialSums.assign((particleCount + rowChunk - 1) / rowChunk, 0.0f);
+}
+
+void ImplicitSolver::step(ParticleState& particles, const std::vector<Spring>& springs,
+                          const std::vector<size_t>& colorOffsets, float stiffness, float damping,
+                          float timeStep, ThreadPool* pool) {
+    if (!hasPattern(particles.size(), springs.size())) {
+        buildPattern(particles.size(), springs);
+    }
+
+    assemble(particles, springs, colorOffsets, stiffness, damping, timeStep, pool);
+    solve(particles, pool);
+
+    forRows(pool, particles.size(), rowChunk, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            particles.setForce(i, glm::vec3(0.0f));
+            if (particles.invMass[i] == 0.0f) continue;
+
+            glm::vec3 position = particles.position(i);
+            glm::vec3 newVelocity = velocity[i] + deltaVelocity[i];
+            particles.setPreviousPosition(i, position);
+            particles.setPosition(i, position + newVelocity * timeStep);
+        }
+    });
+}
+
+void ImplicitSolver::assemble(const ParticleState& particles, const std::vector<Spring>& springs,
+                              const std::vector<size_t>& colorOffsets, float stiffness, float damping,
+                              float timeStep, ThreadPool* pool) {
+    const float invTimeStep = 1.0f / timeStep;
+
+    forRows(pool, particles.size(), rowChunk, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            for (int b = matrix.rowStart[i]; b < matrix.rowStart[i + 1]; b++) {
+                matrix.blocks[b] = glm::mat3(0.0f);
+            }
+
+            bool pinned = particles.invMass[i] == 0.0f;
+            matrix.blocks[matrix.diagonal[i]] = glm::mat3(pinned ? 1.0f : particles.mass[i]);
+            velocity[i] = (particles.position(i) - particles.previousPosition(i)) * invTimeStep;
+            rhs[i] = pinned ? glm::vec3(0.0f) : particles.force(i) * timeStep;
+        }
+    });
+
+    // Springs of one color share no particle, so their blocks can be
+    // accumulated in parallel.
+    for (size_t c = 0; c + 1 < colorOffsets.size(); c++) {
+        const size_t first = colorOffsets[c];
+        const size_t count = colorOffsets[c + 1] - first;
+        forRows(pool, count, springChunk, [&](size_t begin, size_t end) {
+            assembleSprings(particles, springs, first + begin, first + end, stiffness, damping, timeStep);
+        });
+    }
+
+    forRows(pool, particles.size(), rowChunk, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            inverseDiagonal[i] = particles.invMass[i] == 0.0f ? glm::mat3(0.0f)
+                                                               : glm::inverse(matrix.blocks[matrix.diagonal[i]]);
+        }
+    });
+}
+
+void ImplicitSolver::assembleSprings(const ParticleState& particles, const std::vector<Spring>& springs,
+                                     size_t first, size_t last, float stiffness, float damping, float timeStep) {
+    const glm::mat3 identity(1.0f);
+
+    for (size_t k = first; k < last; k++) {
+        const Spring& s = springs[k];
+        glm::vec3 delta = particles.position(s.p2) - particles.position(s.p1);
+        float length = glm::length(delta);
+        if (length < 1e-6f) continue;
+
+        glm::vec3 direction = delta / length;
+        glm::mat3 projection = glm::outerProduct(direction, direction);
+
+        // Dropping the transverse term under compression keeps the stiffness
+        // matrix positive semi-definite, which CG needs.
+        float transverse = std::max(0.0f, 1.0f - s.restLength / length);
+        glm::mat3 elastic = stiffness * (projection + transverse * (identity - projection));
+
+        glm::vec3 relativeVelocity = velocity[s.p2] - velocity[s.p1];
+        glm::vec3 force = stiffness * (length - s.restLength) * direction +
+                          damping * glm::dot(relativeVelocity, direction) * direction;
+
+        glm::mat3 block = (timeStep * damping) * projection + (timeStep * timeStep) * elastic;
+        const int* blocks = &springBlocks[k * 4];
+        matrix.blocks[blocks[0]] += block;
+        matrix.blocks[blocks[1]] -= block;
+        matrix.blocks[blocks[2]] -= block;
+        matrix.blocks[blocks[3]] += block;
+
+        glm::vec3 elasticVelocity = (timeStep * timeStep) * (elastic * relativeVelocity);
+        if (particles.invMass[s.p1] > 0.0f) rhs[s.p1] += force * timeStep + elasticVelocity;
+        if (particles.invMass[s.p2] > 0.0f) rhs[s.p2] -= force * timeStep + elasticVelocity;
+    }
+}
+
+void ImplicitSolver::multiply(const std::vector<glm::vec3>& in, std::vector<glm::vec3>& out, size_t first, size_t last) const {
+    for (size_t i = first; i < last; i++) {
+        glm::vec3 sum(0.0f);
+        for (int b = matrix.rowStart[i]; b < matrix.rowStart[i + 1]; b++) {
+            sum += matrix.blocks[b] * in[matrix.columns[b]];
+        }
+        out[i] = sum;
+    }
+}
+
+float ImplicitSolver::dot(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b, ThreadPool* pool) {
+    // Fixed chunks summed in order, so the result does not depend on the
+    // thread count.
+    const size_t count = a.size();
+    auto partial = [&](size_t first, size_t last) {
+        double sum = 0.0;
+        for (size_t i = first; i < last; i++) {
+            sum += glm::dot(a[i], b[i]);
+        }
+        partialSums[first / rowChunk] = static_cast<float>(sum);
+    };
+
+    if (pool) {
+        pool->parallelFor(count, rowChunk, partial);
+    } else {
+        for (size_t first = 0; first < count; first += rowChunk) {
+            partial(first, std::min(count, first + rowChunk));
+        }
+    }
+
+    double total = 0.0;
+    for (float sum : partialSums) total += sum;
+    return static_cast<float>(total);
+}
+
+void ImplicitSolver::solve(const ParticleState& particles, ThreadPool* pool) {
+    const size_t count = particles.size();
+
+    forRows(pool, count, rowChunk, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            deltaVelocity[i] = glm::vec3(0.0f);
+            residual[i] = rhs[i];
+            preconditioned[i] = inverseDiagonal[i] * residual[i];
+            direction[i] = preconditioned[i];
+        }
+    });
+
+    const float rhsNorm = std::sqrt(dot(rhs, rhs, pool));
+    float rz = dot(residual, preconditioned, pool);
+    lastIterations = 0;
+    lastResidual = 0.0f;
+    if (rhsNorm == 0.0f) return;
+
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        // Pinned rows are filtered out of the product so their velocity
+        // change stays zero.
+        forRows(pool, count, rowChunk, [&](size_t first, size_t last) {
+            multiply(direction, product, first, last);
+            for (size_t i = first; i < last; i++) {
+                if (particles.invMass[i] == 0.0f) product[i] = glm::vec3(0.0f);
+            }
+        });
+
+        float curvature = dot(direction, product, pool);
+        if (curvature <= 0.0f) break;
+        float alpha = rz / curvature;
+
+        forRows(pool, count, rowChunk, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                deltaVelocity[i] += alpha * direction[i];
+                residual[i] -= alpha * product[i];
+                preconditioned[i] = inverseDiagonal[i] * residual[i];
+            }
+        });
+
+        lastIterations = iteration + 1;
+        lastResidual = std::sqrt(dot(residual, residual, pool)) / rhsNorm;
+        if (lastResidual <= tolerance) break;
+
+        float rzNext = dot(residual, preconditioned, pool);
+        float beta = rzNext / rz;
+        rz = rzNext;
+
+        forRows(pool, count, rowChunk, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                direction[i] = preconditioned[i] + beta * direction[i];
+            }
+        });
+    }
+}
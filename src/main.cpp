@@ -5,9 +5,9 @@
 
 class ClothWindow : public QMainWindow {
 public:
-    ClothWindow(QWidget* parent = nullptr) : QMainWindow(parent) {
+    ClothWindow(const std::string& meshPath, QWidget* parent = nullptr) : QMainWindow(parent) {
         setWindowTitle("Cloth Simulation");
-        clothWidget = new ClothWidget(this);
+        clothWidget = new ClothWidget(this, meshPath);
         setCentralWidget(clothWidget);
         resize(800, 600);
     }
@@ -26,7 +26,8 @@ private:
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
-    ClothWindow window;
+    // An optional argument names an OBJ cloth mesh to load.
+    ClothWindow window(argc > 1 ? argv[1] : std::string());
     window.show();
     return app.exec();
 }
\ No newline at end of file
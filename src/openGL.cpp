@@ -1,8 +1,11 @@
 #include "openGL.h"
+#include "clothprofiler.h"
 #include <QOpenGLFunctions> 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 ClothRenderer::ClothRenderer() 
     : vao(0), vbo(0), ebo(0), shaderProgram(0) {
@@ -207,139 +210,62 @@ void ClothRenderer::initialize(QOpenGLFunctions_3_3_Core* funcs) {
     gl->glGenVertexArrays(1, &vao);
     gl->glGenBuffers(1, &vbo);
     gl->glGenBuffers(1, &ebo);
-}
-
-void ClothRenderer::setShadingMode(int mode) {
-    currentShadingMode = mode;
-}
-
-float ClothRenderer::calculateCurvature(const std::vector<Particle>& particles, int index, int width, int height) {
-    int x = index % width;
-    int y = index / width;
-    
-    if (x < 2 || x >= width - 2 || y < 2 || y >= height - 2) {
-        return 0.0f;
-    }
-    
-    glm::vec3 center = particles[index].position;
-    
-    glm::vec3 left2 = particles[y * width + (x - 2)].position;
-    glm::vec3 left1 = particles[y * width + (x - 1)].position;
-    glm::vec3 right1 = particles[y * width + (x + 1)].position;
-    glm::vec3 right2 = particles[y * width + (x + 2)].position;
-    
-    glm::vec3 up2 = particles[(y - 2) * width + x].position;
-    glm::vec3 up1 = particles[(y - 1) * width + x].position;
-    glm::vec3 down1 = particles[(y + 1) * width + x].position;
-    glm::vec3 down2 = particles[(y + 2) * width + x].position;
-    
-    float curvatureX = glm::length((left2 - 2.0f * left1 + center) + (center - 2.0f * right1 + right2));
-    float curvatureY = glm::length((up2 - 2.0f * up1 + center) + (center - 2.0f * down1 + down2));
-    
-    return (curvatureX + curvatureY) * 0.5f;
-}
-
-void ClothRenderer::calculateNormalsAndCurvature(std::vector<float>& vertices, const std::vector<Particle>& particles, int width, int height) {
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int index = y * width + x;
-            
-            glm::vec3 normal(0.0f, 1.0f, 0.0f);
-            int normalCount = 0;
-            
-            if (x < width - 1 && y < height - 1) {
-                glm::vec3 p0 = particles[index].position;
-                glm::vec3 p1 = particles[index + 1].position;
-                glm::vec3 p2 = particles[index + width].position;
-                
-                glm::vec3 v1 = p1 - p0;
-                glm::vec3 v2 = p2 - p0;
-                glm::vec3 triNormal = glm::normalize(glm::cross(v1, v2));
-                
-                normal += triNormal;
-                normalCount++;
-            }
-            
-            if (x > 0 && y < height - 1) {
-                glm::vec3 p0 = particles[index].position;
-                glm::vec3 p1 = particles[index + width].position;
-                glm::vec3 p2 = particles[index - 1].position;
-                
-                glm::vec3 v1 = p1 - p0;
-                glm::vec3 v2 = p2 - p0;
-                glm::vec3 triNormal = glm::normalize(glm::cross(v1, v2));
-                
-                normal += triNormal;
-                normalCount++;
-            }
-            
-            if (normalCount > 0) {
-                normal = glm::normalize(normal / float(normalCount));
-            }
-            
-            float curvature = calculateCurvature(particles, index, width, height);
-            
-            int vertexIndex = index * 7;
-            vertices[vertexIndex + 3] = normal.x;
-            vertices[vertexIndex + 4] = normal.y;
-            vertices[vertexIndex + 5] = normal.z;
-            vertices[vertexIndex + 6] = curvature;
-        }
-    }
-}
-
-void ClothRenderer::updateBuffers(const std::vector<Particle>& particles, int width, int height) {
-    vertices.clear();
-    vertices.resize(particles.size() * 7, 0.0f);
-    for (size_t i = 0; i < particles.size(); i++) {
-        vertices[i * 7 + 0] = particles[i].position.x;
-        vertices[i * 7 + 1] = particles[i].position.y;
-        vertices[i * 7 + 2] = particles[i].position.z;
-    }
-
-    calculateNormalsAndCurvature(vertices, particles, width, height);
-
-    indices.clear();
-    for (int y = 0; y < height - 1; y++) {
-        for (int x = 0; x < width - 1; x++) {
-            int i0 = y * width + x;
-            int i1 = i0 + 1;
-            int i2 = i0 + width;
-            int i3 = i2 + 1;
-
-            indices.push_back(i0);
-            indices.push_back(i2);
-            indices.push_back(i3);
-            indices.push_back(i0);
-            indices.push_back(i3);
-            indices.push_back(i1);
-        }
-    }
 
+    uploads.glBufferData = [this](unsigned target, std::ptrdiff_t size, const void* data, unsigned usage) {
+        gl->glBufferData(target, size, data, usage);
+    };
+    uploads.glBufferSubData = [this](unsigned target, std::ptrdiff_t offset, std::ptrdiff_t size, const void* data) {
+        gl->glBufferSubData(target, offset, size, data);
+    };
+    uploads.glMapBufferRange = [this](unsigned target, std::ptrdiff_t offset, std::ptrdiff_t length, unsigned access) {
+        return gl->glMapBufferRange(target, offset, length, access);
+    };
+    uploads.glUnmapBuffer = [this](unsigned target) {
+        return gl->glUnmapBuffer(target) == GL_TRUE;
+    };
+
+    // Mesh derivation shares the machine with the simulation thread, so it
+    // only takes half of the cores.
+    unsigned cores = std::thread::hardware_concurrency();
+    meshWorkers = std::make_unique<ThreadPool>(std::max(1u, cores / 2));
+
+    // The vertex layout never changes, so the VAO is recorded once here.
+    const GLsizei stride = ClothMesh::floatsPerVertex * sizeof(float);
     gl->glBindVertexArray(vao);
-
     gl->glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    gl->glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
-
     gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
 
-    gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)0);
+    gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
     gl->glEnableVertexAttribArray(0);
 
-    gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(3 * sizeof(float)));
+    gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
     gl->glEnableVertexAttribArray(1);
 
-    gl->glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(6 * sizeof(float)));
+    gl->glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     gl->glEnableVertexAttribArray(2);
 
     gl->glBindVertexArray(0);
 }
 
-void ClothRenderer::render(const Cloth& cloth, const std::vector<Particle>& particles, 
-                          const glm::mat4& projection, const glm::mat4& view) {
-    updateBuffers(particles, cloth.width, cloth.height);
+void ClothRenderer::setShadingMode(int mode) {
+    currentShadingMode = mode;
+}
+
+void ClothRenderer::updateBuffers(const ClothSnapshot& snapshot) {
+    uploads.beginFrame();
+    gl->glBindVertexArray(vao);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    mesh.upload(uploads, snapshot, meshWorkers.get());
+    gl->glBindVertexArray(0);
+}
+
+void ClothRenderer::render(const ClothSnapshot& snapshot, const glm::mat4& projection, const glm::mat4& view) {
+    if (snapshot.size() == 0) return;
+    ProfileScope frame(ProfilePhase::Render);
+
+    updateBuffers(snapshot);
 
+    ProfileScope scope(ProfilePhase::Draw);
     gl->glUseProgram(shaderProgram);
 
     glm::mat4 model = glm::mat4(1.0f);
@@ -367,7 +293,7 @@ void ClothRenderer::render(const Cloth& cloth, const std::vector<Particle>& part
     gl->glEnable(GL_DEPTH_TEST);
     gl->glPolygonOffset(1.0f, 1.0f);
 
-    gl->glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    gl->glDrawElements(GL_TRIANGLES, mesh.getIndices().size(), GL_UNSIGNED_INT, 0);
 
     gl->glDisable(GL_POLYGON_OFFSET_FILL);
     gl->glBindVertexArray(0);
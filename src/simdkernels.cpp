@@ -0,0 +1,797 @@
+#include "simdkernels.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CLOTH_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CLOTH_TARGET_AVX2
+#else
+#define CLOTH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CLOTH_SIMD_X86 0
+#endif
+
+// The AVX2 spring kernel gathers p1, p2 and restLength straight out of the
+// Spring array, so its layout has to stay four 32-bit words.
+static_assert(sizeof(Spring) == 4 * sizeof(int), "Spring layout changed");
+static_assert(offsetof(Spring, p1) == 0 && offsetof(Spring, p2) == 4 && offsetof(Spring, restLength) == 8,
+              "Spring layout changed");
+
+SimdLevel detectSimdLevel() {
+#if CLOTH_SIMD_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) return SimdLevel::AVX2;
+    }
+    return SimdLevel::SSE;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    return SimdLevel::SSE;
+#endif
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::SSE:
+            return "sse";
+        default:
+            return "scalar";
+    }
+}
+
+// One spring of the scalar kernels, shared by the list and stencil forms.
+static inline void springForce(ParticleState& particles, size_t p1, size_t p2, float restLength, float stiffness, float damping) {
+    float invMass1 = particles.invMass[p1];
+    float invMass2 = particles.invMass[p2];
+
+    if (invMass1 == 0.0f && invMass2 == 0.0f) return;
+
+    glm::vec3 position1 = particles.position(p1);
+    glm::vec3 position2 = particles.position(p2);
+
+    glm::vec3 delta = position2 - position1;
+    float currentLength = glm::length(delta);
+
+    if (currentLength < 1e-6f) return;
+
+    glm::vec3 direction = delta / currentLength;
+
+    float displacement = currentLength - restLength;
+    glm::vec3 force = stiffness * displacement * direction;
+
+    glm::vec3 velocity1 = position1 - particles.previousPosition(p1);
+    glm::vec3 velocity2 = position2 - particles.previousPosition(p2);
+    glm::vec3 relativeVelocity = velocity2 - velocity1;
+
+    float velocityAlongSpring = glm::dot(relativeVelocity, direction);
+    glm::vec3 dampingForce = damping * velocityAlongSpring * direction;
+
+    if (invMass1 > 0.0f) particles.addForce(p1, force + dampingForce);
+    if (invMass2 > 0.0f) particles.addForce(p2, -(force + dampingForce));
+}
+
+void springForcesScalar(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    for (size_t k = first; k < last; k++) {
+        const Spring& s = springs[k];
+        springForce(particles, s.p1, s.p2, s.restLength, stiffness, damping);
+    }
+}
+
+void stencilForcesScalar(ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    for (size_t j = 0; j < run.count; j++) {
+        size_t p1 = run.first + j * run.stride;
+        springForce(particles, p1, p1 + run.offset, run.restLength, stiffness, damping);
+    }
+}
+
+void integrateScalar(ParticleState& particles, size_t first, size_t last, float timeStep) {
+    for (size_t i = first; i < last; i++) {
+        if (particles.invMass[i] == 0.0f) continue;
+
+        glm::vec3 acceleration = particles.force(i) * particles.invMass[i];
+
+        glm::vec3 temp = particles.position(i);
+        glm::vec3 position = temp * 2.0f - particles.previousPosition(i) + acceleration * timeStep * timeStep;
+        glm::vec3 previousPosition = temp;
+
+        particles.setForce(i, glm::vec3(0.0f));
+
+        if (position.y < 0.0f) {
+            position.y = 0.0f;
+            glm::vec3 velocity = position - previousPosition;
+            previousPosition = position - velocity * 0.1f;
+        }
+
+        particles.setPosition(i, position);
+        particles.setPreviousPosition(i, previousPosition);
+    }
+}
+
+void faceNormalsScalar(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    for (size_t q = first; q < last; q++) {
+        size_t i1 = q + 1;
+        size_t i2 = q + stride;
+        size_t i3 = i2 + 1;
+
+        float e1x = x[i1] - x[q], e1y = y[i1] - y[q], e1z = z[i1] - z[q];
+        float e2x = x[i2] - x[q], e2y = y[i2] - y[q], e2z = z[i2] - z[q];
+        float e3x = x[i3] - x[q], e3y = y[i3] - y[q], e3z = z[i3] - z[q];
+
+        // A = (p3 - p0) x (p2 - p0), B = (p1 - p0) x (p3 - p0)
+        out.ax[q] = e3y * e2z - e3z * e2y;
+        out.ay[q] = e3z * e2x - e3x * e2z;
+        out.az[q] = e3x * e2y - e3y * e2x;
+        out.bx[q] = e1y * e3z - e1z * e3y;
+        out.by[q] = e1z * e3x - e1x * e3z;
+        out.bz[q] = e1x * e3y - e1y * e3x;
+    }
+}
+
+#if CLOTH_SIMD_X86
+
+// SSE2 has no blend instruction; pick b where mask is set, a elsewhere.
+static inline __m128 select128(__m128 a, __m128 b, __m128 mask) {
+    return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+}
+
+void springForcesSse(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const float* prevX = particles.prevX.data();
+    const float* prevY = particles.prevY.data();
+    const float* prevZ = particles.prevZ.data();
+    const float* invMass = particles.invMass.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minLength = _mm_set1_ps(1e-6f);
+    const __m128 k = _mm_set1_ps(stiffness);
+    const __m128 d = _mm_set1_ps(damping);
+
+    alignas(16) float out1X[4], out1Y[4], out1Z[4];
+    alignas(16) float out2X[4], out2Y[4], out2Z[4];
+
+    size_t s = first;
+    for (; s + 4 <= last; s += 4) {
+        const Spring* block = springs + s;
+        int a0 = block[0].p1, a1 = block[1].p1, a2 = block[2].p1, a3 = block[3].p1;
+        int b0 = block[0].p2, b1 = block[1].p2, b2 = block[2].p2, b3 = block[3].p2;
+
+        __m128 x1 = _mm_setr_ps(x[a0], x[a1], x[a2], x[a3]);
+        __m128 y1 = _mm_setr_ps(y[a0], y[a1], y[a2], y[a3]);
+        __m128 z1 = _mm_setr_ps(z[a0], z[a1], z[a2], z[a3]);
+        __m128 x2 = _mm_setr_ps(x[b0], x[b1], x[b2], x[b3]);
+        __m128 y2 = _mm_setr_ps(y[b0], y[b1], y[b2], y[b3]);
+        __m128 z2 = _mm_setr_ps(z[b0], z[b1], z[b2], z[b3]);
+        __m128 rest = _mm_setr_ps(block[0].restLength, block[1].restLength, block[2].restLength, block[3].restLength);
+
+        __m128 dx = _mm_sub_ps(x2, x1);
+        __m128 dy = _mm_sub_ps(y2, y1);
+        __m128 dz = _mm_sub_ps(z2, z1);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 valid = _mm_cmpnlt_ps(length, minLength);
+
+        __m128 dirX = _mm_div_ps(dx, length);
+        __m128 dirY = _mm_div_ps(dy, length);
+        __m128 dirZ = _mm_div_ps(dz, length);
+
+        __m128 spring = _mm_mul_ps(k, _mm_sub_ps(length, rest));
+
+        __m128 relX = _mm_sub_ps(_mm_sub_ps(x2, _mm_setr_ps(prevX[b0], prevX[b1], prevX[b2], prevX[b3])),
+                                 _mm_sub_ps(x1, _mm_setr_ps(prevX[a0], prevX[a1], prevX[a2], prevX[a3])));
+        __m128 relY = _mm_sub_ps(_mm_sub_ps(y2, _mm_setr_ps(prevY[b0], prevY[b1], prevY[b2], prevY[b3])),
+                                 _mm_sub_ps(y1, _mm_setr_ps(prevY[a0], prevY[a1], prevY[a2], prevY[a3])));
+        __m128 relZ = _mm_sub_ps(_mm_sub_ps(z2, _mm_setr_ps(prevZ[b0], prevZ[b1], prevZ[b2], prevZ[b3])),
+                                 _mm_sub_ps(z1, _mm_setr_ps(prevZ[a0], prevZ[a1], prevZ[a2], prevZ[a3])));
+        __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(relX, dirX), _mm_mul_ps(relY, dirY)), _mm_mul_ps(relZ, dirZ));
+        __m128 damp = _mm_mul_ps(d, along);
+
+        __m128 totalX = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirX), _mm_mul_ps(damp, dirX)), valid);
+        __m128 totalY = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirY), _mm_mul_ps(damp, dirY)), valid);
+        __m128 totalZ = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirZ), _mm_mul_ps(damp, dirZ)), valid);
+
+        // Pinned endpoints receive +0 instead of being skipped.
+        __m128 movable1 = _mm_cmpgt_ps(_mm_setr_ps(invMass[a0], invMass[a1], invMass[a2], invMass[a3]), zero);
+        __m128 movable2 = _mm_cmpgt_ps(_mm_setr_ps(invMass[b0], invMass[b1], invMass[b2], invMass[b3]), zero);
+
+        _mm_store_ps(out1X, _mm_and_ps(totalX, movable1));
+        _mm_store_ps(out1Y, _mm_and_ps(totalY, movable1));
+        _mm_store_ps(out1Z, _mm_and_ps(totalZ, movable1));
+        _mm_store_ps(out2X, _mm_and_ps(totalX, movable2));
+        _mm_store_ps(out2Y, _mm_and_ps(totalY, movable2));
+        _mm_store_ps(out2Z, _mm_and_ps(totalZ, movable2));
+
+        // Springs in a block may share particles, so scatter lane by lane in
+        // spring order to keep the summation order of the scalar kernel.
+        for (int lane = 0; lane < 4; lane++) {
+            int p1 = block[lane].p1;
+            int p2 = block[lane].p2;
+            forceX[p1] += out1X[lane];
+            forceY[p1] += out1Y[lane];
+            forceZ[p1] += out1Z[lane];
+            forceX[p2] -= out2X[lane];
+            forceY[p2] -= out2Y[lane];
+            forceZ[p2] -= out2Z[lane];
+        }
+    }
+
+    springForcesScalar(particles, springs, s, last, stiffness, damping);
+}
+
+CLOTH_TARGET_AVX2
+void springForcesAvx2(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const float* prevX = particles.prevX.data();
+    const float* prevY = particles.prevY.data();
+    const float* prevZ = particles.prevZ.data();
+    const float* invMass = particles.invMass.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 minLength = _mm256_set1_ps(1e-6f);
+    const __m256 k = _mm256_set1_ps(stiffness);
+    const __m256 d = _mm256_set1_ps(damping);
+    const __m256i springStride = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+
+    alignas(32) float out1X[8], out1Y[8], out1Z[8];
+    alignas(32) float out2X[8], out2Y[8], out2Z[8];
+
+    size_t s = first;
+    for (; s + 8 <= last; s += 8) {
+        const Spring* block = springs + s;
+        const int* words = reinterpret_cast<const int*>(block);
+        __m256i a = _mm256_i32gather_epi32(words, springStride, 4);
+        __m256i b = _mm256_i32gather_epi32(words + 1, springStride, 4);
+        __m256 rest = _mm256_i32gather_ps(reinterpret_cast<const float*>(words + 2), springStride, 4);
+
+        __m256 x1 = _mm256_i32gather_ps(x, a, 4);
+        __m256 y1 = _mm256_i32gather_ps(y, a, 4);
+        __m256 z1 = _mm256_i32gather_ps(z, a, 4);
+        __m256 x2 = _mm256_i32gather_ps(x, b, 4);
+        __m256 y2 = _mm256_i32gather_ps(y, b, 4);
+        __m256 z2 = _mm256_i32gather_ps(z, b, 4);
+
+        __m256 dx = _mm256_sub_ps(x2, x1);
+        __m256 dy = _mm256_sub_ps(y2, y1);
+        __m256 dz = _mm256_sub_ps(z2, z1);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                     _mm256_mul_ps(dz, dz)));
+        __m256 valid = _mm256_cmp_ps(length, minLength, _CMP_NLT_UQ);
+
+        __m256 dirX = _mm256_div_ps(dx, length);
+        __m256 dirY = _mm256_div_ps(dy, length);
+        __m256 dirZ = _mm256_div_ps(dz, length);
+
+        __m256 spring = _mm256_mul_ps(k, _mm256_sub_ps(length, rest));
+
+        __m256 relX = _mm256_sub_ps(_mm256_sub_ps(x2, _mm256_i32gather_ps(prevX, b, 4)),
+                                    _mm256_sub_ps(x1, _mm256_i32gather_ps(prevX, a, 4)));
+        __m256 relY = _mm256_sub_ps(_mm256_sub_ps(y2, _mm256_i32gather_ps(prevY, b, 4)),
+                                    _mm256_sub_ps(y1, _mm256_i32gather_ps(prevY, a, 4)));
+        __m256 relZ = _mm256_sub_ps(_mm256_sub_ps(z2, _mm256_i32gather_ps(prevZ, b, 4)),
+                                    _mm256_sub_ps(z1, _mm256_i32gather_ps(prevZ, a, 4)));
+        __m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(relX, dirX), _mm256_mul_ps(relY, dirY)),
+                                     _mm256_mul_ps(relZ, dirZ));
+        __m256 damp = _mm256_mul_ps(d, along);
+
+        __m256 totalX = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirX), _mm256_mul_ps(damp, dirX)), valid);
+        __m256 totalY = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirY), _mm256_mul_ps(damp, dirY)), valid);
+        __m256 totalZ = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirZ), _mm256_mul_ps(damp, dirZ)), valid);
+
+        __m256 movable1 = _mm256_cmp_ps(_mm256_i32gather_ps(invMass, a, 4), zero, _CMP_GT_OQ);
+        __m256 movable2 = _mm256_cmp_ps(_mm256_i32gather_ps(invMass, b, 4), zero, _CMP_GT_OQ);
+
+        _mm256_store_ps(out1X, _mm256_and_ps(totalX, movable1));
+        _mm256_store_ps(out1Y, _mm256_and_ps(totalY, movable1));
+        _mm256_store_ps(out1Z, _mm256_and_ps(totalZ, movable1));
+        _mm256_store_ps(out2X, _mm256_and_ps(totalX, movable2));
+        _mm256_store_ps(out2Y, _mm256_and_ps(totalY, movable2));
+        _mm256_store_ps(out2Z, _mm256_and_ps(totalZ, movable2));
+
+        for (int lane = 0; lane < 8; lane++) {
+            int p1 = block[lane].p1;
+            int p2 = block[lane].p2;
+            forceX[p1] += out1X[lane];
+            forceY[p1] += out1Y[lane];
+            forceZ[p1] += out1Z[lane];
+            forceX[p2] -= out2X[lane];
+            forceY[p2] -= out2Y[lane];
+            forceZ[p2] -= out2Z[lane];
+        }
+    }
+
+    springForcesScalar(particles, springs, s, last, stiffness, damping);
+}
+
+// Four particles of a stencil run, from particle i on.
+static inline __m128 loadRun128(const float* values, size_t i, size_t stride) {
+    if (stride == 1) return _mm_loadu_ps(values + i);
+    return _mm_setr_ps(values[i], values[i + stride], values[i + 2 * stride], values[i + 3 * stride]);
+}
+
+void stencilForcesSse(ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const float* prevX = particles.prevX.data();
+    const float* prevY = particles.prevY.data();
+    const float* prevZ = particles.prevZ.data();
+    const float* invMass = particles.invMass.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minLength = _mm_set1_ps(1e-6f);
+    const __m128 k = _mm_set1_ps(stiffness);
+    const __m128 d = _mm_set1_ps(damping);
+    const __m128 rest = _mm_set1_ps(run.restLength);
+    const size_t stride = run.stride;
+
+    alignas(16) float out1X[4], out1Y[4], out1Z[4];
+    alignas(16) float out2X[4], out2Y[4], out2Z[4];
+
+    size_t j = 0;
+    for (; j + 4 <= run.count; j += 4) {
+        const size_t a = run.first + j * stride;
+        const size_t b = a + run.offset;
+
+        __m128 x1 = loadRun128(x, a, stride);
+        __m128 y1 = loadRun128(y, a, stride);
+        __m128 z1 = loadRun128(z, a, stride);
+        __m128 x2 = loadRun128(x, b, stride);
+        __m128 y2 = loadRun128(y, b, stride);
+        __m128 z2 = loadRun128(z, b, stride);
+
+        __m128 dx = _mm_sub_ps(x2, x1);
+        __m128 dy = _mm_sub_ps(y2, y1);
+        __m128 dz = _mm_sub_ps(z2, z1);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 valid = _mm_cmpnlt_ps(length, minLength);
+
+        __m128 dirX = _mm_div_ps(dx, length);
+        __m128 dirY = _mm_div_ps(dy, length);
+        __m128 dirZ = _mm_div_ps(dz, length);
+
+        __m128 spring = _mm_mul_ps(k, _mm_sub_ps(length, rest));
+
+        __m128 relX = _mm_sub_ps(_mm_sub_ps(x2, loadRun128(prevX, b, stride)), _mm_sub_ps(x1, loadRun128(prevX, a, stride)));
+        __m128 relY = _mm_sub_ps(_mm_sub_ps(y2, loadRun128(prevY, b, stride)), _mm_sub_ps(y1, loadRun128(prevY, a, stride)));
+        __m128 relZ = _mm_sub_ps(_mm_sub_ps(z2, loadRun128(prevZ, b, stride)), _mm_sub_ps(z1, loadRun128(prevZ, a, stride)));
+        __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(relX, dirX), _mm_mul_ps(relY, dirY)), _mm_mul_ps(relZ, dirZ));
+        __m128 damp = _mm_mul_ps(d, along);
+
+        __m128 totalX = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirX), _mm_mul_ps(damp, dirX)), valid);
+        __m128 totalY = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirY), _mm_mul_ps(damp, dirY)), valid);
+        __m128 totalZ = _mm_and_ps(_mm_add_ps(_mm_mul_ps(spring, dirZ), _mm_mul_ps(damp, dirZ)), valid);
+
+        __m128 movable1 = _mm_cmpgt_ps(loadRun128(invMass, a, stride), zero);
+        __m128 movable2 = _mm_cmpgt_ps(loadRun128(invMass, b, stride), zero);
+
+        // A run touches each particle once, so its forces can be updated a
+        // whole vector at a time.
+        if (stride == 1) {
+            _mm_storeu_ps(forceX + a, _mm_add_ps(_mm_loadu_ps(forceX + a), _mm_and_ps(totalX, movable1)));
+            _mm_storeu_ps(forceY + a, _mm_add_ps(_mm_loadu_ps(forceY + a), _mm_and_ps(totalY, movable1)));
+            _mm_storeu_ps(forceZ + a, _mm_add_ps(_mm_loadu_ps(forceZ + a), _mm_and_ps(totalZ, movable1)));
+            _mm_storeu_ps(forceX + b, _mm_sub_ps(_mm_loadu_ps(forceX + b), _mm_and_ps(totalX, movable2)));
+            _mm_storeu_ps(forceY + b, _mm_sub_ps(_mm_loadu_ps(forceY + b), _mm_and_ps(totalY, movable2)));
+            _mm_storeu_ps(forceZ + b, _mm_sub_ps(_mm_loadu_ps(forceZ + b), _mm_and_ps(totalZ, movable2)));
+            continue;
+        }
+
+        _mm_store_ps(out1X, _mm_and_ps(totalX, movable1));
+        _mm_store_ps(out1Y, _mm_and_ps(totalY, movable1));
+        _mm_store_ps(out1Z, _mm_and_ps(totalZ, movable1));
+        _mm_store_ps(out2X, _mm_and_ps(totalX, movable2));
+        _mm_store_ps(out2Y, _mm_and_ps(totalY, movable2));
+        _mm_store_ps(out2Z, _mm_and_ps(totalZ, movable2));
+        for (int lane = 0; lane < 4; lane++) {
+            size_t p1 = a + lane * stride;
+            size_t p2 = b + lane * stride;
+            forceX[p1] += out1X[lane];
+            forceY[p1] += out1Y[lane];
+            forceZ[p1] += out1Z[lane];
+            forceX[p2] -= out2X[lane];
+            forceY[p2] -= out2Y[lane];
+            forceZ[p2] -= out2Z[lane];
+        }
+    }
+
+    StencilRun tail = run;
+    tail.first = run.first + j * stride;
+    tail.count = run.count - j;
+    stencilForcesScalar(particles, tail, stiffness, damping);
+}
+
+CLOTH_TARGET_AVX2
+static inline __m256 loadRun256(const float* values, size_t i, size_t stride, __m256i lanes) {
+    if (stride == 1) return _mm256_loadu_ps(values + i);
+    return _mm256_i32gather_ps(values + i, lanes, 4);
+}
+
+CLOTH_TARGET_AVX2
+void stencilForcesAvx2(ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    const float* x = particles.x.data();
+    const float* y = particles.y.data();
+    const float* z = particles.z.data();
+    const float* prevX = particles.prevX.data();
+    const float* prevY = particles.prevY.data();
+    const float* prevZ = particles.prevZ.data();
+    const float* invMass = particles.invMass.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 minLength = _mm256_set1_ps(1e-6f);
+    const __m256 k = _mm256_set1_ps(stiffness);
+    const __m256 d = _mm256_set1_ps(damping);
+    const __m256 rest = _mm256_set1_ps(run.restLength);
+    const size_t stride = run.stride;
+    const int step = static_cast<int>(stride);
+    const __m256i lanes = _mm256_setr_epi32(0, step, 2 * step, 3 * step, 4 * step, 5 * step, 6 * step, 7 * step);
+
+    alignas(32) float out1X[8], out1Y[8], out1Z[8];
+    alignas(32) float out2X[8], out2Y[8], out2Z[8];
+
+    size_t j = 0;
+    for (; j + 8 <= run.count; j += 8) {
+        const size_t a = run.first + j * stride;
+        const size_t b = a + run.offset;
+
+        __m256 x1 = loadRun256(x, a, stride, lanes);
+        __m256 y1 = loadRun256(y, a, stride, lanes);
+        __m256 z1 = loadRun256(z, a, stride, lanes);
+        __m256 x2 = loadRun256(x, b, stride, lanes);
+        __m256 y2 = loadRun256(y, b, stride, lanes);
+        __m256 z2 = loadRun256(z, b, stride, lanes);
+
+        __m256 dx = _mm256_sub_ps(x2, x1);
+        __m256 dy = _mm256_sub_ps(y2, y1);
+        __m256 dz = _mm256_sub_ps(z2, z1);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                     _mm256_mul_ps(dz, dz)));
+        __m256 valid = _mm256_cmp_ps(length, minLength, _CMP_NLT_UQ);
+
+        __m256 dirX = _mm256_div_ps(dx, length);
+        __m256 dirY = _mm256_div_ps(dy, length);
+        __m256 dirZ = _mm256_div_ps(dz, length);
+
+        __m256 spring = _mm256_mul_ps(k, _mm256_sub_ps(length, rest));
+
+        __m256 relX = _mm256_sub_ps(_mm256_sub_ps(x2, loadRun256(prevX, b, stride, lanes)),
+                                    _mm256_sub_ps(x1, loadRun256(prevX, a, stride, lanes)));
+        __m256 relY = _mm256_sub_ps(_mm256_sub_ps(y2, loadRun256(prevY, b, stride, lanes)),
+                                    _mm256_sub_ps(y1, loadRun256(prevY, a, stride, lanes)));
+        __m256 relZ = _mm256_sub_ps(_mm256_sub_ps(z2, loadRun256(prevZ, b, stride, lanes)),
+                                    _mm256_sub_ps(z1, loadRun256(prevZ, a, stride, lanes)));
+        __m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(relX, dirX), _mm256_mul_ps(relY, dirY)),
+                                     _mm256_mul_ps(relZ, dirZ));
+        __m256 damp = _mm256_mul_ps(d, along);
+
+        __m256 totalX = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirX), _mm256_mul_ps(damp, dirX)), valid);
+        __m256 totalY = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirY), _mm256_mul_ps(damp, dirY)), valid);
+        __m256 totalZ = _mm256_and_ps(_mm256_add_ps(_mm256_mul_ps(spring, dirZ), _mm256_mul_ps(damp, dirZ)), valid);
+
+        __m256 movable1 = _mm256_cmp_ps(loadRun256(invMass, a, stride, lanes), zero, _CMP_GT_OQ);
+        __m256 movable2 = _mm256_cmp_ps(loadRun256(invMass, b, stride, lanes), zero, _CMP_GT_OQ);
+
+        if (stride == 1) {
+            _mm256_storeu_ps(forceX + a, _mm256_add_ps(_mm256_loadu_ps(forceX + a), _mm256_and_ps(totalX, movable1)));
+            _mm256_storeu_ps(forceY + a, _mm256_add_ps(_mm256_loadu_ps(forceY + a), _mm256_and_ps(totalY, movable1)));
+            _mm256_storeu_ps(forceZ + a, _mm256_add_ps(_mm256_loadu_ps(forceZ + a), _mm256_and_ps(totalZ, movable1)));
+            _mm256_storeu_ps(forceX + b, _mm256_sub_ps(_mm256_loadu_ps(forceX + b), _mm256_and_ps(totalX, movable2)));
+            _mm256_storeu_ps(forceY + b, _mm256_sub_ps(_mm256_loadu_ps(forceY + b), _mm256_and_ps(totalY, movable2)));
+            _mm256_storeu_ps(forceZ + b, _mm256_sub_ps(_mm256_loadu_ps(forceZ + b), _mm256_and_ps(totalZ, movable2)));
+            continue;
+        }
+
+        _mm256_store_ps(out1X, _mm256_and_ps(totalX, movable1));
+        _mm256_store_ps(out1Y, _mm256_and_ps(totalY, movable1));
+        _mm256_store_ps(out1Z, _mm256_and_ps(totalZ, movable1));
+        _mm256_store_ps(out2X, _mm256_and_ps(totalX, movable2));
+        _mm256_store_ps(out2Y, _mm256_and_ps(totalY, movable2));
+        _mm256_store_ps(out2Z, _mm256_and_ps(totalZ, movable2));
+        for (int lane = 0; lane < 8; lane++) {
+            size_t p1 = a + lane * stride;
+            size_t p2 = b + lane * stride;
+            forceX[p1] += out1X[lane];
+            forceY[p1] += out1Y[lane];
+            forceZ[p1] += out1Z[lane];
+            forceX[p2] -= out2X[lane];
+            forceY[p2] -= out2Y[lane];
+            forceZ[p2] -= out2Z[lane];
+        }
+    }
+
+    StencilRun tail = run;
+    tail.first = run.first + j * stride;
+    tail.count = run.count - j;
+    stencilForcesScalar(particles, tail, stiffness, damping);
+}
+
+void integrateSse(ParticleState& particles, size_t first, size_t last, float timeStep) {
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* z = particles.z.data();
+    float* prevX = particles.prevX.data();
+    float* prevY = particles.prevY.data();
+    float* prevZ = particles.prevZ.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+    const float* invMass = particles.invMass.data();
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 dt = _mm_set1_ps(timeStep);
+    const __m128 groundDamping = _mm_set1_ps(0.1f);
+
+    size_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        __m128 inv = _mm_loadu_ps(invMass + i);
+        __m128 movable = _mm_cmpneq_ps(inv, zero);
+
+        __m128 oldX = _mm_loadu_ps(x + i);
+        __m128 oldY = _mm_loadu_ps(y + i);
+        __m128 oldZ = _mm_loadu_ps(z + i);
+        __m128 oldPrevX = _mm_loadu_ps(prevX + i);
+        __m128 oldPrevY = _mm_loadu_ps(prevY + i);
+        __m128 oldPrevZ = _mm_loadu_ps(prevZ + i);
+        __m128 oldForceX = _mm_loadu_ps(forceX + i);
+        __m128 oldForceY = _mm_loadu_ps(forceY + i);
+        __m128 oldForceZ = _mm_loadu_ps(forceZ + i);
+
+        __m128 newX = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(oldX, two), oldPrevX), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(oldForceX, inv), dt), dt));
+        __m128 newY = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(oldY, two), oldPrevY), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(oldForceY, inv), dt), dt));
+        __m128 newZ = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(oldZ, two), oldPrevZ), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(oldForceZ, inv), dt), dt));
+
+        __m128 ground = _mm_cmplt_ps(newY, zero);
+        newY = select128(newY, zero, ground);
+
+        __m128 newPrevX = select128(oldX, _mm_sub_ps(newX, _mm_mul_ps(_mm_sub_ps(newX, oldX), groundDamping)), ground);
+        __m128 newPrevY = select128(oldY, _mm_sub_ps(newY, _mm_mul_ps(_mm_sub_ps(newY, oldY), groundDamping)), ground);
+        __m128 newPrevZ = select128(oldZ, _mm_sub_ps(newZ, _mm_mul_ps(_mm_sub_ps(newZ, oldZ), groundDamping)), ground);
+
+        _mm_storeu_ps(x + i, select128(oldX, newX, movable));
+        _mm_storeu_ps(y + i, select128(oldY, newY, movable));
+        _mm_storeu_ps(z + i, select128(oldZ, newZ, movable));
+        _mm_storeu_ps(prevX + i, select128(oldPrevX, newPrevX, movable));
+        _mm_storeu_ps(prevY + i, select128(oldPrevY, newPrevY, movable));
+        _mm_storeu_ps(prevZ + i, select128(oldPrevZ, newPrevZ, movable));
+        _mm_storeu_ps(forceX + i, select128(oldForceX, zero, movable));
+        _mm_storeu_ps(forceY + i, select128(oldForceY, zero, movable));
+        _mm_storeu_ps(forceZ + i, select128(oldForceZ, zero, movable));
+    }
+
+    integrateScalar(particles, i, last, timeStep);
+}
+
+CLOTH_TARGET_AVX2
+void integrateAvx2(ParticleState& particles, size_t first, size_t last, float timeStep) {
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* z = particles.z.data();
+    float* prevX = particles.prevX.data();
+    float* prevY = particles.prevY.data();
+    float* prevZ = particles.prevZ.data();
+    float* forceX = particles.forceX.data();
+    float* forceY = particles.forceY.data();
+    float* forceZ = particles.forceZ.data();
+    const float* invMass = particles.invMass.data();
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 dt = _mm256_set1_ps(timeStep);
+    const __m256 groundDamping = _mm256_set1_ps(0.1f);
+
+    size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m256 inv = _mm256_loadu_ps(invMass + i);
+        __m256 movable = _mm256_cmp_ps(inv, zero, _CMP_NEQ_UQ);
+
+        __m256 oldX = _mm256_loadu_ps(x + i);
+        __m256 oldY = _mm256_loadu_ps(y + i);
+        __m256 oldZ = _mm256_loadu_ps(z + i);
+        __m256 oldPrevX = _mm256_loadu_ps(prevX + i);
+        __m256 oldPrevY = _mm256_loadu_ps(prevY + i);
+        __m256 oldPrevZ = _mm256_loadu_ps(prevZ + i);
+        __m256 oldForceX = _mm256_loadu_ps(forceX + i);
+        __m256 oldForceY = _mm256_loadu_ps(forceY + i);
+        __m256 oldForceZ = _mm256_loadu_ps(forceZ + i);
+
+        __m256 newX = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(oldX, two), oldPrevX),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(oldForceX, inv), dt), dt));
+        __m256 newY = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(oldY, two), oldPrevY),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(oldForceY, inv), dt), dt));
+        __m256 newZ = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(oldZ, two), oldPrevZ),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(oldForceZ, inv), dt), dt));
+
+        // Ground plane: clamp y to 0 and bleed off 90% of the step's motion.
+        __m256 ground = _mm256_cmp_ps(newY, zero, _CMP_LT_OQ);
+        newY = _mm256_blendv_ps(newY, zero, ground);
+
+        __m256 newPrevX = _mm256_blendv_ps(oldX, _mm256_sub_ps(newX, _mm256_mul_ps(_mm256_sub_ps(newX, oldX), groundDamping)), ground);
+        __m256 newPrevY = _mm256_blendv_ps(oldY, _mm256_sub_ps(newY, _mm256_mul_ps(_mm256_sub_ps(newY, oldY), groundDamping)), ground);
+        __m256 newPrevZ = _mm256_blendv_ps(oldZ, _mm256_sub_ps(newZ, _mm256_mul_ps(_mm256_sub_ps(newZ, oldZ), groundDamping)), ground);
+
+        // Pinned particles keep their position, previous position and force.
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(oldX, newX, movable));
+        _mm256_storeu_ps(y + i, _mm256_blendv_ps(oldY, newY, movable));
+        _mm256_storeu_ps(z + i, _mm256_blendv_ps(oldZ, newZ, movable));
+        _mm256_storeu_ps(prevX + i, _mm256_blendv_ps(oldPrevX, newPrevX, movable));
+        _mm256_storeu_ps(prevY + i, _mm256_blendv_ps(oldPrevY, newPrevY, movable));
+        _mm256_storeu_ps(prevZ + i, _mm256_blendv_ps(oldPrevZ, newPrevZ, movable));
+        _mm256_storeu_ps(forceX + i, _mm256_blendv_ps(oldForceX, zero, movable));
+        _mm256_storeu_ps(forceY + i, _mm256_blendv_ps(oldForceY, zero, movable));
+        _mm256_storeu_ps(forceZ + i, _mm256_blendv_ps(oldForceZ, zero, movable));
+    }
+
+    integrateScalar(particles, i, last, timeStep);
+}
+
+void faceNormalsSse(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    size_t q = first;
+    for (; q + 4 <= last; q += 4) {
+        __m128 x0 = _mm_loadu_ps(x + q), y0 = _mm_loadu_ps(y + q), z0 = _mm_loadu_ps(z + q);
+        __m128 e1x = _mm_sub_ps(_mm_loadu_ps(x + q + 1), x0);
+        __m128 e1y = _mm_sub_ps(_mm_loadu_ps(y + q + 1), y0);
+        __m128 e1z = _mm_sub_ps(_mm_loadu_ps(z + q + 1), z0);
+        __m128 e2x = _mm_sub_ps(_mm_loadu_ps(x + q + stride), x0);
+        __m128 e2y = _mm_sub_ps(_mm_loadu_ps(y + q + stride), y0);
+        __m128 e2z = _mm_sub_ps(_mm_loadu_ps(z + q + stride), z0);
+        __m128 e3x = _mm_sub_ps(_mm_loadu_ps(x + q + stride + 1), x0);
+        __m128 e3y = _mm_sub_ps(_mm_loadu_ps(y + q + stride + 1), y0);
+        __m128 e3z = _mm_sub_ps(_mm_loadu_ps(z + q + stride + 1), z0);
+
+        _mm_storeu_ps(out.ax + q, _mm_sub_ps(_mm_mul_ps(e3y, e2z), _mm_mul_ps(e3z, e2y)));
+        _mm_storeu_ps(out.ay + q, _mm_sub_ps(_mm_mul_ps(e3z, e2x), _mm_mul_ps(e3x, e2z)));
+        _mm_storeu_ps(out.az + q, _mm_sub_ps(_mm_mul_ps(e3x, e2y), _mm_mul_ps(e3y, e2x)));
+        _mm_storeu_ps(out.bx + q, _mm_sub_ps(_mm_mul_ps(e1y, e3z), _mm_mul_ps(e1z, e3y)));
+        _mm_storeu_ps(out.by + q, _mm_sub_ps(_mm_mul_ps(e1z, e3x), _mm_mul_ps(e1x, e3z)));
+        _mm_storeu_ps(out.bz + q, _mm_sub_ps(_mm_mul_ps(e1x, e3y), _mm_mul_ps(e1y, e3x)));
+    }
+
+    faceNormalsScalar(x, y, z, stride, q, last, out);
+}
+
+CLOTH_TARGET_AVX2
+void faceNormalsAvx2(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    size_t q = first;
+    for (; q + 8 <= last; q += 8) {
+        __m256 x0 = _mm256_loadu_ps(x + q), y0 = _mm256_loadu_ps(y + q), z0 = _mm256_loadu_ps(z + q);
+        __m256 e1x = _mm256_sub_ps(_mm256_loadu_ps(x + q + 1), x0);
+        __m256 e1y = _mm256_sub_ps(_mm256_loadu_ps(y + q + 1), y0);
+        __m256 e1z = _mm256_sub_ps(_mm256_loadu_ps(z + q + 1), z0);
+        __m256 e2x = _mm256_sub_ps(_mm256_loadu_ps(x + q + stride), x0);
+        __m256 e2y = _mm256_sub_ps(_mm256_loadu_ps(y + q + stride), y0);
+        __m256 e2z = _mm256_sub_ps(_mm256_loadu_ps(z + q + stride), z0);
+        __m256 e3x = _mm256_sub_ps(_mm256_loadu_ps(x + q + stride + 1), x0);
+        __m256 e3y = _mm256_sub_ps(_mm256_loadu_ps(y + q + stride + 1), y0);
+        __m256 e3z = _mm256_sub_ps(_mm256_loadu_ps(z + q + stride + 1), z0);
+
+        _mm256_storeu_ps(out.ax + q, _mm256_sub_ps(_mm256_mul_ps(e3y, e2z), _mm256_mul_ps(e3z, e2y)));
+        _mm256_storeu_ps(out.ay + q, _mm256_sub_ps(_mm256_mul_ps(e3z, e2x), _mm256_mul_ps(e3x, e2z)));
+        _mm256_storeu_ps(out.az + q, _mm256_sub_ps(_mm256_mul_ps(e3x, e2y), _mm256_mul_ps(e3y, e2x)));
+        _mm256_storeu_ps(out.bx + q, _mm256_sub_ps(_mm256_mul_ps(e1y, e3z), _mm256_mul_ps(e1z, e3y)));
+        _mm256_storeu_ps(out.by + q, _mm256_sub_ps(_mm256_mul_ps(e1z, e3x), _mm256_mul_ps(e1x, e3z)));
+        _mm256_storeu_ps(out.bz + q, _mm256_sub_ps(_mm256_mul_ps(e1x, e3y), _mm256_mul_ps(e1y, e3x)));
+    }
+
+    faceNormalsScalar(x, y, z, stride, q, last, out);
+}
+
+#else
+
+void springForcesSse(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    springForcesScalar(particles, springs, first, last, stiffness, damping);
+}
+
+void springForcesAvx2(ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    springForcesScalar(particles, springs, first, last, stiffness, damping);
+}
+
+void stencilForcesSse(ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    stencilForcesScalar(particles, run, stiffness, damping);
+}
+
+void stencilForcesAvx2(ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    stencilForcesScalar(particles, run, stiffness, damping);
+}
+
+void integrateSse(ParticleState& particles, size_t first, size_t last, float timeStep) {
+    integrateScalar(particles, first, last, timeStep);
+}
+
+void integrateAvx2(ParticleState& particles, size_t first, size_t last, float timeStep) {
+    integrateScalar(particles, first, last, timeStep);
+}
+
+void faceNormalsSse(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    faceNormalsScalar(x, y, z, stride, first, last, out);
+}
+
+void faceNormalsAvx2(const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    faceNormalsScalar(x, y, z, stride, first, last, out);
+}
+
+#endif
+
+void springForces(SimdLevel level, ParticleState& particles, const Spring* springs, size_t first, size_t last, float stiffness, float damping) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            springForcesAvx2(particles, springs, first, last, stiffness, damping);
+            break;
+        case SimdLevel::SSE:
+            springForcesSse(particles, springs, first, last, stiffness, damping);
+            break;
+        default:
+            springForcesScalar(particles, springs, first, last, stiffness, damping);
+            break;
+    }
+}
+
+void stencilForces(SimdLevel level, ParticleState& particles, const StencilRun& run, float stiffness, float damping) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            stencilForcesAvx2(particles, run, stiffness, damping);
+            break;
+        case SimdLevel::SSE:
+            stencilForcesSse(particles, run, stiffness, damping);
+            break;
+        default:
+            stencilForcesScalar(particles, run, stiffness, damping);
+            break;
+    }
+}
+
+void integrate(SimdLevel level, ParticleState& particles, size_t first, size_t last, float timeStep) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            integrateAvx2(particles, first, last, timeStep);
+            break;
+        case SimdLevel::SSE:
+            integrateSse(particles, first, last, timeStep);
+            break;
+        default:
+            integrateScalar(particles, first, last, timeStep);
+            break;
+    }
+}
+
+void faceNormals(SimdLevel level, const float* x, const float* y, const float* z, size_t stride, size_t first, size_t last, const FaceNormalRow& out) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            faceNormalsAvx2(x, y, z, stride, first, last, out);
+            break;
+        case SimdLevel::SSE:
+            faceNormalsSse(x, y, z, stride, first, last, out);
+            break;
+        default:
+            faceNormalsScalar(x, y, z, stride, first, last, out);
+            break;
+    }
+}
@@ -0,0 +1,196 @@
+#include "simthread.h"
+#include "clothprofiler.h"
+
+
+SimCommand SimCommand::mouse(glm::vec2 pos, bool pressed) {
+    SimCommand command{Mouse};
+    command.mousePos = pos;
+    command.enabled = pressed;
+    return command;
+}
+
+SimCommand SimCommand::mouseRay(const glm::vec3& origin, const glm::vec3& direction, bool pressed) {
+    SimCommand command{MouseRay};
+    command.rayOrigin = origin;
+    command.rayDirection = direction;
+    command.enabled = pressed;
+    return command;
+}
+
+SimCommand SimCommand::wind(bool enabled) {
+    SimCommand command{SetWind};
+    command.enabled = enabled;
+    return command;
+}
+
+SimCommand SimCommand::gravity(bool enabled) {
+    SimCommand command{SetGravity};
+    command.enabled = enabled;
+    return command;
+}
+
+SimCommand SimCommand::reset() {
+    return SimCommand{Reset};
+}
+
+SimCommand SimCommand::record(const std::string& path) {
+    SimCommand command{Record};
+    command.path = path;
+    command.enabled = !path.empty();
+    return command;
+}
+
+SimCommand SimCommand::loadMesh(const std::string& path) {
+    SimCommand command{LoadMesh};
+    command.path = path;
+    return command;
+}
+
+SimulationThread::SimulationThread(int width, int height, float spacing, float stiffness, float damping)
+    : cloth(width, height, spacing, stiffness, damping) {
+    cloth.sleepingEnabled = true;
+    pendingCommands.reserve(64);
+    activeCommands.reserve(64);
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (running.exchange(true)) return;
+
+    publishSnapshot();
+    worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (!running.exchange(false)) return;
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+    recorder.close();
+}
+
+void SimulationThread::post(const SimCommand& command) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    pendingCommands.push_back(command);
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    ClothProfiler::setThreadName("simulation");
+
+    Clock::time_point lastStep = Clock::now();
+    Clock::time_point nextStep = lastStep + stepInterval;
+
+    while (running.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_until(nextStep);
+
+        Clock::time_point now = Clock::now();
+        float deltaTime = std::chrono::duration<float>(now - lastStep).count();
+        lastStep = now;
+
+        drainCommands();
+        step(deltaTime);
+        publishSnapshot();
+
+        // If a step overran, restart the schedule instead of bursting to
+        // catch up.
+        nextStep += stepInterval;
+        if (nextStep < now) {
+            nextStep = now + stepInterval;
+        }
+    }
+}
+
+void SimulationThread::drainCommands() {
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        activeCommands.swap(pendingCommands);
+    }
+
+    for (const SimCommand& command : activeCommands) {
+        switch (command.type) {
+            case SimCommand::Mouse:
+                mousePos = command.mousePos;
+                mousePressed = command.enabled;
+                mouseUsesRay = false;
+                break;
+            case SimCommand::MouseRay:
+                rayOrigin = command.rayOrigin;
+                rayDirection = command.rayDirection;
+                mousePressed = command.enabled;
+                mouseUsesRay = true;
+                // Drop the grab right away, so a quick release and press
+                // before the next step grabs afresh.
+                if (!mousePressed) {
+                    cloth.applymouseconstraint(rayOrigin, rayDirection, false);
+                }
+                break;
+            case SimCommand::SetWind:
+                windEnabled = command.enabled;
+                break;
+            case SimCommand::SetGravity:
+                cloth.gravityEnabled = command.enabled;
+                break;
+            case SimCommand::Reset:
+                cloth.reset();
+                break;
+            case SimCommand::Record:
+                recorder.close();
+                if (command.enabled) {
+                    recorder.open(command.path, cloth.width, cloth.height);
+                }
+                break;
+            case SimCommand::LoadMesh:
+                loadMesh(command.path);
+                break;
+        }
+    }
+    activeCommands.clear();
+}
+
+void SimulationThread::loadMesh(const std::string& path) {
+    auto mesh = std::make_shared<ClothTopology>();
+    if (!mesh->loadObj(path)) return;
+
+    // A recording cannot change topology midway.
+    recorder.close();
+
+    int threads = cloth.getThreadCount();
+    bool gravity = cloth.gravityEnabled;
+    cloth = Cloth(mesh, cloth.stiffness, cloth.damping);
+    cloth.setThreadCount(threads);
+    cloth.gravityEnabled = gravity;
+    cloth.sleepingEnabled = true;
+}
+
+void SimulationThread::step(float deltaTime) {
+    // Substeps follow the measured frame time, so a late frame simulates
+    // more rather than slowing the cloth down.
+    cloth.advance(deltaTime, [this](float substep) {
+        if (mousePressed) {
+            if (mouseUsesRay) {
+                cloth.applymouseconstraint(rayOrigin, rayDirection, true);
+            } else {
+                cloth.applymouseconstraint(mousePos, true);
+            }
+        }
+
+        if (windEnabled && mousePressed) {
+            cloth.applywind(substep);
+        }
+    });
+    stepCount.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void SimulationThread::publishSnapshot() {
+    ClothSnapshot& snapshot = snapshots.writeBuffer();
+    snapshot.capture(cloth, stepCount.load(std::memory_order_relaxed));
+    if (recorder.isOpen()) {
+        recorder.record(snapshot);
+    }
+    snapshots.publish();
+}
@@ -0,0 +1,106 @@
+#include "workstealingpool.h"
+
+WorkStealingPool::WorkStealingPool(int threadCount) {
+    const int count = threadCount < 1 ? 1 : threadCount;
+    for (int i = 0; i < count; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (int i = 1; i < count; i++) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::run(const std::vector<size_t>& tasks, TaskFunction function, const void* task) {
+    if (tasks.empty()) return;
+
+    if (workers.empty()) {
+        for (size_t id : tasks) function(task, id);
+        return;
+    }
+
+    for (size_t k = 0; k < tasks.size(); k++) {
+        Queue& queue = *queues[k % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.items.push_back(tasks[k]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobFunction = function;
+        job = task;
+        busyWorkers = static_cast<int>(workers.size());
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return busyWorkers == 0; });
+    jobFunction = nullptr;
+    job = nullptr;
+}
+
+// Returns once every queue is empty. No task is queued mid-run, so the
+// tasks still running belong to other threads, and run() waits for them on
+// `finished` rather than spinning here.
+void WorkStealingPool::drain(int index) {
+    size_t item;
+    while (pop(index, item) || steal(index, item)) {
+        jobFunction(job, item);
+    }
+}
+
+bool WorkStealingPool::pop(int index, size_t& item) {
+    Queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.items.empty()) return false;
+    item = queue.items.front();
+    queue.items.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(int thief, size_t& item) {
+    const int count = static_cast<int>(queues.size());
+    for (int offset = 1; offset < count; offset++) {
+        Queue& queue = *queues[(thief + offset) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.items.empty()) continue;
+        item = queue.items.back();
+        queue.items.pop_back();
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        drain(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        finished.notify_one();
+    }
+}
@@ -1,10 +1,63 @@
 #include <gtest/gtest.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
 #include <iostream>
+#include <iterator>
+#include <thread>
+#include "clothbatch.h"
+#include "clothcheckpoint.h"
+#include "clothcollider.h"
+#include "clothmesh.h"
+#include "clothprofiler.h"
+#include "clothrecorder.h"
 #include "clothsim.h"
+#include "clothtopology.h"
+#include "simthread.h"
+#include "threadpool.h"
+#include "triplebuffer.h"
 
-extern bool gravityEnabled;
+namespace {
+
+// Heap allocations made on any thread while armed; see AllocationTest.
+std::atomic<bool> countingAllocations{false};
+std::atomic<size_t> allocationCount{0};
+
+void* countedAllocation(size_t size, size_t alignment) {
+    if (countingAllocations.load(std::memory_order_relaxed)) allocationCount++;
+    if (size == 0) size = 1;
+    void* p = alignment > alignof(std::max_align_t)
+        ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+        : std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+}
+
+void* operator new(size_t size) { return countedAllocation(size, 0); }
+void* operator new[](size_t size) { return countedAllocation(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return countedAllocation(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return countedAllocation(size, static_cast<size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
 
 class ClothTest : public ::testing::Test {
 protected:
@@ -60,4 +113,1122 @@ TEST_F(ClothTest, ApplyGravityTest) {
     cloth.applygravity(particles, deltaTime);
 
     EXPECT_NE(particles[0].force, initialForce);
-}
\ No newline at end of file
+}
+
+TEST(ClothCollisionTest, SpatialHashMatchesBruteForce) {
+    Cloth hashed(12, 12, 0.1f, 50.0f, 20.0f);
+    Cloth brute(12, 12, 0.1f, 50.0f, 20.0f);
+    brute.useSpatialHash = false;
+
+    // Drag the bottom-left corner across the cloth so it overlaps itself.
+    for (int step = 0; step < 40; ++step) {
+        glm::vec2 mouse(20.0f + step * 10.0f, 580.0f - step * 8.0f);
+        hashed.applymouseconstraint(mouse, true);
+        brute.applymouseconstraint(mouse, true);
+        hashed.update(0.016f);
+        brute.update(0.016f);
+    }
+
+    ParticleView a = hashed.getParticles();
+    ParticleView b = brute.getParticles();
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        EXPECT_NEAR(glm::distance(a.position(i), b.position(i)), 0.0f, 1e-3f) << "particle " << i;
+    }
+}
+
+TEST(ParticleStateTest, ViewMatchesGridLayout) {
+    Cloth cloth(4, 3, 0.5f, 10.0f, 0.1f);
+    ParticleView view = cloth.getParticles();
+
+    ASSERT_EQ(view.size(), 12u);
+    EXPECT_EQ(view[5].position, glm::vec3(0.5f, 0.5f, 0.0f));
+    EXPECT_EQ(view[5].mass, 1.0f);
+    EXPECT_EQ(view.data().invMass[5], 1.0f);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(view.data().x.data()) % 32, 0u);
+}
+
+TEST(SimdKernelTest, VectorKernelsMatchScalar) {
+    Cloth cloth(13, 11, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    for (int step = 0; step < 20; ++step) {
+        cloth.applymouseconstraint(glm::vec2(30.0f + step * 12.0f, 560.0f - step * 9.0f), true);
+        cloth.update(0.016f);
+    }
+
+    ParticleState reference = cloth.getParticles().data();
+    for (size_t i = 0; i < reference.size(); i += 7) {
+        reference.setMass(i, 0.0f);
+    }
+    for (size_t i = 0; i < reference.size(); ++i) {
+        reference.setForce(i, glm::vec3(0.1f * i, -0.05f * i, 0.02f));
+    }
+    reference.y[3] = -0.2f;
+    const std::vector<Spring>& springs = cloth.getSprings();
+
+    for (SimdLevel level : {SimdLevel::SSE, SimdLevel::AVX2}) {
+        if (level > detectSimdLevel()) continue;
+
+        ParticleState expected = reference;
+        ParticleState actual = reference;
+
+        springForcesScalar(expected, springs.data(), 0, springs.size(), cloth.stiffness, cloth.damping);
+        springForces(level, actual, springs.data(), 0, springs.size(), cloth.stiffness, cloth.damping);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQ(expected.force(i), actual.force(i)) << simdLevelName(level) << " particle " << i;
+        }
+
+        integrateScalar(expected, 0, expected.size(), 0.016f);
+        integrate(level, actual, 0, actual.size(), 0.016f);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQ(expected.position(i), actual.position(i)) << simdLevelName(level) << " particle " << i;
+            ASSERT_EQ(expected.previousPosition(i), actual.previousPosition(i)) << simdLevelName(level) << " particle " << i;
+            ASSERT_EQ(expected.force(i), actual.force(i)) << simdLevelName(level) << " particle " << i;
+        }
+    }
+}
+
+TEST(SpringColoringTest, ColorsAreIndependentSets) {
+    Cloth cloth(17, 9, 0.1f, 50.0f, 20.0f);
+    const std::vector<Spring>& springs = cloth.getSprings();
+    const std::vector<size_t>& offsets = cloth.getSpringColorOffsets();
+
+    EXPECT_EQ(offsets.size(), 13u);
+    EXPECT_EQ(offsets.back(), springs.size());
+
+    for (size_t c = 0; c + 1 < offsets.size(); ++c) {
+        std::vector<int> touched(17 * 9, 0);
+        for (size_t k = offsets[c]; k < offsets[c + 1]; ++k) {
+            EXPECT_EQ(touched[springs[k].p1]++, 0) << "color " << c;
+            EXPECT_EQ(touched[springs[k].p2]++, 0) << "color " << c;
+        }
+    }
+}
+
+TEST(SpringColoringTest, ThreadedSolveMatchesSingleThreaded) {
+    Cloth serial(160, 100, 0.02f, 50.0f, 20.0f);
+    Cloth threaded(160, 100, 0.02f, 50.0f, 20.0f);
+    threaded.setThreadCount(4);
+    EXPECT_EQ(threaded.getThreadCount(), 4);
+
+    serial.gravityEnabled = true;
+    threaded.gravityEnabled = true;
+    for (int step = 0; step < 10; ++step) {
+        glm::vec2 mouse(100.0f + step * 5.0f, 300.0f);
+        serial.applymouseconstraint(mouse, true);
+        threaded.applymouseconstraint(mouse, true);
+        serial.update(0.016f);
+        threaded.update(0.016f);
+    }
+
+    ParticleView a = serial.getParticles();
+    ParticleView b = threaded.getParticles();
+    for (size_t i = 0; i < a.size(); ++i) {
+        ASSERT_EQ(a.position(i), b.position(i)) << "particle " << i;
+    }
+}
+
+TEST(TripleBufferTest, ReaderSeesNewestPublishedValue) {
+    TripleBuffer<int> buffer;
+    EXPECT_FALSE(buffer.acquire());
+
+    buffer.writeBuffer() = 1;
+    buffer.publish();
+    buffer.writeBuffer() = 2;
+    buffer.publish();
+
+    EXPECT_TRUE(buffer.acquire());
+    EXPECT_EQ(buffer.readBuffer(), 2);
+    EXPECT_FALSE(buffer.acquire());
+    EXPECT_EQ(buffer.readBuffer(), 2);
+
+    buffer.writeBuffer() = 3;
+    buffer.publish();
+    EXPECT_TRUE(buffer.acquire());
+    EXPECT_EQ(buffer.readBuffer(), 3);
+}
+
+TEST(SimulationThreadTest, PublishesSnapshotsFromWorker) {
+    SimulationThread simulation(8, 8, 0.1f, 50.0f, 20.0f);
+    // The cloth advances by wall-clock time, so 20 ticks must span a few
+    // fixed steps.
+    simulation.setStepInterval(std::chrono::microseconds(4000));
+    simulation.start();
+
+    ASSERT_TRUE(simulation.acquireSnapshot());
+    EXPECT_EQ(simulation.snapshot().size(), 64u);
+    EXPECT_EQ(simulation.snapshot().position(9), glm::vec3(0.1f, 0.1f, 0.0f));
+
+    simulation.post(SimCommand::gravity(true));
+    while (simulation.getStepCount() < 20) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    simulation.stop();
+
+    simulation.acquireSnapshot();
+    EXPECT_GT(simulation.snapshot().step, 0u);
+    EXPECT_LT(simulation.snapshot().position(63).y, 0.7f);
+}
+
+TEST(ClothMeshTest, TopologyUploadsOnceThenStreamsVertices) {
+    Cloth cloth(16, 12, 0.1f, 50.0f, 20.0f);
+    ClothSnapshot snapshot;
+    snapshot.capture(cloth, 0);
+
+    std::vector<unsigned> dataTargets;
+    GLUploadTable gl;
+    gl.glBufferData = [&](unsigned target, std::ptrdiff_t, const void* data, unsigned) {
+        if (data) dataTargets.push_back(target);
+    };
+
+    const uint64_t vertexBytes = 16 * 12 * ClothMesh::floatsPerVertex * sizeof(float);
+    const uint64_t indexBytes = 15 * 11 * 6 * sizeof(unsigned int);
+
+    ClothMesh mesh;
+    gl.beginFrame();
+    mesh.upload(gl, snapshot);
+    EXPECT_EQ(gl.getFrameBytes(), vertexBytes + indexBytes);
+    ASSERT_EQ(dataTargets.size(), 1u);
+    EXPECT_EQ(dataTargets[0], GLUploadEnum::ElementArrayBuffer);
+
+    for (int frame = 0; frame < 3; ++frame) {
+        cloth.update(0.016f);
+        snapshot.capture(cloth, frame + 1);
+        gl.beginFrame();
+        mesh.upload(gl, snapshot);
+        EXPECT_EQ(gl.getFrameBytes(), vertexBytes);
+    }
+    EXPECT_EQ(dataTargets.size(), 1u);
+
+    Cloth larger(20, 12, 0.1f, 50.0f, 20.0f);
+    snapshot.capture(larger, 0);
+    gl.beginFrame();
+    mesh.upload(gl, snapshot);
+    EXPECT_EQ(gl.getFrameBytes(), (20 * 12 * ClothMesh::floatsPerVertex + 19 * 11 * 6) * 4u);
+}
+
+TEST(ClothMeshTest, ParallelVectorizedNormalsMatchSerial) {
+    Cloth cloth(37, 29, 0.1f, 50.0f, 20.0f);
+    for (int i = 0; i < 15; ++i) {
+        cloth.applymouseconstraint(glm::vec2(20.0f + i * 10.0f, 580.0f - i * 8.0f), true);
+        cloth.update(0.016f);
+    }
+    ClothSnapshot snapshot;
+    snapshot.capture(cloth, 0);
+
+    ClothMesh serial;
+    serial.simdLevel = SimdLevel::Scalar;
+    serial.update(snapshot);
+
+    ThreadPool pool(4);
+    ClothMesh parallel;
+    parallel.simdLevel = detectSimdLevel();
+    parallel.update(snapshot, &pool);
+    EXPECT_EQ(parallel.getVertices(), serial.getVertices());
+
+    const std::vector<float>& vertices = serial.getVertices();
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        glm::vec3 normal(vertices[i * 7 + 3], vertices[i * 7 + 4], vertices[i * 7 + 5]);
+        EXPECT_NEAR(glm::length(normal), 1.0f, 1e-5f);
+    }
+
+    // Writing through a mapped buffer produces the same stream.
+    std::vector<float> mapped(vertices.size());
+    GLUploadTable gl;
+    gl.glBufferData = [](unsigned, std::ptrdiff_t, const void*, unsigned) {};
+    gl.glMapBufferRange = [&](unsigned, std::ptrdiff_t, std::ptrdiff_t, unsigned) -> void* { return mapped.data(); };
+    gl.glUnmapBuffer = [](unsigned) { return true; };
+    parallel.upload(gl, snapshot, &pool);
+    EXPECT_EQ(mapped, vertices);
+}
+
+TEST(XpbdSolverTest, StableAtLargeTimeStep) {
+    Cloth serial(24, 24, 0.1f, 50.0f, 20.0f);
+    Cloth threaded(24, 24, 0.1f, 50.0f, 20.0f);
+    serial.gravityEnabled = true;
+    threaded.gravityEnabled = true;
+    serial.solverMode = SolverMode::XPBD;
+    threaded.solverMode = SolverMode::XPBD;
+    threaded.setThreadCount(4);
+
+    // Six times the force solver's fixed step.
+    const float timeStep = 0.1f;
+    for (int step = 0; step < 120; ++step) {
+        glm::vec2 mouse(100.0f + step * 3.0f, 300.0f);
+        serial.applymouseconstraint(mouse, step < 40);
+        threaded.applymouseconstraint(mouse, step < 40);
+        serial.update(timeStep);
+        threaded.update(timeStep);
+    }
+
+    ParticleView particles = serial.getParticles();
+    ParticleView threadedParticles = threaded.getParticles();
+    for (size_t i = 0; i < particles.size(); ++i) {
+        glm::vec3 position = particles.position(i);
+        ASSERT_TRUE(std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z));
+        EXPECT_GE(position.y, 0.0f);
+        EXPECT_EQ(position, threadedParticles.position(i));
+    }
+
+    for (const Spring& spring : serial.getSprings()) {
+        float length = glm::distance(particles.position(spring.p1), particles.position(spring.p2));
+        EXPECT_LT(length, spring.restLength * 3.0f);
+    }
+}
+
+TEST(ImplicitSolverTest, StiffClothStaysBoundedAtLargeStep) {
+    // Forty times the widget's stiffness at twice the fixed step.
+    Cloth serial(20, 20, 0.1f, 2000.0f, 20.0f);
+    Cloth threaded(20, 20, 0.1f, 2000.0f, 20.0f);
+    serial.gravityEnabled = true;
+    threaded.gravityEnabled = true;
+    serial.solverMode = SolverMode::Implicit;
+    threaded.solverMode = SolverMode::Implicit;
+    threaded.setThreadCount(4);
+
+    const float timeStep = 0.033f;
+    for (int step = 0; step < 60; ++step) {
+        glm::vec2 mouse(100.0f + step * 4.0f, 300.0f);
+        serial.applymouseconstraint(mouse, step < 20);
+        threaded.applymouseconstraint(mouse, step < 20);
+        serial.update(timeStep);
+        threaded.update(timeStep);
+        EXPECT_LT(serial.getImplicitSolver().getLastIterations(), serial.getImplicitSolver().maxIterations);
+    }
+
+    // The pattern holds the diagonal plus both blocks of every spring.
+    const BlockSparseMatrix& matrix = serial.getImplicitSolver().getMatrix();
+    EXPECT_EQ(matrix.blocks.size(), serial.getParticles().size() + 2 * serial.getSprings().size());
+
+    ParticleView particles = serial.getParticles();
+    ParticleView threadedParticles = threaded.getParticles();
+    for (size_t i = 0; i < particles.size(); ++i) {
+        glm::vec3 position = particles.position(i);
+        ASSERT_TRUE(std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z));
+        EXPECT_EQ(position, threadedParticles.position(i));
+    }
+
+    for (const Spring& spring : serial.getSprings()) {
+        float length = glm::distance(particles.position(spring.p1), particles.position(spring.p2));
+        EXPECT_LT(length, spring.restLength * 3.0f);
+    }
+}
+
+TEST(HierarchicalSolverTest, CoarseLevelsReduceStretch) {
+    auto meanStrain = [](SolverMode mode) {
+        Cloth cloth(64, 64, 2.0f / 64, 50000.0f, 20.0f);
+        cloth.gravityEnabled = true;
+        cloth.selfCollisionEnabled = false;
+        cloth.solverMode = mode;
+        for (int step = 0; step < 30; ++step) {
+            cloth.applymouseconstraint(glm::vec2(100.0f + step * 6.0f, 100.0f), true);
+            cloth.update(0.016f);
+        }
+
+        if (mode == SolverMode::Hierarchical) {
+            const ClothHierarchy& hierarchy = cloth.getHierarchy();
+            EXPECT_EQ(hierarchy.levelCount(), 4);
+            EXPECT_EQ(hierarchy.level(1).width, 32);
+            EXPECT_EQ(hierarchy.level(3).width, 8);
+            EXPECT_EQ(hierarchy.level(2).nodes[1], 4);
+        }
+
+        ParticleView particles = cloth.getParticles();
+        float sum = 0.0f;
+        int count = 0;
+        for (const Spring& spring : cloth.getSprings()) {
+            if (spring.restLength > cloth.spacing * 1.5f) continue;
+            float length = glm::distance(particles.position(spring.p1), particles.position(spring.p2));
+            sum += std::fabs(length / spring.restLength - 1.0f);
+            count++;
+        }
+        return sum / count;
+    };
+
+    float flat = meanStrain(SolverMode::XPBD);
+    float hierarchical = meanStrain(SolverMode::Hierarchical);
+
+    EXPECT_LT(hierarchical, flat * 0.25f);
+
+    // Changing the level count rebuilds the hierarchy on the next step.
+    Cloth cloth(64, 64, 2.0f / 64, 50.0f, 20.0f);
+    cloth.solverMode = SolverMode::Hierarchical;
+    cloth.update(0.016f);
+    EXPECT_EQ(cloth.getHierarchy().levelCount(), 4);
+    cloth.hierarchyLevels = 2;
+    cloth.update(0.016f);
+    EXPECT_EQ(cloth.getHierarchy().levelCount(), 2);
+}
+
+TEST(SleepingTest, RestingTilesSleepAndWakeOnMouse) {
+    Cloth cloth(40, 40, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    cloth.selfCollisionEnabled = false;
+    cloth.sleepingEnabled = true;
+    for (int step = 0; step < 800 && cloth.getSleepingTileCount() < 9; ++step) {
+        cloth.update(0.016f);
+    }
+    ASSERT_EQ(cloth.getSleepingTileCount(), 9);
+
+    ParticleView particles = cloth.getParticles();
+    std::vector<glm::vec3> resting;
+    for (size_t i = 0; i < particles.size(); ++i) resting.push_back(particles.position(i));
+
+    for (int step = 0; step < 10; ++step) cloth.update(0.016f);
+    for (size_t i = 0; i < particles.size(); ++i) {
+        EXPECT_TRUE(cloth.isAsleep(i));
+        EXPECT_EQ(cloth.getParticles().position(i), resting[i]);
+    }
+
+    // Grabbing the corner tile wakes it; tiles beyond the grab stay asleep.
+    cloth.applymouseconstraint(glm::vec2(0.0f, 600.0f), true);
+    cloth.update(0.016f);
+
+    EXPECT_LT(cloth.getSleepingTileCount(), 9);
+    EXPECT_GT(cloth.getSleepingTileCount(), 0);
+    EXPECT_FALSE(cloth.isAsleep(0));
+    EXPECT_TRUE(cloth.isAsleep(39 * 40 + 39));
+}
+
+TEST(SubsteppingTest, AccumulatesFrameTimeWithinBudget) {
+    Cloth cloth(20, 20, 0.1f, 50.0f, 20.0f);
+    EXPECT_FLOAT_EQ(cloth.getSubstepTime(), Cloth::fixedTimeStep);
+    EXPECT_EQ(cloth.advance(0.05f), 3);
+
+    // A one second hitch runs the budget and drops the rest.
+    EXPECT_EQ(cloth.advance(1.0f), cloth.maxSubsteps);
+    EXPECT_GT(cloth.droppedTime, 0.8);
+
+    // Stiffness past the explicit limit shrinks the substep instead of
+    // exploding.
+    Cloth stiff(20, 20, 0.1f, 2000.0f, 20.0f);
+    stiff.gravityEnabled = true;
+    EXPECT_LT(stiff.getSubstepTime(), Cloth::fixedTimeStep / 4.0f);
+    int substeps = 0;
+    for (int frame = 0; frame < 60; ++frame) {
+        stiff.advance(Cloth::fixedTimeStep, [&](float) {
+            stiff.applymouseconstraint(glm::vec2(100.0f + frame * 4.0f, 300.0f), frame < 20);
+            substeps++;
+        });
+    }
+    EXPECT_GT(substeps, 60 * 4);
+
+    ParticleView particles = stiff.getParticles();
+    for (const Spring& spring : stiff.getSprings()) {
+        float length = glm::distance(particles.position(spring.p1), particles.position(spring.p2));
+        ASSERT_TRUE(std::isfinite(length));
+        EXPECT_LT(length, spring.restLength * 3.0f);
+    }
+}
+
+TEST(CheckpointTest, RoundTripResumesBitExactly) {
+    Cloth cloth(24, 24, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    cloth.sleepingEnabled = true;
+    for (int i = 0; i < 40; ++i) cloth.update(Cloth::fixedTimeStep);
+
+    std::vector<uint8_t> checkpoint = cloth.saveCheckpoint();
+    Cloth restored(8, 8, 0.3f, 10.0f, 1.0f);
+    ASSERT_TRUE(restored.loadCheckpoint(checkpoint.data(), checkpoint.size()));
+    EXPECT_TRUE(restored.sleepingEnabled);
+    EXPECT_EQ(restored.getSprings().size(), cloth.getSprings().size());
+
+    for (int i = 0; i < 20; ++i) {
+        cloth.update(Cloth::fixedTimeStep);
+        restored.update(Cloth::fixedTimeStep);
+    }
+    ParticleView a = cloth.getParticles();
+    ParticleView b = restored.getParticles();
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        ASSERT_EQ(a.position(i), b.position(i)) << "particle " << i;
+    }
+
+    // advance() resumes with the saved time step and leftover frame time.
+    cloth.advance(0.025f);
+    checkpoint = cloth.saveCheckpoint();
+    Cloth midFrame(8, 8, 0.3f, 10.0f, 1.0f);
+    ASSERT_TRUE(midFrame.loadCheckpoint(checkpoint.data(), checkpoint.size()));
+    EXPECT_EQ(midFrame.advance(0.01f), cloth.advance(0.01f));
+    midFrame.update(Cloth::fixedTimeStep);
+    cloth.update(Cloth::fixedTimeStep);
+    for (size_t i = 0; i < a.size(); ++i) {
+        ASSERT_EQ(cloth.getParticles().position(i), midFrame.getParticles().position(i)) << "particle " << i;
+    }
+
+    // reset() goes back to the checkpoint taken at construction.
+    restored.reset();
+    EXPECT_EQ(restored.getParticles().position(24 * 5 + 7), glm::vec3(7 * 0.1f, 5 * 0.1f, 0.0f));
+
+    // Damaged or truncated buffers are rejected and leave the cloth intact.
+    std::vector<uint8_t> damaged = checkpoint;
+    damaged[0] ^= 0xff;
+    EXPECT_FALSE(restored.loadCheckpoint(damaged.data(), damaged.size()));
+    EXPECT_FALSE(restored.loadCheckpoint(checkpoint.data(), checkpoint.size() - 1));
+
+    // So is a spring list whose colors would race in the parallel solvers.
+    ClothCheckpointHeader header;
+    std::memcpy(&header, checkpoint.data(), sizeof(header));
+    damaged = checkpoint;
+    std::memcpy(damaged.data() + header.springOffset + sizeof(Spring), damaged.data() + header.springOffset,
+                sizeof(Spring));
+    EXPECT_FALSE(restored.loadCheckpoint(damaged.data(), damaged.size()));
+
+    // And out-of-range parameters.
+    ClothCheckpointHeader bad = header;
+    bad.spacing = NAN;
+    damaged = checkpoint;
+    std::memcpy(damaged.data(), &bad, sizeof(bad));
+    EXPECT_FALSE(restored.loadCheckpoint(damaged.data(), damaged.size()));
+    bad = header;
+    bad.solverMode = 7;
+    damaged = checkpoint;
+    std::memcpy(damaged.data(), &bad, sizeof(bad));
+    EXPECT_FALSE(restored.loadCheckpoint(damaged.data(), damaged.size()));
+    EXPECT_EQ(restored.getParticles().size(), 24u * 24u);
+}
+
+TEST(ClothRecorderTest, PlaybackMatchesRecordingWithinQuantum) {
+    const std::string path = ::testing::TempDir() + "cloth_recorder_test.clrec";
+    const int frames = 30;
+
+    Cloth cloth(24, 24, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    std::vector<ClothSnapshot> recorded(frames);
+
+    ClothRecorder recorder;
+    recorder.keyframeInterval = 10;
+    recorder.maxPendingFrames = frames;
+    ASSERT_TRUE(recorder.open(path, 24, 24));
+    for (int i = 0; i < frames; ++i) {
+        cloth.update(Cloth::fixedTimeStep);
+        recorded[i].capture(cloth, i);
+        ASSERT_TRUE(recorder.record(recorded[i]));
+    }
+    recorder.close();
+
+    EXPECT_EQ(recorder.getFramesWritten(), uint64_t(frames));
+    EXPECT_EQ(recorder.getDroppedFrames(), 0u);
+    EXPECT_LT(recorder.getBytesWritten(), frames * 24 * 24 * 3 * sizeof(float) / 2);
+
+    ClothPlayback playback;
+    ASSERT_TRUE(playback.open(path));
+    ASSERT_EQ(playback.frameCount(), size_t(frames));
+
+    const float tolerance = ClothRecorder::defaultQuantum * 0.5f + 1e-6f;
+    ClothSnapshot frame;
+    for (int i = 0; i < frames; ++i) {
+        ASSERT_TRUE(playback.readFrame(i, frame));
+        EXPECT_EQ(frame.step, uint64_t(i));
+        for (size_t p = 0; p < frame.size(); ++p) {
+            ASSERT_NEAR(frame.x[p], recorded[i].x[p], tolerance);
+            ASSERT_NEAR(frame.y[p], recorded[i].y[p], tolerance);
+            ASSERT_NEAR(frame.z[p], recorded[i].z[p], tolerance);
+        }
+    }
+
+    // Seeking decodes from the previous keyframe to the same result.
+    ClothSnapshot sequential = frame;
+    ASSERT_TRUE(playback.readFrame(25, frame));
+    ASSERT_TRUE(playback.readFrame(frames - 1, frame));
+    EXPECT_EQ(frame.y, sequential.y);
+    std::remove(path.c_str());
+}
+
+TEST(ClothTopologyTest, ObjMeshIsReorderedAndSimulates) {
+    // A 12x12 quad sheet with its vertices written in shuffled order.
+    const int n = 12;
+    std::vector<int> slot(n * n);
+    for (int i = 0; i < n * n; ++i) slot[i] = i;
+    std::shuffle(slot.begin(), slot.end(), std::mt19937(7));
+    std::vector<int> vertexAt(n * n);
+    for (int i = 0; i < n * n; ++i) vertexAt[slot[i]] = i;
+
+    std::stringstream obj;
+    obj << "# shuffled sheet\n";
+    for (int s = 0; s < n * n; ++s) {
+        int i = vertexAt[s];
+        obj << "v " << (i % n) * 0.1f << " " << (i / n) * 0.1f << " 0\n";
+    }
+    for (int y = 0; y + 1 < n; ++y) {
+        for (int x = 0; x + 1 < n; ++x) {
+            int i = y * n + x;
+            obj << "f " << slot[i] + 1 << "/1 " << slot[i + 1] + 1 << "/2 " << slot[i + n + 1] + 1 << "/3 "
+                << slot[i + n] + 1 << "/4\n";
+        }
+    }
+
+    auto mesh = std::make_shared<ClothTopology>();
+    ASSERT_TRUE(mesh->parseObj(obj));
+    EXPECT_EQ(mesh->vertexCount(), size_t(n * n));
+    EXPECT_EQ(mesh->triangles.size(), size_t((n - 1) * (n - 1) * 6));
+    EXPECT_NEAR(mesh->meanEdgeLength(), 0.1f, 1e-4f);
+
+    std::vector<Spring> springs;
+    mesh->buildSprings(50.0f, springs);
+    int bandwidth = 0;
+    int structural = 0;
+    for (const Spring& s : springs) {
+        bandwidth = std::max(bandwidth, std::abs(s.p1 - s.p2));
+        if (std::fabs(s.restLength - 0.1f) < 1e-4f) structural++;
+    }
+    EXPECT_EQ(structural, 2 * n * (n - 1));
+    // Reverse Cuthill-McKee keeps connected particles close in memory.
+    EXPECT_LE(bandwidth, 3 * n);
+
+    Cloth cloth(mesh, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    EXPECT_EQ(cloth.getParticles().size(), size_t(n * n));
+    for (int i = 0; i < 60; ++i) cloth.update(Cloth::fixedTimeStep);
+
+    ParticleView particles = cloth.getParticles();
+    for (const Spring& spring : cloth.getSprings()) {
+        float length = glm::distance(particles.position(spring.p1), particles.position(spring.p2));
+        ASSERT_TRUE(std::isfinite(length));
+        EXPECT_LT(length, spring.restLength * 3.0f);
+    }
+
+    // The renderer draws the mesh's own triangles.
+    ClothSnapshot snapshot;
+    snapshot.capture(cloth, 0);
+    ClothMesh render;
+    render.update(snapshot);
+    EXPECT_EQ(render.getIndices(), mesh->triangles);
+    for (size_t v = 0; v < snapshot.size(); ++v) {
+        const float* vertex = render.getVertices().data() + v * ClothMesh::floatsPerVertex;
+        EXPECT_NEAR(glm::length(glm::vec3(vertex[3], vertex[4], vertex[5])), 1.0f, 1e-4f);
+    }
+}
+
+TEST(ClothBatchTest, WorkStealingBatchMatchesSerialCloths) {
+    const int sizes[] = {40, 8, 24, 12, 8, 32};
+
+    ClothBatch batch(3);
+    std::vector<std::unique_ptr<Cloth>> reference;
+    for (int i = 0; i < 6; ++i) {
+        ClothInstanceConfig config;
+        config.width = sizes[i];
+        config.height = sizes[i];
+        config.stiffness = 30.0f + 10.0f * i;
+        config.damping = 10.0f + 2.0f * i;
+        config.solverMode = i % 2 ? SolverMode::XPBD : SolverMode::ForceSprings;
+        config.gravityEnabled = i != 3;
+        EXPECT_EQ(batch.add(config), size_t(i));
+
+        reference.push_back(std::make_unique<Cloth>(config.width, config.height, config.spacing,
+                                                    config.stiffness, config.damping));
+        reference.back()->solverMode = config.solverMode;
+        reference.back()->gravityEnabled = config.gravityEnabled;
+    }
+
+    batch.step(10);
+    batch.step(5);
+    for (auto& cloth : reference) {
+        for (int s = 0; s < 15; ++s) cloth->update(Cloth::fixedTimeStep);
+    }
+
+    EXPECT_EQ(batch.getClothSteps(), 6u * 15u);
+    ClothSnapshot snapshot;
+    for (int i = 0; i < 6; ++i) {
+        batch.capture(i, snapshot);
+        EXPECT_EQ(snapshot.step, 15u);
+        ParticleView expected = reference[i]->getParticles();
+        ASSERT_EQ(snapshot.size(), expected.size());
+        for (size_t p = 0; p < snapshot.size(); ++p) {
+            ASSERT_EQ(snapshot.position(p), expected.position(p)) << "cloth " << i << " particle " << p;
+        }
+    }
+}
+
+TEST(DeterminismTest, ThreadCountDoesNotChangeResults) {
+    const SolverMode modes[] = {SolverMode::ForceSprings, SolverMode::XPBD, SolverMode::Implicit,
+                                SolverMode::Hierarchical};
+
+    for (SolverMode mode : modes) {
+        // Large enough that every parallel loop splits into several chunks.
+        Cloth serial(72, 72, 0.03f, 50.0f, 20.0f);
+        Cloth parallel(72, 72, 0.03f, 50.0f, 20.0f);
+        for (Cloth* cloth : {&serial, &parallel}) {
+            cloth->solverMode = mode;
+            cloth->gravityEnabled = true;
+            cloth->sleepingEnabled = true;
+            cloth->randomSeed = 1234;
+        }
+        serial.setThreadCount(1);
+        parallel.setThreadCount(4);
+
+        for (int step = 0; step < 20; ++step) {
+            for (Cloth* cloth : {&serial, &parallel}) {
+                cloth->applywind(Cloth::fixedTimeStep);
+                cloth->update(Cloth::fixedTimeStep);
+            }
+        }
+
+        ParticleView a = serial.getParticles();
+        ParticleView b = parallel.getParticles();
+        for (size_t i = 0; i < a.size(); ++i) {
+            ASSERT_EQ(a.position(i), b.position(i)) << "mode " << static_cast<int>(mode) << " particle " << i;
+        }
+    }
+
+    // Another seed gives other gusts.
+    Cloth first(20, 20, 0.1f, 50.0f, 20.0f);
+    Cloth second(20, 20, 0.1f, 50.0f, 20.0f);
+    first.gravityEnabled = true;
+    second.gravityEnabled = true;
+    second.randomSeed = 99;
+    first.applywind(Cloth::fixedTimeStep);
+    second.applywind(Cloth::fixedTimeStep);
+    first.update(Cloth::fixedTimeStep);
+    second.update(Cloth::fixedTimeStep);
+    EXPECT_NE(first.getParticles().position(210), second.getParticles().position(210));
+}
+
+TEST(ClothPickingTest, RayGrabsFromAnyViewAndRadiusQueryMatchesBruteForce) {
+    Cloth cloth(40, 40, 0.05f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    cloth.solverMode = SolverMode::XPBD;
+    for (int step = 0; step < 30; ++step) {
+        cloth.applywind(Cloth::fixedTimeStep);
+        cloth.update(Cloth::fixedTimeStep);
+    }
+
+    ParticleView particles = cloth.getParticles();
+    std::vector<unsigned int> triangles;
+    ClothTopology::appendGridTriangles(40, 40, triangles);
+
+    // Nearest hit over every triangle, for reference.
+    auto bruteRaycast = [&](const glm::vec3& origin, const glm::vec3& direction) {
+        float best = -1.0f;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            glm::vec3 a = particles.position(triangles[t]);
+            glm::vec3 edge1 = particles.position(triangles[t + 1]) - a;
+            glm::vec3 edge2 = particles.position(triangles[t + 2]) - a;
+            glm::vec3 p = glm::cross(direction, edge2);
+            float determinant = glm::dot(edge1, p);
+            if (std::fabs(determinant) < 1e-12f) continue;
+            glm::vec3 s = origin - a;
+            float u = glm::dot(s, p) / determinant;
+            glm::vec3 q = glm::cross(s, edge1);
+            float v = glm::dot(direction, q) / determinant;
+            float distance = glm::dot(edge2, q) / determinant;
+            if (u < 0.0f || v < 0.0f || u + v > 1.0f || distance < 0.0f) continue;
+            if (best < 0.0f || distance < best) best = distance;
+        }
+        return best;
+    };
+
+    // Cameras off to the side, above and behind the moved cloth.
+    const glm::vec3 eyes[] = {glm::vec3(3.0f, 1.5f, 2.0f), glm::vec3(-1.0f, 4.0f, 1.0f), glm::vec3(1.0f, 0.5f, -3.0f)};
+    const size_t targets[] = {20 * 40 + 20, 8 * 40 + 31, 30 * 40 + 5};
+    for (const glm::vec3& eye : eyes) {
+        for (size_t target : targets) {
+            glm::vec3 direction = particles.position(target) - eye;
+            ClothRayHit hit;
+            ASSERT_TRUE(cloth.raycast(eye, direction, hit));
+            EXPECT_NEAR(hit.t, bruteRaycast(eye, direction), 1e-5f);
+        }
+    }
+    glm::vec3 away(0.0f, 0.0f, 5.0f);
+    ClothRayHit miss;
+    EXPECT_FALSE(cloth.raycast(away, glm::vec3(0.0f, 0.0f, 1.0f), miss));
+
+    std::vector<int> found;
+    for (size_t center : targets) {
+        for (float radius : {0.02f, 0.12f, 0.4f}) {
+            cloth.particlesWithin(particles.position(center), radius, found);
+            std::sort(found.begin(), found.end());
+            std::vector<int> expected;
+            for (size_t i = 0; i < particles.size(); ++i) {
+                glm::vec3 offset = particles.position(i) - particles.position(center);
+                if (glm::dot(offset, offset) < radius * radius) expected.push_back(static_cast<int>(i));
+            }
+            EXPECT_EQ(found, expected);
+        }
+    }
+
+    // Grab a free particle through a tilted ray, then drag the ray sideways:
+    // the particle follows at its grab depth.
+    const size_t target = 20 * 40 + 20;
+    glm::vec3 eye = eyes[0];
+    glm::vec3 direction = glm::normalize(particles.position(target) - eye);
+    ClothRayHit hit;
+    ASSERT_TRUE(cloth.raycast(eye, direction, hit));
+    ASSERT_NE(std::find(hit.vertices, hit.vertices + 3, static_cast<int>(target)), hit.vertices + 3);
+
+    cloth.applymouseconstraint(eye, direction, true);
+    glm::vec3 grabbed = particles.position(target);
+    glm::vec3 shift(0.0f, 0.1f, 0.0f);
+    cloth.applymouseconstraint(eye + shift, direction, true);
+    EXPECT_LT(glm::distance(particles.position(target), grabbed + shift * 0.8f), 1e-4f);
+
+    cloth.applymouseconstraint(eye + shift, direction, false);
+    glm::vec3 released = particles.position(target);
+    cloth.applymouseconstraint(away, glm::vec3(0.0f, 0.0f, 1.0f), true);
+    EXPECT_EQ(particles.position(target), released);
+}
+
+TEST(ColliderTest, BakedMeshMatchesAnalyticBoxAndClothStaysOutside) {
+    // A closed box mesh, twelve outward-facing triangles.
+    const glm::vec3 half(0.3f, 0.2f, 0.25f);
+    std::vector<glm::vec3> vertices;
+    for (int corner = 0; corner < 8; ++corner) {
+        vertices.push_back(glm::vec3(corner & 1 ? half.x : -half.x, corner & 2 ? half.y : -half.y,
+                                     corner & 4 ? half.z : -half.z));
+    }
+    const std::vector<unsigned int> triangles = {
+        0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+    };
+    auto field = std::make_shared<SignedDistanceField>();
+    const float cell = 0.02f;
+    ASSERT_TRUE(field->bake(vertices, triangles, cell));
+
+    const glm::vec3 center(0.45f, 0.15f, 0.05f);
+    ClothCollider baked = ClothCollider::mesh(field);
+    baked.position = center;
+    ClothCollider exact = ClothCollider::box(center, half);
+
+    std::mt19937 random(7);
+    // Within the grid: the default padding is three cells.
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    const glm::vec3 reach = half + glm::vec3(2.0f * cell);
+    for (int n = 0; n < 2000; ++n) {
+        glm::vec3 point = center + reach * glm::vec3(offset(random), offset(random), offset(random));
+        glm::vec3 bakedNormal, exactNormal;
+        float expected = exact.distance(point, exactNormal);
+        EXPECT_NEAR(baked.distance(point, bakedNormal), expected, cell) << glm::to_string(point);
+        // Inside, the normal flips across the box's medial planes.
+        if (expected > 2.0f * cell) {
+            EXPECT_GT(glm::dot(bakedNormal, exactNormal), 0.9f) << glm::to_string(point);
+        }
+    }
+    glm::vec3 normal;
+    EXPECT_EQ(baked.distance(center + glm::vec3(2.0f), normal), FLT_MAX);
+
+    // Drop a cloth onto a sphere and the baked box; no particle may end up
+    // inside either.
+    Cloth cloth(24, 24, 0.05f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    cloth.solverMode = SolverMode::XPBD;
+    cloth.colliders.push_back(ClothCollider::sphere(glm::vec3(1.1f, 0.1f, 0.0f), 0.2f));
+    cloth.colliders.push_back(baked);
+    for (int step = 0; step < 90; ++step) {
+        cloth.update(Cloth::fixedTimeStep);
+    }
+
+    ParticleView particles = cloth.getParticles();
+    int touching = 0;
+    for (size_t i = 0; i < particles.size(); ++i) {
+        for (const ClothCollider& collider : cloth.colliders) {
+            float distance = collider.distance(particles.position(i), normal);
+            EXPECT_GT(distance, 0.0f) << "particle " << i;
+            if (distance < 2.0f * collider.thickness) touching++;
+        }
+    }
+    EXPECT_GT(touching, 10);
+}
+
+TEST(ContinuousCollisionTest, FallingSheetDoesNotTunnelThroughSheetBelow) {
+    // Two separate sheets in one mesh: a wide one lying on a box and a
+    // smaller one above it, offset so no vertex sits exactly over a lower
+    // edge.
+    std::stringstream obj;
+    int base = 1;
+    auto sheet = [&](int n, const glm::vec3& corner) {
+        for (int i = 0; i < n * n; ++i) {
+            glm::vec3 p = corner + glm::vec3((i % n) * 0.1f, 0.0f, (i / n) * 0.1f);
+            obj << "v " << p.x << " " << p.y << " " << p.z << "\n";
+        }
+        for (int y = 0; y + 1 < n; ++y) {
+            for (int x = 0; x + 1 < n; ++x) {
+                int i = base + y * n + x;
+                obj << "f " << i << " " << i + 1 << " " << i + n + 1 << " " << i + n << "\n";
+            }
+        }
+        base += n * n;
+    };
+    sheet(16, glm::vec3(-0.75f, 0.51f, -0.75f));
+    sheet(10, glm::vec3(-0.42f, 0.9f, -0.41f));
+    auto mesh = std::make_shared<ClothTopology>();
+    ASSERT_TRUE(mesh->parseObj(obj));
+
+    // Lowest upper-sheet and highest lower-sheet particle after the drop.
+    auto drop = [&](bool continuous, float& lowestUpper, float& highestLower) {
+        Cloth cloth(mesh, 50.0f, 20.0f);
+        cloth.gravityEnabled = true;
+        cloth.solverMode = SolverMode::XPBD;
+        cloth.selfCollisionEnabled = false;
+        cloth.continuousCollisionEnabled = continuous;
+        cloth.colliders.push_back(ClothCollider::box(glm::vec3(0.0f, 0.25f, 0.0f), glm::vec3(1.0f, 0.25f, 1.0f)));
+        int contacts = 0;
+        for (int step = 0; step < 80; ++step) {
+            cloth.update(Cloth::fixedTimeStep);
+            contacts += cloth.getContinuousContactCount();
+        }
+        EXPECT_EQ(contacts > 0, continuous);
+
+        ParticleView particles = cloth.getParticles();
+        lowestUpper = FLT_MAX;
+        highestLower = -FLT_MAX;
+        for (size_t i = 0; i < particles.size(); ++i) {
+            float y = particles.position(i).y;
+            ASSERT_TRUE(std::isfinite(y));
+            if (mesh->restPositions[i].y > 0.7f) {
+                lowestUpper = std::min(lowestUpper, y);
+            } else {
+                highestLower = std::max(highestLower, y);
+            }
+        }
+    };
+
+    // Without continuous collision the upper sheet falls through onto the
+    // box, level with the lower one.
+    float lowestUpper, highestLower;
+    drop(false, lowestUpper, highestLower);
+    EXPECT_LT(lowestUpper, highestLower + 1e-3f);
+
+    // With it, the upper sheet rests on the lower one.
+    drop(true, lowestUpper, highestLower);
+    EXPECT_GT(lowestUpper, highestLower + 0.5f * 0.05f * mesh->meanEdgeLength());
+}
+
+TEST(ProfilerTest, ScopesReachPerThreadRingsAndCsv) {
+    ClothProfiler::clear();
+    ClothProfiler::setEnabled(true);
+
+    // A few steps and a normals pass record their phases.
+    Cloth cloth(16, 16, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    for (int i = 0; i < 5; ++i) cloth.update(Cloth::fixedTimeStep);
+    ClothSnapshot snapshot;
+    snapshot.capture(cloth, 0);
+    ClothMesh mesh;
+    mesh.update(snapshot);
+
+    std::vector<ProfileSample> samples;
+    ClothProfiler::collect(samples);
+    int counts[static_cast<size_t>(ProfilePhase::Count)] = {};
+    for (const ProfileSample& sample : samples) counts[static_cast<size_t>(sample.phase)]++;
+    EXPECT_EQ(counts[static_cast<size_t>(ProfilePhase::Gravity)], 5);
+    EXPECT_GE(counts[static_cast<size_t>(ProfilePhase::Springs)], 5);
+    EXPECT_EQ(counts[static_cast<size_t>(ProfilePhase::Integrate)], 5);
+    EXPECT_EQ(counts[static_cast<size_t>(ProfilePhase::Normals)], 1);
+    EXPECT_TRUE(std::is_sorted(samples.begin(), samples.end(), [](const ProfileSample& a, const ProfileSample& b) {
+        return a.start < b.start;
+    }));
+
+    // Two writers overrun their rings while a reader copies them. Every
+    // sample read back must be whole: its duration's parity names the
+    // writer, which must match the phase and stay on one ring.
+    ClothProfiler::clear();
+    const int perWriter = 3 * static_cast<int>(ProfileRing::capacity);
+    std::atomic<int> running{2};
+    auto writer = [&](int id) {
+        for (int i = 0; i < perWriter; ++i) {
+            uint64_t start = ClothProfiler::now();
+            ClothProfiler::record(id == 0 ? ProfilePhase::Springs : ProfilePhase::Wind, start,
+                                  start + 1 + 2 * static_cast<uint64_t>(i) + id);
+        }
+        // An exited thread's ring goes to the next new thread; stay alive
+        // so each writer keeps its own.
+        running--;
+        while (running > 0) std::this_thread::yield();
+    };
+    std::thread first(writer, 0);
+    std::thread second(writer, 1);
+    auto checkWhole = [](const std::vector<ProfileSample>& read) {
+        std::map<uint32_t, int> writerOf;
+        for (const ProfileSample& sample : read) {
+            int id = static_cast<int>((sample.duration - 1) % 2);
+            ASSERT_EQ(sample.phase, id == 0 ? ProfilePhase::Springs : ProfilePhase::Wind);
+            ASSERT_EQ(writerOf.emplace(sample.thread, id).first->second, id);
+        }
+    };
+    while (running > 0) {
+        ClothProfiler::collect(samples);
+        checkWhole(samples);
+    }
+    first.join();
+    second.join();
+    ClothProfiler::collect(samples);
+    checkWhole(samples);
+    EXPECT_EQ(samples.size(), 2 * ProfileRing::capacity);
+
+    // The CSV holds a header and one row per sample.
+    const std::string path = ::testing::TempDir() + "cloth_profile_test.csv";
+    ASSERT_TRUE(ClothProfiler::writeCsv(path));
+    std::ifstream csv(path);
+    std::string line;
+    ASSERT_TRUE(std::getline(csv, line));
+    EXPECT_EQ(line, "thread,phase,start_us,duration_us");
+    size_t rows = 0;
+    while (std::getline(csv, line)) rows++;
+    EXPECT_EQ(rows, samples.size());
+    std::remove(path.c_str());
+
+    // Disabled scopes record nothing.
+    ClothProfiler::setEnabled(false);
+    ClothProfiler::clear();
+    { ProfileScope scope(ProfilePhase::Draw); }
+    cloth.update(Cloth::fixedTimeStep);
+    ClothProfiler::collect(samples);
+    EXPECT_TRUE(samples.empty());
+}
+
+TEST(ProfilerTest, ChromeTraceNamesThreadsAndNestsPhasesInSteps) {
+    ClothProfiler::clear();
+    ClothProfiler::setEnabled(true);
+
+    std::thread worker([] {
+        ClothProfiler::setThreadName("solver \"test\"");
+        Cloth cloth(8, 8, 0.1f, 50.0f, 20.0f);
+        for (int i = 0; i < 3; ++i) cloth.update(Cloth::fixedTimeStep);
+    });
+    worker.join();
+    ClothProfiler::setEnabled(false);
+
+    std::vector<ProfileSample> samples;
+    ClothProfiler::collect(samples);
+    int steps = 0;
+    for (const ProfileSample& step : samples) {
+        if (step.phase != ProfilePhase::Step) continue;
+        steps++;
+        // Every other phase on the same thread falls inside some step.
+        for (const ProfileSample& inner : samples) {
+            if (inner.thread != step.thread || inner.phase == ProfilePhase::Step) continue;
+            if (inner.start < step.start || inner.start >= step.start + step.duration) continue;
+            EXPECT_LE(inner.start + inner.duration, step.start + step.duration);
+        }
+    }
+    EXPECT_EQ(steps, 3);
+
+    const std::string path = ::testing::TempDir() + "cloth_trace_test.json";
+    ASSERT_TRUE(ClothProfiler::writeChromeTrace(path));
+    std::ifstream trace(path);
+    std::string line;
+    ASSERT_TRUE(std::getline(trace, line));
+    EXPECT_EQ(line, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    size_t events = 0;
+    bool named = false;
+    std::string last;
+    while (std::getline(trace, line)) {
+        if (line.find("\"ph\":\"X\"") != std::string::npos) events++;
+        if (line.find("\"args\":{\"name\":\"solver \\\"test\\\"\"}") != std::string::npos) named = true;
+        last = line;
+    }
+    EXPECT_EQ(events, samples.size());
+    EXPECT_TRUE(named);
+    EXPECT_EQ(last, "]}");
+
+    // With every sample cleared only the thread names remain, and the event
+    // list must still close without a trailing comma.
+    ClothProfiler::clear();
+    ASSERT_TRUE(ClothProfiler::writeChromeTrace(path));
+    std::ifstream cleared(path);
+    std::string text((std::istreambuf_iterator<char>(cleared)), std::istreambuf_iterator<char>());
+    auto space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+    text.erase(std::remove_if(text.begin(), text.end(), space), text.end());
+    EXPECT_EQ(text.find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(text.find("thread_name"), std::string::npos);
+    EXPECT_EQ(text.find(",]"), std::string::npos);
+    EXPECT_EQ(text.find(",,"), std::string::npos);
+    EXPECT_EQ(text.substr(text.size() - 2), "]}");
+    std::remove(path.c_str());
+    ClothProfiler::clear();
+}
+
+TEST(AllocationTest, SteadyStateFramesDoNotAllocate) {
+    Cloth cloth(24, 24, 0.1f, 50.0f, 20.0f);
+    cloth.gravityEnabled = true;
+    cloth.setThreadCount(2);
+    cloth.sleepingEnabled = true;
+    cloth.colliders.push_back(ClothCollider::sphere(glm::vec3(1.5f, 0.5f, 0.3f), 0.4f));
+
+    ClothSnapshot snapshot;
+    ClothMesh mesh;
+    ThreadPool pool(2);
+    std::vector<float> mapped;
+    GLUploadTable gl;
+    gl.glMapBufferRange = [&](unsigned, std::ptrdiff_t, std::ptrdiff_t length, unsigned) -> void* {
+        return length <= static_cast<std::ptrdiff_t>(mapped.size() * sizeof(float)) ? mapped.data() : nullptr;
+    };
+    gl.glUnmapBuffer = [](unsigned) { return true; };
+    mapped.resize(24 * 24 * ClothMesh::floatsPerVertex);
+    ClothProfiler::setEnabled(true);
+
+    // What the simulation thread and the renderer do every frame: substeps
+    // with the cursor dragging the cloth through the wind, a published
+    // snapshot and a mapped vertex upload.
+    auto frame = [&](int index) {
+        cloth.advance(1.0f / 60.0f, [&](float substep) {
+            glm::vec3 origin(1.0f + 0.01f * (index % 40), 2.0f, 3.0f);
+            cloth.applymouseconstraint(origin, glm::vec3(0.0f, -0.3f, -1.0f), true);
+            cloth.applywind(substep);
+        });
+        snapshot.capture(cloth, index);
+        gl.beginFrame();
+        mesh.upload(gl, snapshot, &pool);
+    };
+
+    for (int i = 0; i < 60; ++i) frame(i);
+    allocationCount = 0;
+    countingAllocations = true;
+    for (int i = 60; i < 120; ++i) frame(i);
+    countingAllocations = false;
+    EXPECT_EQ(allocationCount.load(), 0u);
+
+    ClothProfiler::setEnabled(false);
+    ClothProfiler::clear();
+}
+
+TEST(GridStencilTest, StencilMatchesSpringListBitExactly) {
+    const SolverMode modes[] = {SolverMode::ForceSprings, SolverMode::XPBD};
+
+    for (SolverMode mode : modes) {
+        for (int threads : {1, 3}) {
+            // Odd sizes leave vector tails and both parities of every run.
+            Cloth stencil(37, 29, 0.04f, 50.0f, 20.0f);
+            Cloth list(37, 29, 0.04f, 50.0f, 20.0f);
+            list.useGridStencil = false;
+            ASSERT_TRUE(stencil.usesGridStencil());
+            ASSERT_FALSE(list.usesGridStencil());
+
+            for (Cloth* cloth : {&stencil, &list}) {
+                cloth->solverMode = mode;
+                cloth->gravityEnabled = true;
+                cloth->randomSeed = 5;
+                cloth->setThreadCount(threads);
+            }
+
+            for (int step = 0; step < 30; ++step) {
+                for (Cloth* cloth : {&stencil, &list}) {
+                    cloth->applymouseconstraint(glm::vec2(200.0f + step * 6.0f, 300.0f - step * 4.0f), step < 20);
+                    cloth->applywind(Cloth::fixedTimeStep);
+                    cloth->update(Cloth::fixedTimeStep);
+                }
+            }
+
+            ParticleView a = stencil.getParticles();
+            ParticleView b = list.getParticles();
+            for (size_t i = 0; i < a.size(); ++i) {
+                ASSERT_EQ(a.position(i), b.position(i))
+                    << "mode " << static_cast<int>(mode) << " threads " << threads << " particle " << i;
+            }
+        }
+    }
+
+    // A restored grid keeps the stencil; a mesh has none to use.
+    Cloth grid(8, 6, 0.1f, 50.0f, 20.0f);
+    std::vector<uint8_t> checkpoint = grid.saveCheckpoint();
+    ASSERT_TRUE(grid.loadCheckpoint(checkpoint.data(), checkpoint.size()));
+    EXPECT_TRUE(grid.usesGridStencil());
+
+    std::stringstream obj;
+    obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n";
+    auto mesh = std::make_shared<ClothTopology>();
+    ASSERT_TRUE(mesh->parseObj(obj));
+    Cloth sheet(mesh, 50.0f, 20.0f);
+    EXPECT_FALSE(sheet.usesGridStencil());
+    sheet.update(Cloth::fixedTimeStep);
+}